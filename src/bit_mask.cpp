@@ -0,0 +1,163 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bit_mask.h"
+
+using namespace std;
+using namespace cv;
+
+BitMask::BitMask()
+{
+    _rows = 0;
+    _cols = 0;
+    stride = 0;
+    
+    data = NULL;
+}
+
+
+BitMask::BitMask(const Mat &mask)
+{
+    _rows = mask.rows;
+    _cols = mask.cols;
+    
+    // one zero word of padding on each side of a row
+    stride = (_cols + 63)/64 + 2;
+    
+    words.assign(_rows*stride, 0);
+    
+    for(int y = 0; y < _rows; y++)
+    {
+        const uchar *maskRow = mask.ptr<uchar>(y);
+        uint64_t *row = &words[y*stride + 1];
+        
+        for(int x = 0; x < _cols; x++)
+        {
+            if(maskRow[x])
+            {
+                row[x >> 6] |= uint64_t(1) << (x & 63);
+            }
+        }
+    }
+    
+    data = words.data();
+}
+
+
+BitMask::BitMask(const BitMask &other)
+{
+    *this = other;
+}
+
+
+BitMask &BitMask::operator=(const BitMask &other)
+{
+    _rows = other._rows;
+    _cols = other._cols;
+    stride = other.stride;
+    
+    words = other.words;
+    
+    // owned words have to be referenced from the copy, external words are shared
+    data = words.empty() ? other.data : words.data();
+    
+    return *this;
+}
+
+
+void BitMask::setData(int rows, int cols, const uint64_t *data)
+{
+    _rows = rows;
+    _cols = cols;
+    
+    stride = (_cols + 63)/64 + 2;
+    
+    vector<uint64_t>().swap(words);
+    this->data = data;
+}
+
+
+int BitMask::rows() const
+{
+    return _rows;
+}
+
+
+int BitMask::cols() const
+{
+    return _cols;
+}
+
+
+const uint64_t *BitMask::getData() const
+{
+    return data;
+}
+
+
+size_t BitMask::getDataSize() const
+{
+    return (size_t)_rows*stride*sizeof(uint64_t);
+}
+
+
+int BitMask::countOverlap(const BitMask &mask, const Rect &roi, int offsetX, int offsetY) const
+{
+    // only the rows of the region that overlap with this mask contribute
+    int yStart = max(roi.y, -offsetY);
+    int yEnd = min(roi.y + roi.height, _rows - offsetY);
+    
+    int cnt = 0;
+    
+    for(int j = yStart; j < yEnd; j++)
+    {
+        for(int x = 0; x < roi.width; x += 64)
+        {
+            uint64_t maskWord = mask.window(j, roi.x + x);
+            
+            // clear the pixels beyond the right border of the region
+            int remaining = roi.width - x;
+            if(remaining < 64)
+                maskWord &= (uint64_t(1) << remaining) - 1;
+            
+            if(maskWord)
+            {
+                cnt += popcount64(maskWord & window(j + offsetY, roi.x + x + offsetX));
+            }
+        }
+    }
+    
+    return cnt;
+}
@@ -0,0 +1,182 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BIT_MASK_H
+#define BIT_MASK_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ *  Returns the number of set bits in a 64 bit word.
+ */
+inline int popcount64(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return (int)__popcnt64(word);
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/**
+ *  A binary image stored as bit-packed rows of 64 bit words, where bit k of
+ *  word w in a row represents the pixel in column 64*w + k. Each row is padded
+ *  with a zero word on both sides, such that a 64 pixel wide window starting at
+ *  any column (also partially or completely outside of the image) can be read
+ *  with two word loads and without any bounds checks per pixel. This allows to
+ *  count the overlap of two masks at an arbitrary 2D offset with a bitwise AND
+ *  and a popcount per 64 pixels.
+ */
+class BitMask
+{
+public:
+    BitMask();
+    
+    /**
+     *  Packs all non-zero pixels of a given image.
+     *
+     *  @param  mask The binary image to be packed (single channel, uchar).
+     */
+    BitMask(const cv::Mat &mask);
+    
+    BitMask(const BitMask &other);
+    
+    BitMask &operator=(const BitMask &other);
+    
+    /**
+     *  Returns the number of rows of the mask.
+     *
+     *  @return  The number of rows of the mask.
+     */
+    int rows() const;
+    
+    /**
+     *  Returns the number of columns of the mask.
+     *
+     *  @return  The number of columns of the mask.
+     */
+    int cols() const;
+    
+    /**
+     *  Sets the mask to reference previously packed words as returned by getData()
+     *  without copying them, e.g. within a memory-mapped file. The words must outlive
+     *  the mask and all of its copies.
+     *
+     *  @param  rows The number of rows of the mask.
+     *  @param  cols The number of columns of the mask.
+     *  @param  data The packed words of all rows including their padding, aligned to 8 bytes.
+     */
+    void setData(int rows, int cols, const uint64_t *data);
+    
+    /**
+     *  Returns the packed words of all rows including their padding.
+     *
+     *  @return  The packed words of the mask.
+     */
+    const uint64_t *getData() const;
+    
+    /**
+     *  Returns the size of the packed words of all rows including their padding.
+     *
+     *  @return  The size of the packed words in bytes.
+     */
+    size_t getDataSize() const;
+    
+    /**
+     *  Returns the 64 pixels of a row starting at a given column as a single word, where
+     *  pixels outside of the mask are 0.
+     *
+     *  @param  y The row to be read.
+     *  @param  x The first column of the window, which may be negative or beyond the last column.
+     *  @return  The pixels x, ..., x + 63 of row y in the bits 0, ..., 63.
+     */
+    inline uint64_t window(int y, int x) const
+    {
+        if(y < 0 || y >= _rows || x <= -64 || x >= _cols)
+            return 0;
+        
+        // shift by one padding word, such that the bit position is never negative
+        int b = x + 64;
+        const uint64_t *row = data + y*stride;
+        
+        int q = b >> 6;
+        int r = b & 63;
+        
+        if(r == 0)
+            return row[q];
+        
+        return (row[q] >> r) | (row[q + 1] << (64 - r));
+    }
+    
+    /**
+     *  Counts the number of pixels set in both this mask and a region of interest of another
+     *  mask placed at a given offset within this mask. Pixels of the other mask falling
+     *  outside of this mask are not counted.
+     *
+     *  @param  mask The other mask.
+     *  @param  roi The region of interest within the other mask to be considered.
+     *  @param  offsetX The column of this mask where column 0 of the other mask is placed.
+     *  @param  offsetY The row of this mask where row 0 of the other mask is placed.
+     *  @return  The number of overlapping pixels.
+     */
+    int countOverlap(const BitMask &mask, const cv::Rect &roi, int offsetX, int offsetY) const;
+    
+private:
+    int _rows;
+    int _cols;
+    
+    // the number of words per row including the padding
+    int stride;
+    
+    // the packed words owned by the mask, empty if it references external words
+    std::vector<uint64_t> words;
+    
+    // the packed words read by window(), either words.data() or external words
+    const uint64_t *data;
+};
+
+#endif //BIT_MASK_H
@@ -0,0 +1,117 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "file_utils.h"
+
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+using namespace std;
+
+
+static bool isFolder(const string &path)
+{
+    struct stat fileStat;
+    return stat(path.c_str(), &fileStat) == 0 && (fileStat.st_mode & S_IFDIR);
+}
+
+
+static void makeFolder(const string &path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+
+string getCacheFolder(const char *variable, const string &subfolder)
+{
+    string suffix = subfolder.empty() ? string("/rbot") : "/rbot/" + subfolder;
+    
+    const char *folder = getenv(variable);
+    if(folder)
+    {
+        return string(folder);
+    }
+#ifdef _WIN32
+    folder = getenv("LOCALAPPDATA");
+    if(folder && folder[0] != '\0')
+    {
+        return string(folder) + suffix;
+    }
+#else
+    folder = getenv("XDG_CACHE_HOME");
+    if(folder && folder[0] != '\0')
+    {
+        return string(folder) + suffix;
+    }
+    folder = getenv("HOME");
+    if(folder && folder[0] != '\0')
+    {
+        return string(folder) + "/.cache" + suffix;
+    }
+#endif
+    return string();
+}
+
+
+bool createFolders(const string &path)
+{
+#ifdef _WIN32
+    const char *separators = "/\\";
+#else
+    const char *separators = "/";
+#endif
+    
+    // create all parent folders first, skipping the root
+    for(size_t pos = path.find_first_of(separators, 1); pos != string::npos; pos = path.find_first_of(separators, pos + 1))
+    {
+        string parent = path.substr(0, pos);
+        if(!isFolder(parent))
+            makeFolder(parent);
+    }
+    
+    if(!isFolder(path))
+        makeFolder(path);
+    
+    return isFolder(path);
+}
@@ -0,0 +1,60 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILE_UTILS_H
+#define FILE_UTILS_H
+
+#include <string>
+
+/**
+ *  Returns a folder for files cached across runs, which is taken from a given environment
+ *  variable if set and otherwise is a subfolder of the folder rbot within the user's cache
+ *  directory ($XDG_CACHE_HOME or $HOME/.cache, %LOCALAPPDATA% on Windows).
+ *
+ *  @param  variable The name of the environment variable overriding the folder.
+ *  @param  subfolder The subfolder within the rbot cache folder (may be empty).
+ *  @return  The cache folder or an empty string if none could be determined.
+ */
+std::string getCacheFolder(const char *variable, const std::string &subfolder);
+
+/**
+ *  Creates a folder together with all of its missing parent folders.
+ *
+ *  @param  path The path of the folder.
+ *  @return  True if the folder exists afterwards and false otherwise.
+ */
+bool createFolders(const std::string &path);
+
+#endif //FILE_UTILS_H
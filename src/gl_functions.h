@@ -0,0 +1,71 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GL_FUNCTIONS_H
+#define GL_FUNCTIONS_H
+
+#ifdef RBOT_WITH_QT
+
+#include <QOpenGLFunctions_3_3_Core>
+
+/**
+ *  With Qt the OpenGL 3.3 core functions are resolved at runtime
+ *  for the current context by Qt.
+ */
+typedef QOpenGLFunctions_3_3_Core GLFunctions;
+
+#else
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/**
+ *  Without Qt the OpenGL 3.3 core functions are linked directly from the
+ *  vendor neutral OpenGL library, such that nothing has to be resolved at
+ *  runtime. This class only provides the same interface as its Qt counterpart.
+ */
+class GLFunctions
+{
+public:
+    bool initializeOpenGLFunctions()
+    {
+        return true;
+    }
+};
+
+#endif
+
+#endif /* GL_FUNCTIONS_H */
@@ -33,54 +33,26 @@
  * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef RBOT_WITH_QT
 #include <QApplication>
 #include <QThread>
+#endif
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 
 #include "object3d.h"
 #include "pose_estimator6d.h"
+#include "render_server.h"
 
 using namespace std;
 using namespace cv;
 
-cv::Mat drawResultOverlay(const vector<Object3D*>& objects, const cv::Mat& frame)
-{
-    // render the models with phong shading
-    RenderingEngine::Instance()->setLevel(0);
-    
-    vector<Point3f> colors;
-    colors.push_back(Point3f(1.0, 0.5, 0.0));
-    //colors.push_back(Point3f(0.2, 0.3, 1.0));
-    RenderingEngine::Instance()->renderShaded(vector<Model*>(objects.begin(), objects.end()), GL_FILL, colors, true);
-    
-    // download the rendering to the CPU
-    Mat rendering = RenderingEngine::Instance()->downloadFrame(RenderingEngine::RGB);
-    
-    // download the depth buffer to the CPU
-    Mat depth = RenderingEngine::Instance()->downloadFrame(RenderingEngine::DEPTH);
-    
-    // compose the rendering with the current camera image for demo purposes (can be done more efficiently directly in OpenGL)
-    Mat result = frame.clone();
-    for(int y = 0; y < frame.rows; y++)
-    {
-        for(int x = 0; x < frame.cols; x++)
-        {
-            Vec3b color = rendering.at<Vec3b>(y,x);
-            if(depth.at<float>(y,x) != 0.0f)
-            {
-                result.at<Vec3b>(y,x)[0] = color[2];
-                result.at<Vec3b>(y,x)[1] = color[1];
-                result.at<Vec3b>(y,x)[2] = color[0];
-            }
-        }
-    }
-    return result;
-}
-
 int main(int argc, char *argv[])
 {
+#ifdef RBOT_WITH_QT
+    // required by Qt for creating the offscreen OpenGL context
     QApplication a(argc, argv);
+#endif
 
     // camera image size
     int width = 640;
@@ -102,14 +74,29 @@ int main(int argc, char *argv[])
     objects.push_back(new Object3D("data/squirrel_demo_low.obj", 15, -35, 515, 55, -20, 205, 1.0, 0.55f, distances));
     //objects.push_back(new Object3D("data/a_second_model.obj", -50, 0, 600, 30, 0, 180, 1.0, 0.55f, distances2));
     
+    // create the rendering engine with its own OpenGL context used by the pose estimator (one per camera)
+    RenderingEngine* renderingEngine = new RenderingEngine();
+    
     // create the pose estimator
-    PoseEstimator6D* poseEstimator = new PoseEstimator6D(width, height, zNear, zFar, K, distCoeffs, objects);
+    PoseEstimator6D* poseEstimator = new PoseEstimator6D(width, height, zNear, zFar, K, distCoeffs, objects, renderingEngine);
     
-    // move the OpenGL context for offscreen rendering to the current thread, if run in a seperate QT worker thread (unnessary in this example)
-    //RenderingEngine::Instance()->getContext()->moveToThread(this);
+    // stop if no OpenGL context could be created for the rendering engine
+    if(!poseEstimator->isValid())
+    {
+        for(int i = 0; i < objects.size(); i++)
+        {
+            delete objects[i];
+        }
+        
+        delete poseEstimator;
+        delete renderingEngine;
+        
+        return -1;
+    }
     
-    // active the OpenGL context for the offscreen rendering engine during pose estimation
-    RenderingEngine::Instance()->makeCurrent();
+    // execute all renderings in a dedicated thread owning the OpenGL context for offscreen rendering
+    RenderServer* renderServer = new RenderServer(renderingEngine);
+    renderServer->start();
     
     int timeout = 0;
     
@@ -126,8 +113,13 @@ int main(int argc, char *argv[])
         
         cout << objects[0]->getPose() << endl;
         
-        // render the models with the resulting pose estimates ontop of the input image
-        Mat result = drawResultOverlay(objects, frame);
+        // render the models with the resulting pose estimates ontop of the input image,
+        // also before tracking is started such that the object can be aligned with them
+        renderingEngine->setLevel(0);
+        
+        vector<Point3f> colors;
+        colors.push_back(Point3f(1.0, 0.5, 0.0));
+        Mat result = renderingEngine->renderOverlay(frame, vector<Model*>(objects.begin(), objects.end()), colors, true);
         
         if(showHelp)
         {
@@ -160,12 +152,11 @@ int main(int argc, char *argv[])
             break;
     }
     
-    // deactivate the offscreen rendering OpenGL context
-    RenderingEngine::Instance()->doneCurrent();
+    // stop the render thread, which makes the OpenGL context current in this thread again
+    renderServer->stop();
+    delete renderServer;
     
     // clean up
-    RenderingEngine::Instance()->destroy();
-    
     for(int i = 0; i < objects.size(); i++)
     {
         delete objects[i];
@@ -173,4 +164,7 @@ int main(int argc, char *argv[])
     objects.clear();
     
     delete poseEstimator;
+    
+    // delete the rendering engine and its OpenGL context last
+    delete renderingEngine;
 }
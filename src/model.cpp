@@ -36,7 +36,12 @@
 #include "model.h"
 #include "tclc_histograms.h"
 
+#include <iostream>
+#include <cfloat>
 #include <limits>
+#include <algorithm>
+#include <unordered_set>
+#include <unordered_map>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -46,7 +51,7 @@
 using namespace std;
 using namespace cv;
 
-Model::Model(const string modelFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale)
+Model::Model(const string modelFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale, int numSamplePoints, int maxSilhouetteTriangles)
 {
     m_id = 0;
     
@@ -68,11 +73,25 @@ Model::Model(const string modelFilename, float tx, float ty, float tz, float alp
     
     hasNormals = false;
     
+    buffersInitialsed = false;
+    
+#ifdef RBOT_WITH_QT
     vertexBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
     normalBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
     indexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    silhouetteVertexBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    silhouetteIndexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+#endif
     
     loadModel(modelFilename);
+    
+    simplifySilhouetteMesh(maxSilhouetteTriangles);
+    
+    computeSamplePoints(numSamplePoints);
+    
+    computeEdgeAdjacency();
+    
+    computeVertexSampleIDs();
 }
 
 
@@ -86,6 +105,7 @@ Model::~Model()
     
     if(buffersInitialsed)
     {
+#ifdef RBOT_WITH_QT
         vertexBuffer.release();
         vertexBuffer.destroy();
         normalBuffer.release();
@@ -93,11 +113,31 @@ Model::~Model()
         
         indexBuffer.release();
         indexBuffer.destroy();
+        
+        if(!silhouetteIndices.empty())
+        {
+            silhouetteVertexBuffer.release();
+            silhouetteVertexBuffer.destroy();
+            silhouetteIndexBuffer.release();
+            silhouetteIndexBuffer.destroy();
+        }
+#else
+        glDeleteBuffers(1, &vertexBufferID);
+        glDeleteBuffers(1, &normalBufferID);
+        glDeleteBuffers(1, &indexBufferID);
+        
+        if(!silhouetteIndices.empty())
+        {
+            glDeleteBuffers(1, &silhouetteVertexBufferID);
+            glDeleteBuffers(1, &silhouetteIndexBufferID);
+        }
+#endif
     }
 }
 
 void Model::initBuffers()
 {
+#ifdef RBOT_WITH_QT
     vertexBuffer.create();
     vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
     vertexBuffer.bind();
@@ -113,6 +153,45 @@ void Model::initBuffers()
     indexBuffer.bind();
     indexBuffer.allocate(indices.data(), (int)indices.size() * sizeof(int));
     
+    // the silhouette mesh only exists if the full mesh had to be simplified
+    if(!silhouetteIndices.empty())
+    {
+        silhouetteVertexBuffer.create();
+        silhouetteVertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        silhouetteVertexBuffer.bind();
+        silhouetteVertexBuffer.allocate(silhouetteVertices.data(), (int)silhouetteVertices.size() * sizeof(Vec3f));
+        
+        silhouetteIndexBuffer.create();
+        silhouetteIndexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        silhouetteIndexBuffer.bind();
+        silhouetteIndexBuffer.allocate(silhouetteIndices.data(), (int)silhouetteIndices.size() * sizeof(int));
+    }
+#else
+    glGenBuffers(1, &vertexBufferID);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vec3f), vertices.data(), GL_STATIC_DRAW);
+    
+    glGenBuffers(1, &normalBufferID);
+    glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(Vec3f), normals.data(), GL_STATIC_DRAW);
+    
+    glGenBuffers(1, &indexBufferID);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), indices.data(), GL_STATIC_DRAW);
+    
+    // the silhouette mesh only exists if the full mesh had to be simplified
+    if(!silhouetteIndices.empty())
+    {
+        glGenBuffers(1, &silhouetteVertexBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, silhouetteVertexBufferID);
+        glBufferData(GL_ARRAY_BUFFER, silhouetteVertices.size() * sizeof(Vec3f), silhouetteVertices.data(), GL_STATIC_DRAW);
+        
+        glGenBuffers(1, &silhouetteIndexBufferID);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, silhouetteIndexBufferID);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, silhouetteIndices.size() * sizeof(int), silhouetteIndices.data(), GL_STATIC_DRAW);
+    }
+#endif
+    
     buffersInitialsed = true;
 }
 
@@ -129,20 +208,52 @@ bool Model::isInitialized()
 }
 
 
-void Model::draw(QOpenGLShaderProgram *program, GLint primitives)
+void Model::draw(ShaderProgram *program, GLint primitives, bool silhouetteMesh)
 {
+    if(silhouetteMesh && !silhouetteIndices.empty())
+    {
+#ifdef RBOT_WITH_QT
+        silhouetteVertexBuffer.bind();
+#else
+        glBindBuffer(GL_ARRAY_BUFFER, silhouetteVertexBufferID);
+#endif
+        program->enableAttributeArray("aPosition");
+        program->setAttributeBuffer("aPosition", GL_FLOAT, 0, 3, sizeof(Vec3f));
+        
+#ifdef RBOT_WITH_QT
+        silhouetteIndexBuffer.bind();
+#else
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, silhouetteIndexBufferID);
+#endif
+        glDrawElements(primitives, (GLsizei)silhouetteIndices.size(), GL_UNSIGNED_INT, (GLvoid*)0);
+        
+        return;
+    }
+    
+#ifdef RBOT_WITH_QT
     vertexBuffer.bind();
+#else
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+#endif
     program->enableAttributeArray("aPosition");
     program->setAttributeBuffer("aPosition", GL_FLOAT, 0, 3, sizeof(Vec3f));
     
+#ifdef RBOT_WITH_QT
     normalBuffer.bind();
+#else
+    glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
+#endif
     program->enableAttributeArray("aNormal");
     program->setAttributeBuffer("aNormal", GL_FLOAT, 0, 3, sizeof(Vec3f));
     
     program->enableAttributeArray("aColor");
     program->setAttributeBuffer("aColor", GL_UNSIGNED_BYTE, 0, 3, sizeof(Vec3b));
     
+#ifdef RBOT_WITH_QT
     indexBuffer.bind();
+#else
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+#endif
     
     for (uint i = 0; i < offsets.size() - 1; i++) {
         GLuint size = offsets.at(i + 1) - offsets.at(i);
@@ -150,6 +261,10 @@ void Model::draw(QOpenGLShaderProgram *program, GLint primitives)
         
         glDrawElements(primitives, size, GL_UNSIGNED_INT, (GLvoid*)(offset*sizeof(GLuint)));
     }
+    
+    // the silhouette mesh only provides positions, so no other arrays may stay enabled for its draws
+    program->disableAttributeArray("aNormal");
+    program->disableAttributeArray("aColor");
 }
 
 
@@ -190,7 +305,7 @@ float Model::getScaling() {
 }
 
 
-vector<Vec3f> Model::getVertices()
+const vector<Vec3f> &Model::getVertices()
 {
     return vertices;
 }
@@ -200,6 +315,68 @@ int Model::getNumVertices()
     return (int)vertices.size();
 }
 
+const vector<GLuint> &Model::getIndices()
+{
+    return indices;
+}
+
+const vector<Vec3f> &Model::getSilhouetteVertices()
+{
+    return silhouetteIndices.empty() ? vertices : silhouetteVertices;
+}
+
+const vector<GLuint> &Model::getSilhouetteIndices()
+{
+    return silhouetteIndices.empty() ? indices : silhouetteIndices;
+}
+
+const vector<Vec3f> &Model::getSamplePoints()
+{
+    return samplePoints;
+}
+
+int Model::getNumSamplePoints()
+{
+    return (int)samplePoints.size();
+}
+
+void Model::computeContourEdges(const Vec3f &viewpoint, vector<Vec2i> &edges)
+{
+    edges.clear();
+    
+    const vector<Vec3f> &meshVertices = getSilhouetteVertices();
+    
+    for(int e = 0; e < edgeVertices.size(); e++)
+    {
+        // both adjacent triangles are checked against a vertex of the shared edge
+        Vec3f viewRay = meshVertices[edgeVertices[e][0]] - viewpoint;
+        
+        bool frontFacing0 = faceNormals[edgeFaces[e][0]].dot(viewRay) < 0;
+        
+        if(edgeFaces[e][1] < 0)
+        {
+            if(frontFacing0)
+            {
+                edges.push_back(edgeVertices[e]);
+            }
+        }
+        else
+        {
+            bool frontFacing1 = faceNormals[edgeFaces[e][1]].dot(viewRay) < 0;
+            
+            if(frontFacing0 != frontFacing1)
+            {
+                edges.push_back(edgeVertices[e]);
+            }
+        }
+    }
+}
+
+const vector<int> &Model::getVertexSampleIDs()
+{
+    return vertexSampleIDs;
+}
+
 
 int Model::getModelID()
 {
@@ -284,3 +461,284 @@ void Model::loadModel(const string modelFilename)
     
     //T_n = Transformations::scaleMatrix(scaling);
 }
+
+
+void Model::simplifySilhouetteMesh(int maxTriangles)
+{
+    silhouetteVertices.clear();
+    silhouetteIndices.clear();
+    
+    int numTriangles = (int)indices.size()/3;
+    if(maxTriangles <= 0 || numTriangles <= maxTriangles)
+        return;
+    
+    // start with voxels about the size of the triangles that would remain
+    // if the surface was evenly covered by the maximum number of triangles
+    float surfaceArea = 0;
+    for(int t = 0; t < numTriangles; t++)
+    {
+        Vec3f v0 = vertices[indices[3*t]];
+        surfaceArea += 0.5f*norm((vertices[indices[3*t + 1]] - v0).cross(vertices[indices[3*t + 2]] - v0));
+    }
+    float voxelSize = sqrt(2.0f*surfaceArea/maxTriangles);
+    
+    Vec3f extent = rtf - lbn;
+    
+    vector<int> clusterIDs(vertices.size());
+    
+    for(int iteration = 0; iteration < 32 && voxelSize > 0; iteration++)
+    {
+        int nx = (int)(extent[0]/voxelSize) + 1;
+        int ny = (int)(extent[1]/voxelSize) + 1;
+        
+        // all verticies within the same voxel are merged into their mean
+        unordered_map<long long, int> voxelClusters;
+        vector<Vec3f> clusterSums;
+        vector<int> clusterCounts;
+        
+        for(int i = 0; i < vertices.size(); i++)
+        {
+            Vec3f p = vertices[i] - lbn;
+            long long key = ((long long)(p[2]/voxelSize)*ny + (long long)(p[1]/voxelSize))*nx + (long long)(p[0]/voxelSize);
+            
+            unordered_map<long long, int>::iterator it = voxelClusters.find(key);
+            if(it == voxelClusters.end())
+            {
+                it = voxelClusters.insert(make_pair(key, (int)clusterSums.size())).first;
+                clusterSums.push_back(Vec3f(0, 0, 0));
+                clusterCounts.push_back(0);
+            }
+            clusterIDs[i] = it->second;
+            clusterSums[it->second] += vertices[i];
+            clusterCounts[it->second]++;
+        }
+        
+        // triangles collapsed within a single voxel or onto an edge are dropped
+        silhouetteIndices.clear();
+        for(int t = 0; t < numTriangles; t++)
+        {
+            int c0 = clusterIDs[indices[3*t]];
+            int c1 = clusterIDs[indices[3*t + 1]];
+            int c2 = clusterIDs[indices[3*t + 2]];
+            
+            if(c0 != c1 && c1 != c2 && c0 != c2)
+            {
+                silhouetteIndices.push_back(c0);
+                silhouetteIndices.push_back(c1);
+                silhouetteIndices.push_back(c2);
+            }
+        }
+        
+        if(silhouetteIndices.size()/3 <= maxTriangles)
+        {
+            silhouetteVertices.resize(clusterSums.size());
+            for(int c = 0; c < clusterSums.size(); c++)
+            {
+                silhouetteVertices[c] = clusterSums[c]/(float)clusterCounts[c];
+            }
+            return;
+        }
+        
+        voxelSize *= 1.25f;
+    }
+    
+    // the full mesh is used if no sufficient simplification was found
+    cout << "error simplifying the silhouette mesh" << endl;
+    silhouetteIndices.clear();
+}
+
+
+void Model::computeSamplePoints(int numSamples)
+{
+    samplePoints.clear();
+    sampleSpacing = 0;
+    
+    const vector<Vec3f> &meshVertices = getSilhouetteVertices();
+    const vector<GLuint> &meshIndices = getSilhouetteIndices();
+    
+    int numTriangles = (int)meshIndices.size()/3;
+    if(numSamples <= 0 || numTriangles == 0)
+        return;
+    
+    // the cumulative triangle areas for drawing triangles wrt their area
+    vector<double> cumulativeAreas(numTriangles);
+    double surfaceArea = 0;
+    for(int t = 0; t < numTriangles; t++)
+    {
+        Vec3f v0 = meshVertices[meshIndices[3*t]];
+        surfaceArea += 0.5*norm((meshVertices[meshIndices[3*t + 1]] - v0).cross(meshVertices[meshIndices[3*t + 2]] - v0));
+        cumulativeAreas[t] = surfaceArea;
+    }
+    if(surfaceArea <= 0)
+        return;
+    
+    // oversample the surface randomly with a fixed seed for reproducible histogram centers
+    RNG rng(0x52424f54);
+    
+    vector<Vec3f> candidates(4*numSamples);
+    for(int i = 0; i < candidates.size(); i++)
+    {
+        double a = rng.uniform(0.0, surfaceArea);
+        int t = (int)(lower_bound(cumulativeAreas.begin(), cumulativeAreas.end(), a) - cumulativeAreas.begin());
+        t = min(t, numTriangles - 1);
+        
+        // uniformly distributed barycentric coordinates
+        float r1 = sqrt(rng.uniform(0.0f, 1.0f));
+        float r2 = rng.uniform(0.0f, 1.0f);
+        
+        Vec3f v0 = meshVertices[meshIndices[3*t]];
+        Vec3f v1 = meshVertices[meshIndices[3*t + 1]];
+        Vec3f v2 = meshVertices[meshIndices[3*t + 2]];
+        
+        candidates[i] = (1.0f - r1)*v0 + r1*(1.0f - r2)*v1 + r1*r2*v2;
+    }
+    
+    // keep one candidate per voxel, where a surface covers about area/voxelSize^2 voxels,
+    // and increase the voxel size until no more than the desired number of points remains
+    float voxelSize = (float)sqrt(surfaceArea/numSamples);
+    
+    Vec3f extent = rtf - lbn;
+    
+    do
+    {
+        sampleSpacing = voxelSize;
+        
+        samplePoints.clear();
+        
+        int nx = (int)(extent[0]/voxelSize) + 1;
+        int ny = (int)(extent[1]/voxelSize) + 1;
+        
+        unordered_set<long long> occupiedVoxels;
+        for(int i = 0; i < candidates.size(); i++)
+        {
+            Vec3f p = candidates[i] - lbn;
+            long long key = ((long long)(p[2]/voxelSize)*ny + (long long)(p[1]/voxelSize))*nx + (long long)(p[0]/voxelSize);
+            
+            if(occupiedVoxels.insert(key).second)
+            {
+                samplePoints.push_back(candidates[i]);
+            }
+        }
+        
+        voxelSize *= 1.1f;
+    }
+    while(samplePoints.size() > numSamples);
+}
+
+
+void Model::computeEdgeAdjacency()
+{
+    edgeVertices.clear();
+    edgeFaces.clear();
+    faceNormals.clear();
+    
+    const vector<Vec3f> &meshVertices = getSilhouetteVertices();
+    const vector<GLuint> &meshIndices = getSilhouetteIndices();
+    
+    int numTriangles = (int)meshIndices.size()/3;
+    
+    faceNormals.resize(numTriangles);
+    
+    unordered_map<long long, int> edgeIDs;
+    
+    for(int t = 0; t < numTriangles; t++)
+    {
+        Vec3f v0 = meshVertices[meshIndices[3*t]];
+        faceNormals[t] = (meshVertices[meshIndices[3*t + 1]] - v0).cross(meshVertices[meshIndices[3*t + 2]] - v0);
+        
+        for(int k = 0; k < 3; k++)
+        {
+            int a = meshIndices[3*t + k];
+            int b = meshIndices[3*t + (k + 1)%3];
+            if(a > b) swap(a, b);
+            
+            long long key = (long long)a*(long long)meshVertices.size() + b;
+            
+            unordered_map<long long, int>::iterator it = edgeIDs.find(key);
+            if(it == edgeIDs.end())
+            {
+                edgeIDs.insert(make_pair(key, (int)edgeVertices.size()));
+                edgeVertices.push_back(Vec2i(a, b));
+                edgeFaces.push_back(Vec2i(t, -1));
+            }
+            else if(edgeFaces[it->second][1] < 0)
+            {
+                // further triangles of non-manifold edges are ignored
+                edgeFaces[it->second][1] = t;
+            }
+        }
+    }
+}
+
+
+void Model::computeVertexSampleIDs()
+{
+    const vector<Vec3f> &meshVertices = getSilhouetteVertices();
+    
+    vertexSampleIDs.assign(meshVertices.size(), -1);
+    
+    if(samplePoints.empty())
+        return;
+    
+    Vec3f extent = rtf - lbn;
+    
+    int nx = (int)(extent[0]/sampleSpacing) + 1;
+    int ny = (int)(extent[1]/sampleSpacing) + 1;
+    int nz = (int)(extent[2]/sampleSpacing) + 1;
+    
+    // at most one sample point lies within each voxel of the spacing size
+    unordered_map<long long, int> voxelSamples;
+    for(int s = 0; s < samplePoints.size(); s++)
+    {
+        Vec3f p = samplePoints[s] - lbn;
+        long long key = ((long long)(p[2]/sampleSpacing)*ny + (long long)(p[1]/sampleSpacing))*nx + (long long)(p[0]/sampleSpacing);
+        voxelSamples.insert(make_pair(key, s));
+    }
+    
+    int maxRadius = max(nx, max(ny, nz));
+    
+    for(int i = 0; i < meshVertices.size(); i++)
+    {
+        Vec3f p = meshVertices[i] - lbn;
+        int x = (int)(p[0]/sampleSpacing);
+        int y = (int)(p[1]/sampleSpacing);
+        int z = (int)(p[2]/sampleSpacing);
+        
+        float minDist = FLT_MAX;
+        
+        // grow the searched block of voxels until no closer sample can lie outside of it
+        for(int r = 1; r <= maxRadius; r++)
+        {
+            for(int dz = -r; dz <= r; dz++)
+            {
+                for(int dy = -r; dy <= r; dy++)
+                {
+                    for(int dx = -r; dx <= r; dx++)
+                    {
+                        // only the shell of the block has not been searched before
+                        if(r > 1 && abs(dx) < r && abs(dy) < r && abs(dz) < r)
+                            continue;
+                        
+                        if(x + dx < 0 || x + dx >= nx || y + dy < 0 || y + dy >= ny || z + dz < 0 || z + dz >= nz)
+                            continue;
+                        
+                        long long key = ((long long)(z + dz)*ny + (y + dy))*nx + (x + dx);
+                        
+                        unordered_map<long long, int>::iterator it = voxelSamples.find(key);
+                        if(it != voxelSamples.end())
+                        {
+                            float dist = (float)norm(samplePoints[it->second] - meshVertices[i]);
+                            if(dist < minDist)
+                            {
+                                minDist = dist;
+                                vertexSampleIDs[i] = it->second;
+                            }
+                        }
+                    }
+                }
+            }
+            if(minDist <= r*sampleSpacing)
+                break;
+        }
+    }
+}
@@ -36,12 +36,15 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#ifdef RBOT_WITH_QT
 #include <QOpenGLBuffer>
-#include <QOpenGLShaderProgram>
+#endif
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "gl_functions.h"
+#include "shader_program.h"
 #include "transformations.h"
 
 /**
@@ -50,7 +53,11 @@
  *  model data from a specified file, drawing the model with OpenGL
  *  as well as calculating the bounding box of the model and setting
  *  individual vertex colors. The model data is uploaded to the GPU in
- *  form of VertexBufferObjects.
+ *  form of VertexBufferObjects. Independent of the resolution of the
+ *  mesh, a bounded set of uniformly distributed surface sample points
+ *  is generated for the tclc-histograms and meshes with too many
+ *  triangles are simplified for rendering silhouettes, while the full
+ *  mesh is kept for shaded renderings.
  */
 class Model
 {
@@ -71,8 +78,10 @@ public:
      *  @param beta  The models initial Euler angle rotation about Y-axis of the camera.
      *  @param gamma  The models initial Euler angle rotation about Z-axis of the camera.
      *  @param scale  A scaling factor applied to the model in order change its size independent of the original data.
+     *  @param numSamplePoints  The approximate number of surface sample points used as histogram centers (default = 5000).
+     *  @param maxSilhouetteTriangles  The maximum number of triangles for rendering silhouettes, above which the mesh is simplified (default = 50000).
      */
-    Model(const std::string modelFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale);
+    Model(const std::string modelFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale, int numSamplePoints = 5000, int maxSilhouetteTriangles = 50000);
     
     ~Model();
     
@@ -82,8 +91,9 @@ public:
      *
      *  @param  program    The shader programm to be used.
      *  @param  primitives The primitive type that shall be used for drawing (e.g. GL_POINTS, GL_LINES,...). The default value is set to GL_TRIANGLES.
+     *  @param  silhouetteMesh Whether to draw the simplified silhouette mesh, which only provides vertex positions (default = false).
      */
-    void draw(QOpenGLShaderProgram *program, GLint primitives = GL_TRIANGLES);
+    void draw(ShaderProgram *program, GLint primitives = GL_TRIANGLES, bool silhouetteMesh = false);
     
     /**
      *  The 3d data is packed into VOBs and uploaded to the GPU.
@@ -193,7 +203,7 @@ public:
      *
      *  @return  A vector containing all unnormalized 3D model verticies.
      */
-    std::vector<cv::Vec3f> getVertices();
+    const std::vector<cv::Vec3f> &getVertices();
     
     /**
      *  Returns the total number of 3D model verticies.
@@ -202,6 +212,69 @@ public:
      */
     int getNumVertices();
     
+    /**
+     *  Returns the vertex indices of all triangles of the model,
+     *  where every three consecutive indices form one triangle.
+     *
+     *  @return  The vertex indices of all triangles of the model.
+     */
+    const std::vector<GLuint> &getIndices();
+    
+    /**
+     *  Returns the unnormalized 3D verticies of the mesh used for rendering
+     *  silhouettes. This is the simplified mesh if the full mesh exceeds the
+     *  maximum number of silhouette triangles and the full mesh otherwise.
+     *
+     *  @return  The unnormalized 3D verticies of the silhouette mesh.
+     */
+    const std::vector<cv::Vec3f> &getSilhouetteVertices();
+    
+    /**
+     *  Returns the vertex indices of all triangles of the mesh used for
+     *  rendering silhouettes, where every three consecutive indices form
+     *  one triangle.
+     *
+     *  @return  The vertex indices of all triangles of the silhouette mesh.
+     */
+    const std::vector<GLuint> &getSilhouetteIndices();
+    
+    /**
+     *  Returns the unnormalized 3D surface sample points [X_m, Y_m, Z_m]
+     *  used as the centers of the tclc-histograms. These are distributed
+     *  uniformly across the surface of the silhouette mesh, such that they
+     *  are consistent with the rendered silhouettes.
+     *
+     *  @return  The unnormalized 3D surface sample points of the model.
+     */
+    const std::vector<cv::Vec3f> &getSamplePoints();
+    
+    /**
+     *  Returns the total number of 3D surface sample points.
+     *
+     *  @return  The total number of 3D surface sample points.
+     */
+    int getNumSamplePoints();
+    
+    /**
+     *  Extracts the contour edges of the silhouette mesh as seen from a given viewpoint
+     *  directly from the mesh, i.e. all edges shared by a front and a back facing triangle
+     *  as well as open boundary edges of front facing triangles. This does not require a
+     *  rendering, but also includes contour edges that are occluded by other parts of the
+     *  model.
+     *
+     *  @param  viewpoint The camera center in unnormalized model coordinates.
+     *  @param  edges The resulting pairs of silhouette mesh vertex indices of all contour edges.
+     */
+    void computeContourEdges(const cv::Vec3f &viewpoint, std::vector<cv::Vec2i> &edges);
+    
+    /**
+     *  Returns the index of the closest surface sample point for each vertex of the
+     *  silhouette mesh, such that contour vertices can be assigned to histograms.
+     *
+     *  @return  The indices of the closest surface sample points of all silhouette mesh verticies.
+     */
+    const std::vector<int> &getVertexSampleIDs();
+    
     /**
      *  Returns the index of the model. These indices should be
      *  unique and within [1,255] as they also define the rendering
@@ -244,9 +317,31 @@ private:
     std::vector<GLuint> indices;
     std::vector<GLuint> offsets;
     
+    std::vector<cv::Vec3f> silhouetteVertices;
+    std::vector<GLuint> silhouetteIndices;
+    
+    std::vector<cv::Vec3f> samplePoints;
+    float sampleSpacing;
+    
+    std::vector<cv::Vec2i> edgeVertices;
+    std::vector<cv::Vec2i> edgeFaces;
+    std::vector<cv::Vec3f> faceNormals;
+    
+    std::vector<int> vertexSampleIDs;
+    
+#ifdef RBOT_WITH_QT
     QOpenGLBuffer vertexBuffer;
     QOpenGLBuffer normalBuffer;
     QOpenGLBuffer indexBuffer;
+    QOpenGLBuffer silhouetteVertexBuffer;
+    QOpenGLBuffer silhouetteIndexBuffer;
+#else
+    GLuint vertexBufferID;
+    GLuint normalBufferID;
+    GLuint indexBufferID;
+    GLuint silhouetteVertexBufferID;
+    GLuint silhouetteIndexBufferID;
+#endif
     
     bool buffersInitialsed;
     
@@ -261,6 +356,38 @@ private:
      *  @param  objFilename The relative path to the OBJ/PLY file.
      */
     void loadModel(const std::string modelFilename);
+    
+    /**
+     *  Simplifies the mesh for rendering silhouettes by clustering its
+     *  verticies within a regular voxel grid, where the voxel size is
+     *  increased until the number of remaining non-degenerate triangles
+     *  does not exceed the given maximum.
+     *
+     *  @param  maxTriangles The maximum number of silhouette triangles.
+     */
+    void simplifySilhouetteMesh(int maxTriangles);
+    
+    /**
+     *  Samples points uniformly across the surface of the silhouette mesh
+     *  by drawing random points from the triangles wrt to their area and
+     *  thinning them within a regular voxel grid, such that about the
+     *  given number of evenly spaced points remains.
+     *
+     *  @param  numSamples The desired number of sample points.
+     */
+    void computeSamplePoints(int numSamples);
+    
+    /**
+     *  Computes the unique edges of the silhouette mesh together with the
+     *  one or two triangles adjacent to each edge and the triangle normals.
+     */
+    void computeEdgeAdjacency();
+    
+    /**
+     *  Assigns the closest surface sample point to each vertex of the
+     *  silhouette mesh using a regular voxel grid of the sample points.
+     */
+    void computeVertexSampleIDs();
 };
 
 #endif /* MODEL_H */
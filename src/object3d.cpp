@@ -36,6 +36,10 @@
 #include "object3d.h"
 #include "tclc_histograms.h"
 #include "template_view.h"
+#include "template_database.h"
+#include "template_tree.h"
+
+#include <cstdio>
 
 using namespace std;
 using namespace cv;
@@ -45,7 +49,7 @@ bool sortDistance(std::pair<float, int> a, std::pair<float, int> b)
     return a.first < b.first;
 }
 
-Object3D::Object3D(const string objFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale, float qualityThreshold,  vector<float> &templateDistances) : Model(objFilename, tx, ty, tz, alpha, beta, gamma, scale)
+Object3D::Object3D(const string objFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale, float qualityThreshold,  vector<float> &templateDistances, int numSamplePoints, int maxSilhouetteTriangles) : Model(objFilename, tx, ty, tz, alpha, beta, gamma, scale, numSamplePoints, maxSilhouetteTriangles)
 {
     this->trackingLost = false;
     
@@ -57,6 +61,12 @@ Object3D::Object3D(const string objFilename, float tx, float ty, float tz, float
     
     this->tclcHistograms = new TCLCHistograms(this, 32, 40, 10.0f);
     
+    this->templateFolder = TemplateDatabase::getDefaultFolder();
+    
+    this->templateDatabase = new TemplateDatabase();
+    
+    this->templateTree = new TemplateTree();
+    
     // icosahedron geometry for generating the base templates
     baseIcosahedron.push_back(Vec3f(0, 1, 1.61803));
     baseIcosahedron.push_back(Vec3f(1, 1.61803, 0));
@@ -121,6 +131,8 @@ Object3D::~Object3D()
 {
     delete tclcHistograms;
     
+    delete templateTree;
+    
     for(int i = 0; i < baseTemplates.size(); i++)
     {
         delete baseTemplates[i];
@@ -132,6 +144,9 @@ Object3D::~Object3D()
         delete neighboringTemplates[i];
     }
     neighboringTemplates.clear();
+    
+    // the mapped templates reference the file until here
+    delete templateDatabase;
 }
 
 
@@ -157,47 +172,55 @@ TCLCHistograms *Object3D::getTCLCHistograms()
 }
 
 
-void Object3D::generateTemplates()
+void Object3D::setTemplateFolder(const string &folder)
+{
+    templateFolder = folder;
+}
+
+
+void Object3D::generateTemplates(RenderingEngine *renderingEngine)
 {
     int numLevels = 4;
     
     int numBaseRotations = 4;
     
-    // create all base templates
-    for(int i = 0; i < baseIcosahedron.size(); i++)
+    int gamma2Precision = 30;
+    
+    int numBaseTemplates = (int)baseIcosahedron.size()*numBaseRotations*numDistances;
+    int numNeighboringTemplates = (int)subdivIcosahedron.size()*(360/gamma2Precision)*numDistances;
+    
+    string templateFile;
+    uint64_t key = 0;
+    if(!templateFolder.empty())
     {
-        Vec3f v = baseIcosahedron[i];
+        key = TemplateDatabase::computeKey(this, renderingEngine, numLevels, templateDistances);
         
-        float r = norm(v);
-        float alpha = acos(v[1]/r)*180.0f/float(CV_PI) - 90.0f;
-        float beta = atan2(v[0], v[2])*180.0f/float(CV_PI);
-        
-        for(int gamma = 0; gamma < 360; gamma += 90)
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.tpl", (unsigned long long)key);
+        templateFile = templateFolder + "/" + name;
+    }
+    
+    // map previously generated templates if available
+    if(!templateFile.empty() && templateDatabase->open(templateFile, key, numLevels)
+       && templateDatabase->getNumBaseTemplates() == numBaseTemplates
+       && templateDatabase->getNumNeighboringTemplates() == numNeighboringTemplates)
+    {
+        for(int i = 0; i < numBaseTemplates + numNeighboringTemplates; i++)
         {
-            for(int d = 0; d < numDistances; d++)
-            {
-                baseTemplates.push_back(new TemplateView(this, alpha, beta, gamma, templateDistances[d], numLevels, true));
-            }
+            TemplateView *kv = templateDatabase->createTemplateView(i);
+            if(i < numBaseTemplates)
+                baseTemplates.push_back(kv);
+            else
+                neighboringTemplates.push_back(kv);
         }
     }
-    
-    int gamma2Precision = 30;
-    
-    // create all neighboring templates
-    for(int i = 0; i < subdivIcosahedron.size(); i++)
+    else
     {
-        Vec3f v = subdivIcosahedron[i];
+        renderTemplates(renderingEngine, numLevels, gamma2Precision);
         
-        float r = norm(v);
-        float alpha = acos(v[1]/r)*180.0f/float(CV_PI) - 90.0f;
-        float beta = atan2(v[0], v[2])*180.0f/float(CV_PI);
-        
-        for(int gamma = 0; gamma < 360; gamma += gamma2Precision)
+        if(!templateFile.empty())
         {
-            for(int d = 0; d < numDistances; d++)
-            {
-                neighboringTemplates.push_back(new TemplateView(this, alpha, beta, gamma, templateDistances[d], numLevels, true));
-            }
+            TemplateDatabase::write(templateFile, key, numLevels, baseTemplates, neighboringTemplates);
         }
     }
     
@@ -243,17 +266,116 @@ void Object3D::generateTemplates()
         }
     }
     
+    // cluster the base templates at the coarsest level, where they are searched first
+    templateTree->build(baseTemplates, numLevels - 1, 4);
+    
     // reset the model to its prescribed initial pose
     Model::reset();
 }
 
 
-vector<TemplateView*> Object3D::getTemplateViews()
+void Object3D::renderTemplates(RenderingEngine *renderingEngine, int numLevels, int gamma2Precision)
+{
+    // the viewpoints (alpha, beta, gamma, distance) of all base templates followed by all neighboring templates
+    vector<Vec4f> viewpoints;
+    
+    for(int i = 0; i < baseIcosahedron.size(); i++)
+    {
+        Vec3f v = baseIcosahedron[i];
+        
+        float r = norm(v);
+        float alpha = acos(v[1]/r)*180.0f/float(CV_PI) - 90.0f;
+        float beta = atan2(v[0], v[2])*180.0f/float(CV_PI);
+        
+        for(int gamma = 0; gamma < 360; gamma += 90)
+        {
+            for(int d = 0; d < numDistances; d++)
+            {
+                viewpoints.push_back(Vec4f(alpha, beta, gamma, templateDistances[d]));
+            }
+        }
+    }
+    
+    int numBaseTemplates = (int)viewpoints.size();
+    
+    for(int i = 0; i < subdivIcosahedron.size(); i++)
+    {
+        Vec3f v = subdivIcosahedron[i];
+        
+        float r = norm(v);
+        float alpha = acos(v[1]/r)*180.0f/float(CV_PI) - 90.0f;
+        float beta = atan2(v[0], v[2])*180.0f/float(CV_PI);
+        
+        for(int gamma = 0; gamma < 360; gamma += gamma2Precision)
+        {
+            for(int d = 0; d < numDistances; d++)
+            {
+                viewpoints.push_back(Vec4f(alpha, beta, gamma, templateDistances[d]));
+            }
+        }
+    }
+    
+    vector<TemplateView*> templateViews(viewpoints.size(), NULL);
+    
+    // the templates are rendered at full resolution
+    renderingEngine->setLevel(0);
+    
+    Matx33f K = renderingEngine->getCalibrationMatrix().get_minor<3, 3>(0, 0);
+    
+    // render a batch of templates at once and process all of them in parallel, where the
+    // batch size bounds the memory of the full resolution renderings held at the same time
+    int batchSize = 64;
+    
+    for(int b = 0; b < viewpoints.size(); b += batchSize)
+    {
+        vector<Vec4f> batch(viewpoints.begin() + b, viewpoints.begin() + min(b + batchSize, (int)viewpoints.size()));
+        
+        vector<Matx44f> poses(batch.size());
+        for(int i = 0; i < batch.size(); i++)
+        {
+            poses[i] = TemplateView::computePose(batch[i][0], batch[i][1], batch[i][2], batch[i][3]);
+        }
+        
+        vector<Mat> masks, depths;
+        renderingEngine->renderSilhouetteBatch(this, poses, masks, depths);
+        
+        int threads = (int)batch.size();
+        
+        parallel_for_(cv::Range(0, threads), Parallel_For_createTemplateViews(this, batch, masks, depths, K, numLevels, &templateViews[b], threads));
+    }
+    
+    baseTemplates.assign(templateViews.begin(), templateViews.begin() + numBaseTemplates);
+    neighboringTemplates.assign(templateViews.begin() + numBaseTemplates, templateViews.end());
+}
+
+
+const vector<TemplateView*> &Object3D::getTemplateViews()
 {
     return baseTemplates;
 }
 
 
+size_t Object3D::getTemplateMemoryUsage()
+{
+    size_t size = 0;
+    for(int i = 0; i < baseTemplates.size(); i++)
+    {
+        size += baseTemplates[i]->getMemoryUsage();
+    }
+    for(int i = 0; i < neighboringTemplates.size(); i++)
+    {
+        size += neighboringTemplates[i]->getMemoryUsage();
+    }
+    return size;
+}
+
+
+TemplateTree *Object3D::getTemplateTree()
+{
+    return templateTree;
+}
+
+
 int Object3D::getNumDistances()
 {
     return numDistances;
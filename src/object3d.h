@@ -37,9 +37,12 @@
 #define OBJECT3D_H
 
 #include "model.h"
+#include "rendering_engine.h"
 
 class TCLCHistograms;
 class TemplateView;
+class TemplateDatabase;
+class TemplateTree;
 
 /**
  *  A representation of a 3D object that provides all nessecary information
@@ -55,7 +58,7 @@ public:
      *  scaling factor, a tracking quality threshhold and a set of distances to the
      *  camera for template generation used within pose detection. Here, also the set
      *  of n tclc-histograms is initialized, with n being the total number of 3D model
-     *  vertices.
+     *  surface sample points.
      *
      *  @param objFilename  The relative path to an OBJ/PLY file describing the model.
      *  @param tx  The models initial translation in X-direction relative to the camera.
@@ -67,8 +70,10 @@ public:
      *  @param scale  A scaling factor applied to the model in order change its size independent of the original data.
      *  @param qualityThreshold  The individual quality tracking quality threshold used to decide whether tracking and detection have been successful (should be within [0.5,0.6]).
      *  @param templateDistances  A vector of absolute Z-distance values to be used for template generation (typically 3 values: a close, an intermediate and a far distance)
+     *  @param numSamplePoints  The approximate number of surface sample points used as histogram centers (default = 5000).
+     *  @param maxSilhouetteTriangles  The maximum number of triangles for rendering silhouettes, above which the mesh is simplified (default = 50000).
      */
-    Object3D(const std::string objFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale, float qualityThreshold, std::vector<float> &templateDistances);
+    Object3D(const std::string objFilename, float tx, float ty, float tz, float alpha, float beta, float gamma, float scale, float qualityThreshold, std::vector<float> &templateDistances, int numSamplePoints = 5000, int maxSilhouetteTriangles = 50000);
     
     ~Object3D();
     
@@ -108,16 +113,47 @@ public:
      *  Must be called after the rendering buffers of the
      *  corresponding 3D model have been initialized and while
      *  the offscreen rendering OpenGL context is active.
+     *
+     *  @param  renderingEngine The rendering engine used to render the templates (default = the rendering engine singleton).
+     */
+    void generateTemplates(RenderingEngine *renderingEngine = RenderingEngine::Instance());
+    
+    /**
+     *  Sets the folder of the template files. If a file matching the model, the camera
+     *  and the template parameters exists in this folder, generateTemplates() maps the
+     *  templates from it instead of rendering them, otherwise the rendered templates
+     *  are written to a new file. This has to be called before generateTemplates(). An
+     *  empty folder disables the template files. The default folder is given by
+     *  TemplateDatabase::getDefaultFolder().
+     *
+     *  @param  folder The folder of the template files.
      */
-    void generateTemplates();
+    void setTemplateFolder(const std::string &folder);
     
     /**
      *  Returns the set of all pre-generated base and neighboring template views
-     *  of this object used during pose detection.
+     *  of this object used during pose detection. The returned reference stays
+     *  valid until the templates are generated again or the object is deleted.
      *
      *  @return  The set of all template views for this object.
      */
-    std::vector<TemplateView*> getTemplateViews();
+    const std::vector<TemplateView*> &getTemplateViews();
+    
+    /**
+     *  Returns the approximate amount of memory used by all base and neighboring
+     *  template views of this object.
+     *
+     *  @return  The memory used by the template views in bytes.
+     */
+    size_t getTemplateMemoryUsage();
+    
+    /**
+     *  Returns the hierarchical index of all base template views of this object
+     *  used to search them coarse-to-fine during pose detection.
+     *
+     *  @return  The template tree of the base template views.
+     */
+    TemplateTree *getTemplateTree();
     
     /**
      *  Returns the number of Z-distances used during template view generation
@@ -150,6 +186,13 @@ private:
     std::vector<TemplateView*> baseTemplates;
     std::vector<TemplateView*> neighboringTemplates;
     
+    std::string templateFolder;
+    
+    TemplateDatabase *templateDatabase;
+    
+    TemplateTree *templateTree;
+    
+    void renderTemplates(RenderingEngine *renderingEngine, int numLevels, int gamma2Precision);
 };
 
 
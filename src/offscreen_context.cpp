@@ -0,0 +1,215 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "offscreen_context.h"
+
+#include <iostream>
+#include <cstring>
+#include <mutex>
+
+using namespace std;
+
+
+#ifdef RBOT_WITH_QT
+
+OffscreenContext::OffscreenContext()
+{
+    surface = NULL;
+    glContext = NULL;
+}
+
+OffscreenContext::~OffscreenContext()
+{
+    delete glContext;
+    delete surface;
+}
+
+bool OffscreenContext::create()
+{
+    QSurfaceFormat glFormat;
+    glFormat.setVersion(3, 3);
+    glFormat.setProfile(QSurfaceFormat::CoreProfile);
+    glFormat.setRenderableType(QSurfaceFormat::OpenGL);
+    
+    surface = new QOffscreenSurface();
+    surface->setFormat(glFormat);
+    surface->create();
+    
+    glContext = new QOpenGLContext();
+    glContext->setFormat(surface->requestedFormat());
+    
+    if(!glContext->create())
+    {
+        cout << "error creating OpenGL context" << endl;
+        return false;
+    }
+    return true;
+}
+
+void OffscreenContext::makeCurrent()
+{
+    glContext->makeCurrent(surface);
+}
+
+void OffscreenContext::doneCurrent()
+{
+    glContext->doneCurrent();
+}
+
+QOpenGLContext* OffscreenContext::getQOpenGLContext()
+{
+    return glContext;
+}
+
+#else
+
+// the default display is shared by the contexts of all instances and only
+// terminated when the last of them has been destroyed
+static mutex displayMutex;
+static int displayReferences = 0;
+
+static bool initializeDisplay(EGLDisplay display)
+{
+    lock_guard<mutex> lock(displayMutex);
+    
+    EGLint major, minor;
+    if(!eglInitialize(display, &major, &minor))
+        return false;
+    
+    displayReferences++;
+    return true;
+}
+
+static void releaseDisplay(EGLDisplay display)
+{
+    lock_guard<mutex> lock(displayMutex);
+    
+    if(--displayReferences == 0)
+    {
+        eglTerminate(display);
+    }
+}
+
+OffscreenContext::OffscreenContext()
+{
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+}
+
+OffscreenContext::~OffscreenContext()
+{
+    if(context != EGL_NO_CONTEXT)
+    {
+        eglDestroyContext(display, context);
+    }
+    if(display != EGL_NO_DISPLAY)
+    {
+        releaseDisplay(display);
+    }
+}
+
+bool OffscreenContext::create()
+{
+    // prefer the surfaceless platform that does not require any window system
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay)
+    {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if(display == EGL_NO_DISPLAY)
+    {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    
+    if(display == EGL_NO_DISPLAY || !initializeDisplay(display))
+    {
+        cout << "error initializing EGL display" << endl;
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+    
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if(!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        cout << "error EGL display does not support surfaceless contexts" << endl;
+        return false;
+    }
+    
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        cout << "error binding OpenGL API" << endl;
+        return false;
+    }
+    
+    EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if(!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+    {
+        cout << "error choosing EGL config" << endl;
+        return false;
+    }
+    
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if(context == EGL_NO_CONTEXT)
+    {
+        cout << "error creating OpenGL context" << endl;
+        return false;
+    }
+    return true;
+}
+
+void OffscreenContext::makeCurrent()
+{
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+void OffscreenContext::doneCurrent()
+{
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+#endif
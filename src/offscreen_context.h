@@ -0,0 +1,99 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OFFSCREEN_CONTEXT_H
+#define OFFSCREEN_CONTEXT_H
+
+#ifdef RBOT_WITH_QT
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+/**
+ *  This class manages an OpenGL 3.3 core profile context for offscreen rendering
+ *  without any window. With Qt it is based on a QOffscreenSurface and a QOpenGLContext,
+ *  which require a QApplication. Otherwise a surfaceless EGL context is used, that
+ *  neither requires Qt nor a running window system (e.g. on headless machines).
+ *  Since all renderings are performed into frame buffer objects, no default
+ *  frame buffer is needed in either case.
+ */
+class OffscreenContext
+{
+public:
+    OffscreenContext();
+    
+    ~OffscreenContext();
+    
+    /**
+     *  Creates the OpenGL context.
+     *
+     *  @return  True if the context has been created successfully and false otherwise.
+     */
+    bool create();
+    
+    /**
+     *  Activates the OpenGL context in the calling thread.
+     */
+    void makeCurrent();
+    
+    /**
+     *  Deactivates the OpenGL context in the calling thread.
+     */
+    void doneCurrent();
+    
+#ifdef RBOT_WITH_QT
+    /**
+     *  Returns the underlying Qt OpenGL context, e.g. in order to move it
+     *  to a different QThread.
+     *
+     *  @return  The underlying Qt OpenGL context.
+     */
+    QOpenGLContext *getQOpenGLContext();
+#endif
+    
+private:
+#ifdef RBOT_WITH_QT
+    QOffscreenSurface *surface;
+    QOpenGLContext *glContext;
+#else
+    EGLDisplay display;
+    EGLContext context;
+#endif
+};
+
+#endif /* OFFSCREEN_CONTEXT_H */
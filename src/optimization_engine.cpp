@@ -39,11 +39,11 @@ using namespace std;
 using namespace cv;
 
 
-OptimizationEngine::OptimizationEngine(int width, int height)
+OptimizationEngine::OptimizationEngine(int width, int height, RenderingEngine *renderingEngine)
 {
-    renderingEngine = RenderingEngine::Instance();
+    this->renderingEngine = renderingEngine;
     
-    SDT2D = new SignedDistanceTransform2D(8.0f);
+    SDT2D = new SignedDistanceTransform2D();
     
     this->width = width;
     this->height = height;
@@ -83,7 +83,9 @@ void OptimizationEngine::minimize(vector<Mat>& imagePyramid, vector<Object3D*>&
 void OptimizationEngine::runIteration(vector<Object3D*>& objects, const vector<Mat>& imagePyramid, int level)
 {
     Rect roi;
-    Mat mask, depth, depthInv, sdt, xyPos;
+    Mat mask, depth;
+    vector<Mat> depthInvs;
+    SignedDistanceBand band;
     Mat croppedMask, croppedDepth, croppedDepthInv;
     
     renderingEngine->setLevel(level);
@@ -111,49 +113,101 @@ void OptimizationEngine::runIteration(vector<Object3D*>& objects, const vector<M
         }
     }
     
-    // render the common silhouette mask
     renderingEngine->setLevel(level);
-    renderingEngine->renderSilhouette(vector<Model*>(objects.begin(), objects.end()), GL_FILL);
     
-    // download the depth buffer
-    depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
+    // compute the 2D regions of interest containing the silhouettes of all objects
+    // and the region enclosing all of them that is to be rendered
+    vector<Rect> rois(objects.size());
+    vector<SignedDistanceBand> bands(objects.size());
     
-    // if more than one object is initialized, download the common silhouette
-    // mask required for occlusion detection
-    if(numInitialized > 1)
+    Rect renderROI;
+    
+    for(int o = 0; o < objects.size(); o++)
+    {
+        if(objects[o]->isInitialized())
+        {
+            rois[o] = compute2DROI(objects[o], Size(width/pow(2, level), height/pow(2, level)), 8);
+            
+            renderROI |= rois[o];
+        }
+    }
+    
+    if(renderROI.area() == 0)
     {
-        mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
+        return;
     }
-    else // otherwise for a single object the mask is equal to the depth buffer
+    
+    // render the common silhouette mask and depth buffer together with the
+    // individual inverse depth buffers of all objects at once, only within
+    // the region of interest (i.e. all buffers are of the size of renderROI)
+    renderingEngine->setROI(renderROI);
+    renderingEngine->renderSilhouettes(vector<Model*>(objects.begin(), objects.end()), GL_FILL, mask, depth, depthInvs);
+    renderingEngine->setROI(Rect());
+    
+    // the common silhouette mask is only required for occlusion detection in case
+    // of multiple objects, otherwise for a single object the mask is equal to the depth buffer
+    if(numInitialized <= 1)
     {
         mask = depth;
     }
     
+    vector<int> labelObjects;
+    vector<uchar> labelKeys;
+    vector<Rect> labelROIs;
+    
+    for(int o = 0; o < objects.size(); o++)
+    {
+        if(objects[o]->isInitialized() && rois[o].area() != 0)
+        {
+            labelObjects.push_back(o);
+            labelKeys.push_back(objects[o]->getModelID());
+            labelROIs.push_back(rois[o] - renderROI.tl());
+        }
+    }
+    
+    // for multiple objects compute the 2D signed distance transforms of all
+    // silhouettes within the common mask at once
+    if(numInitialized > 1 && !labelObjects.empty())
+    {
+        vector<SignedDistanceBand> labelBands;
+        SDT2D->computeTransforms(mask, labelKeys, labelROIs, labelBands, 8);
+        
+        for(int l = 0; l < labelObjects.size(); l++)
+        {
+            bands[labelObjects[l]] = labelBands[l];
+        }
+    }
+    
     for(int o = 0; o < objects.size(); o++)
     {
         if(objects[o]->isInitialized())
         {
-            // compute the 2D region of interest containing the silhouette of the current object
-            roi = compute2DROI(objects[o], Size(width/pow(2, level), height/pow(2, level)), 8);
+            roi = rois[o];
             
             if(roi.area() == 0)
             {
                 continue;
             }
             
-            // render the individual inverse depth buffer per object
-            renderingEngine->renderSilhouette(objects[o], GL_FILL, true);
-            depthInv = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
+            // crop the rendered images wrt to the 2D roi
+            Rect renderedROI = roi - renderROI.tl();
             
-            // crop the images wrt to the 2D roi
-            croppedMask = mask(roi).clone();
-            croppedDepth = depth(roi).clone();
-            croppedDepthInv = depthInv(roi).clone();
+            croppedMask = mask(renderedROI).clone();
+            croppedDepth = depth(renderedROI).clone();
+            croppedDepthInv = depthInvs[o](renderedROI).clone();
             
             int m_id = (numInitialized <= 1) ? -1 : objects[o]->getModelID();
             
-            // compute the 2D signed distance transform of the silhouette
-            SDT2D->computeTransform(croppedMask, sdt, xyPos, 8, m_id);
+            if(numInitialized > 1)
+            {
+                band = bands[o];
+            }
+            else
+            {
+                // compute the 2D signed distance transform of the silhouette
+                // together with its heaviside, dirac and derivative planes
+                SDT2D->computeTransform(croppedMask, band, 8, m_id);
+            }
             
             // the hessian approximation
             Matx66f wJTJ;
@@ -161,7 +215,7 @@ void OptimizationEngine::runIteration(vector<Object3D*>& objects, const vector<M
             Matx61f JT;
             
             // compute the Jacobian terms (i.e. the gradient and the hessian approx.) needed for the Gauss-Newton step
-            parallel_computeJacobians(objects[o], imagePyramid[level], croppedDepth, croppedDepthInv, sdt, xyPos, roi, croppedMask, m_id, level, wJTJ, JT, roi.height);
+            parallel_computeJacobians(objects[o], imagePyramid[level], croppedDepth, croppedDepthInv, band, roi, croppedMask, m_id, level, wJTJ, JT, roi.height);
             
             // update the pose by computing the Gauss-Newton step
             applyStepGaussNewton(objects[o], wJTJ, JT);
@@ -170,10 +224,8 @@ void OptimizationEngine::runIteration(vector<Object3D*>& objects, const vector<M
 }
 
 
-void OptimizationEngine::parallel_computeJacobians(Object3D* object, const Mat& frame, const Mat& depth, const Mat& depthInv, const Mat& sdt, const Mat& xyPos, const Rect& roi, const cv::Mat& mask, int m_id, int level, Matx66f& wJTJ, Matx61f &JT, int threads)
+void OptimizationEngine::parallel_computeJacobians(Object3D* object, const Mat& frame, const Mat& depth, const Mat& depthInv, const SignedDistanceBand& band, const Rect& roi, const cv::Mat& mask, int m_id, int level, Matx66f& wJTJ, Matx61f &JT, int threads)
 {
-    float zNear = renderingEngine->getZNear();
-    float zFar = renderingEngine->getZFar();
     Matx33f K = renderingEngine->getCalibrationMatrix().get_minor<3, 3>(0, 0);
     
     JT = Matx61f::zeros();
@@ -182,7 +234,7 @@ void OptimizationEngine::parallel_computeJacobians(Object3D* object, const Mat&
     vector<Matx61f> JTCollection(threads);
     vector<Matx66f> wJTJCollection(threads);
     
-    parallel_for_(cv::Range(0, threads), Parallel_For_computeJacobiansGN(object->getTCLCHistograms(), frame, sdt, xyPos, depth, depthInv, K, zNear, zFar, roi, mask, m_id, level, wJTJCollection, JTCollection, threads));
+    parallel_for_(cv::Range(0, threads), Parallel_For_computeJacobiansGN(object->getTCLCHistograms(), frame, band, SDT2D->getMaxDist(), depth, depthInv, K, roi, mask, m_id, level, wJTJCollection, JTCollection, threads));
     
     for(int i = 0; i < threads; i++)
     {
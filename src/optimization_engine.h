@@ -60,8 +60,9 @@ public:
      *
      *  @param width  The width in pixels of the camera frame at full resolution.
      *  @param height  The height in pixels of the camera frame at full resolution.
+     *  @param renderingEngine  The rendering engine to be used (default = the rendering engine singleton).
      */
-    OptimizationEngine(int width, int height);
+    OptimizationEngine(int width, int height, RenderingEngine *renderingEngine = RenderingEngine::Instance());
     
     ~OptimizationEngine();
     
@@ -92,7 +93,7 @@ private:
     
     void runIteration(std::vector<Object3D*> &objects, const std::vector<cv::Mat> &imagePyramid, int level);
     
-    void parallel_computeJacobians(Object3D *object, const cv::Mat &frame, const cv::Mat &depth, const cv::Mat &depthInv, const cv::Mat &sdt, const cv::Mat &xyPos, const cv::Rect &roi, const cv::Mat &mask, int m_id, int level, cv::Matx66f &wJTJ, cv::Matx61f &JT, int threads);
+    void parallel_computeJacobians(Object3D *object, const cv::Mat &frame, const cv::Mat &depth, const cv::Mat &depthInv, const SignedDistanceBand &band, const cv::Rect &roi, const cv::Mat &mask, int m_id, int level, cv::Matx66f &wJTJ, cv::Matx61f &JT, int threads);
     
     cv::Rect compute2DROI(Object3D *object, const cv::Size &maxSize, int offset);
     
@@ -110,17 +111,17 @@ class Parallel_For_computeJacobiansGN: public cv::ParallelLoopBody
 private:
     uchar *frameData, *maskData, *initializedData;
     
-    float *histogramsFGData, *histogramsBGData, *sdtData, *depthData, *depthInvData, *K_invData;
+    float *histogramsFGData, *histogramsBGData, *sdtData, *hsData, *diracData, *dXData, *dYData, *depthData, *depthInvData, *K_invData;
     
     int *xyPosData;
     
     cv::Mat localFG, localBG;
     
-    std::vector<cv::Point3i> centersIDs;
+    const std::vector<cv::Point3i> &centersIDs;
     
     int numHistograms, radius2, upscale, numBins, binShift, fullWidth, fullHeight, _m_id;
     
-    float _fx, _fy, _zNear, _zFar;
+    float _fx, _fy, _maxDist;
     
     bool maskAvailable;
     
@@ -134,7 +135,7 @@ private:
     int _threads;
     
 public:
-    Parallel_For_computeJacobiansGN(TCLCHistograms *tclcHistograms, const cv::Mat &frame, const cv::Mat &sdt, const cv::Mat &xyPos, const cv::Mat &depth, const cv::Mat &depthInv, const cv::Matx33f &K, float zNear, float zFar, const cv::Rect &roi, const cv::Mat &mask, int m_id, int level, std::vector<cv::Matx66f> &wJTJCollection, std::vector<cv::Matx61f> &JTCollection, int threads)
+    Parallel_For_computeJacobiansGN(TCLCHistograms *tclcHistograms, const cv::Mat &frame, const SignedDistanceBand &band, float maxDist, const cv::Mat &depth, const cv::Mat &depthInv, const cv::Matx33f &K, const cv::Rect &roi, const cv::Mat &mask, int m_id, int level, std::vector<cv::Matx66f> &wJTJCollection, std::vector<cv::Matx61f> &JTCollection, int threads): centersIDs(tclcHistograms->getCentersAndIDs())
     {
         frameData = frame.data;
         
@@ -144,8 +145,6 @@ public:
         histogramsFGData = (float*)localFG.ptr<float>();
         histogramsBGData = (float*)localBG.ptr<float>();
         
-        centersIDs = tclcHistograms->getCentersAndIDs();
-        
         initializedData = tclcHistograms->getInitialized().data;
         
         numHistograms = (int)centersIDs.size();
@@ -163,8 +162,15 @@ public:
         fullWidth = frame.cols;
         fullHeight = frame.rows;
         
-        sdtData = (float*)sdt.ptr<float>();
-        xyPosData = (int*)xyPos.ptr<int>();
+        sdtData = (float*)band.sdt.ptr<float>();
+        hsData = (float*)band.heaviside.ptr<float>();
+        diracData = (float*)band.dirac.ptr<float>();
+        dXData = (float*)band.dX.ptr<float>();
+        dYData = (float*)band.dY.ptr<float>();
+        xyPosData = (int*)band.xyPos.ptr<int>();
+        
+        // the Heaviside and Dirac delta values are only valid within the band
+        _maxDist = maxDist;
         
         depthData = (float*)depth.ptr<float>();
         depthInvData = (float*)depthInv.ptr<float>();
@@ -183,9 +189,6 @@ public:
         _fx = K(0, 0);
         _fy = K(1, 1);
         
-        _zNear = zNear;
-        _zFar = zFar;
-        
         _roi = roi;
         
         _wJTJCollection = wJTJCollection.data();
@@ -194,15 +197,15 @@ public:
         _threads = threads;
     }
     
-    bool isOccluded (int idx, float dist, float d) const
+    bool isOccluded (int idx, float dist, float Z) const
     {
         if(dist > 0)
         {
             uchar mVal = maskData[idx];
             if(mVal != 0 && mVal != _m_id)
             {
-                float d2 = 1.0f - depthData[idx];
-                if(d2 < d)
+                float Z2 = depthData[idx];
+                if(Z2 < Z)
                 {
                     return true;
                 }
@@ -218,8 +221,8 @@ public:
             
             int idx2 = yPos*_roi.width + xPos;
             
-            float DsdtDx2 = (sdtData[idx2 + 1] - sdtData[idx2 - 1])/2.0f;
-            float DsdtDy2 = (sdtData[idx2 + _roi.width] - sdtData[idx2 - _roi.width])/2.0f;
+            float DsdtDx2 = dXData[idx2];
+            float DsdtDy2 = dYData[idx2];
             
             int xoffset = DsdtDx2 >= 0 ? 1 : -1;
             int yoffset = DsdtDy2 >= 0 ? 1*_roi.width : -1*_roi.width;
@@ -230,8 +233,8 @@ public:
                 uchar mVal = maskData[idx2 + xoffset];
                 if(mVal != 0 && mVal != _m_id)
                 {
-                    float d2 = 1.0f - depthData[idx2 + xoffset];
-                    if(d2 < d)
+                    float Z2 = depthData[idx2 + xoffset];
+                    if(Z2 < Z)
                     {
                         return true;
                     }
@@ -240,8 +243,8 @@ public:
                 mVal = maskData[idx2 + yoffset];
                 if(mVal != 0 && mVal != _m_id)
                 {
-                    float d2 = 1.0f - depthData[idx2 + yoffset];
-                    if(d2 < d)
+                    float Z2 = depthData[idx2 + yoffset];
+                    if(Z2 < Z)
                     {
                         return true;
                     }
@@ -250,8 +253,8 @@ public:
                 mVal = maskData[idx2 + yoffset + xoffset];
                 if(mVal != 0 && mVal != _m_id)
                 {
-                    float d2 = 1.0f - depthData[idx2 + yoffset + xoffset];
-                    if(d2 < d)
+                    float Z2 = depthData[idx2 + yoffset + xoffset];
+                    if(Z2 < Z)
                     {
                         return true;
                     }
@@ -279,9 +282,6 @@ public:
         float* wJTJ = (float*)_wJTJCollection[r.start].val;
         float* JT = (float*)_JTCollection[r.start].val;
         
-        float s = 1.2f;
-        float s2 = s*s;
-        
         for(int j = jStart; j < jEnd; j++)
         {
             float J[6];
@@ -292,13 +292,13 @@ public:
             {
                 float dist = sdtData[idx];
                 
-                if(fabs(dist) <= 8.0f)
+                if(fabs(dist) <= _maxDist)
                 {
                     // the smoothed Heaviside value for this signed distance
-                    float heaviside = 1.0f/float(CV_PI)*(-atan(dist*s)) + 0.5f;
+                    float heaviside = hsData[idx];
                     
                     // the corresponding smoothed dirac delta value
-                    float dirac = (1.0f / float(CV_PI)) * (s/(dist*s2*dist + 1.0f));
+                    float dirac = diracData[idx];
                     
                     // compute the average foreground and background posterior
                     // probablities from the given set of tclc-histograms
@@ -385,16 +385,13 @@ public:
                         zIdx = idx;
                     }
                     
-                    // get the depth buffer value for this pixel
-                    float depth = 1.0f - depthData[zIdx];
+                    // get the Z-distance to the camera for this pixel from the linear depth buffer
+                    D = depthData[zIdx];
                     
                     // check for occlusions in case of multiple objects
-                    if(maskAvailable && isOccluded(idx, dist, depth))
+                    if(maskAvailable && isOccluded(idx, dist, D))
                         continue;
                     
-                    // compute the Z-distance to the camera from the depth buffer value
-                    D = 2.0f * _zNear * _zFar / (_zFar + _zNear - (2.0f*depth - 1.0) * (_zFar - _zNear));
-                    
                     // back-project to camera coordinates
                     float X_c = D*(K_invData[0]*x+K_invData[2]);
                     float Y_c = D*(K_invData[4]*y+K_invData[5]);
@@ -403,8 +400,8 @@ public:
                     float Z_c2 = Z_c*Z_c;
                     
                     // the image gradient of the signed distance transform
-                    float DsdtDx = (sdtData[idx + 1] - sdtData[idx - 1])/2.0f;
-                    float DsdtDy = (sdtData[idx + _roi.width] - sdtData[idx - _roi.width])/2.0f;
+                    float DsdtDx = dXData[idx];
+                    float DsdtDy = dYData[idx];
 
                     // compute the Jacobian of the signed distance transform with respect to
                     // the twist coordinates for this pixel
@@ -436,9 +433,7 @@ public:
                     }
                     
                     // do the same for the inverse depth buffer
-                    depth = 1.0f - depthInvData[zIdx];
-                    
-                    D = 2.0f * _zNear * _zFar / (_zFar + _zNear - (2.0f*depth - 1.0) * (_zFar - _zNear));
+                    D = depthInvData[zIdx];
                     
                     X_c = D*(K_invData[0]*x+K_invData[2]);
                     Y_c = D*(K_invData[4]*y+K_invData[5]);
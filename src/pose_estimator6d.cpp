@@ -38,18 +38,25 @@
 using namespace std;
 using namespace cv;
 
-bool sortTemplateView(std::pair<float, TemplateView*> a, std::pair<float, TemplateView*> b)
+bool sortTemplateMatch(const TemplateMatch &a, const TemplateMatch &b)
 {
-    return a.first < b.first;
+    return a.offset.z < b.offset.z;
 }
 
 
-PoseEstimator6D::PoseEstimator6D(int width, int height, float zNear, float zFar, const cv::Matx33f &K, const cv::Matx14f &distCoeffs, vector<Object3D*> &objects)
+TemplateMatch::TemplateMatch(const TemplateView *templateView, const Point3f &offset)
 {
-    renderingEngine = RenderingEngine::Instance();
-    optimizationEngine = new OptimizationEngine(width, height);
+    this->templateView = templateView;
+    this->offset = offset;
+}
+
+
+PoseEstimator6D::PoseEstimator6D(int width, int height, float zNear, float zFar, const cv::Matx33f &K, const cv::Matx14f &distCoeffs, vector<Object3D*> &objects, RenderingEngine *renderingEngine)
+{
+    this->renderingEngine = renderingEngine;
+    optimizationEngine = new OptimizationEngine(width, height, renderingEngine);
     
-    SDT2D = new SignedDistanceTransform2D(8.0f);
+    SDT2D = new SignedDistanceTransform2D();
     
     this->width = width;
     this->height = height;
@@ -61,8 +68,14 @@ PoseEstimator6D::PoseEstimator6D(int width, int height, float zNear, float zFar,
     
     initialized = false;
     
+    tmp = 0;
+    
+    relocalizationBudget = 0.0f;
+    
     //start initialization
-    renderingEngine->init(K, width, height, zNear, zFar, 4);
+    valid = renderingEngine->init(K, width, height, zNear, zFar, 4);
+    if(!valid)
+        return;
     
     renderingEngine->makeCurrent();
     
@@ -70,14 +83,17 @@ PoseEstimator6D::PoseEstimator6D(int width, int height, float zNear, float zFar,
     {
         objects[i]->setModelID(i+1);
         this->objects.push_back(objects[i]);
-        this->objects[i]->initBuffers();
-        this->objects[i]->generateTemplates();
+        if(renderingEngine->getBackend() == RenderingEngine::OPENGL)
+        {
+            this->objects[i]->initBuffers();
+        }
+        this->objects[i]->generateTemplates(renderingEngine);
         this->objects[i]->reset();
     }
     
     renderingEngine->doneCurrent();
     
-    tmp = 0;
+    relocalizations.resize(this->objects.size());
 }
 
 
@@ -91,6 +107,12 @@ PoseEstimator6D::~PoseEstimator6D()
 }
 
 
+bool PoseEstimator6D::isValid()
+{
+    return valid;
+}
+
+
 void PoseEstimator6D::toggleTracking(cv::Mat &frame, int objectIndex, bool undistortFrame)
 {
     if(objectIndex >= objects.size())
@@ -99,6 +121,9 @@ void PoseEstimator6D::toggleTracking(cv::Mat &frame, int objectIndex, bool undis
     if(undistortFrame)
         remap(frame, frame, map1, map2, INTER_LINEAR);
     
+    // a pending relocalization of the object is discarded in both cases
+    relocalizations[objectIndex] = Relocalization();
+    
     if(!objects[objectIndex]->isInitialized())
     {
         objects[objectIndex]->initialize();
@@ -107,13 +132,10 @@ void PoseEstimator6D::toggleTracking(cv::Mat &frame, int objectIndex, bool undis
         
         renderingEngine->renderSilhouette(vector<Model*>(objects.begin(), objects.end()), GL_FILL);
         
-        Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-        Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
-        
-        float zNear = renderingEngine->getZNear();
-        float zFar = renderingEngine->getZFar();
+        Mat mask, depth;
+        renderingEngine->downloadMaskAndLinearDepth(mask, depth);
         
-        objects[objectIndex]->getTCLCHistograms()->update(frame, mask, depth, K, zNear, zFar);
+        objects[objectIndex]->getTCLCHistograms()->update(frame, mask, depth, K);
         
         initialized = true;
     }
@@ -154,15 +176,17 @@ void PoseEstimator6D::estimatePoses(cv::Mat &frame, bool undistortFrame, bool ch
         
         renderingEngine->renderSilhouette(vector<Model*>(objects.begin(), objects.end()), GL_FILL);
         
-        Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-        Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
-        
-        float zNear = renderingEngine->getZNear();
-        float zFar = renderingEngine->getZFar();
+        Mat mask, depth;
+        renderingEngine->downloadMaskAndLinearDepth(mask, depth);
         
         Mat binned;
         parallel_for_(cv::Range(0, 8), Parallel_For_convertToBins(frame, binned, objects[0]->getTCLCHistograms()->getNumBins(), 8));
         
+        // the time until which lost objects may be relocalized in this frame (0 = unlimited)
+        int64 deadline = 0;
+        if(relocalizationBudget > 0.0f)
+            deadline = getTickCount() + int64(relocalizationBudget*getTickFrequency()/1000.0);
+        
         for(int i = 0; i < objects.size(); i++)
         {
             if(objects[i]->isInitialized())
@@ -178,107 +202,256 @@ void PoseEstimator6D::estimatePoses(cv::Mat &frame, bool undistortFrame, bool ch
                     }
                     else
                     {
-                        objects[i]->getTCLCHistograms()->update(frame, mask, depth, K, zNear, zFar);
+                        objects[i]->getTCLCHistograms()->update(frame, mask, depth, K);
                     }
                 }
                 else
                 {
-                    relocalize(objects[i], imagePyramid);
+                    relocalize(i, imagePyramid, deadline);
                 }
             }
         }
     }
 }
 
-void PoseEstimator6D::relocalize(Object3D *object, vector<Mat> &imagePyramid)
+PoseEstimator6D::Relocalization::Relocalization()
 {
-    vector<TemplateView*> templateViews = object->getTemplateViews();
+    stage = INACTIVE;
     
-    int numDistances = object->getNumDistances();
+    next = 0;
     
-    int level = 3;
+    minE = FLT_MAX;
+    found = false;
+}
+
+
+void PoseEstimator6D::relocalize(int objectIndex, const vector<Mat> &imagePyramid, int64 deadline)
+{
+    Object3D *object = objects[objectIndex];
+    Relocalization &relocalization = relocalizations[objectIndex];
+    
+    if(relocalization.stage == Relocalization::INACTIVE)
+    {
+        startRelocalization(object, relocalization, imagePyramid);
+    }
+    
+    // perform at least one step per frame and continue until the time budget is used up
+    do
+    {
+        if(continueRelocalization(object, relocalization))
+        {
+            relocalization = Relocalization();
+            break;
+        }
+    }
+    while(deadline == 0 || getTickCount() < deadline);
+}
+
+
+void PoseEstimator6D::startRelocalization(Object3D *object, Relocalization &relocalization, const vector<Mat> &imagePyramid)
+{
+    relocalization = Relocalization();
+    
+    relocalization.imagePyramid = imagePyramid;
+    
+    // the templates are searched at the pyramid level their tree has been built for
+    int level = object->getTemplateTree()->getLevel();
     
     // PREPARE FRAME FOR LOWEST LEVEL
-    Mat binned;
-    parallel_for_(cv::Range(0, 8), Parallel_For_convertToBins(imagePyramid[level], binned, object->getTCLCHistograms()->getNumBins(), 8));
+    parallel_for_(cv::Range(0, 8), Parallel_For_convertToBins(imagePyramid[level], relocalization.binned, object->getTCLCHistograms()->getNumBins(), 8));
     
     Mat prMap;
-    parallel_for_(cv::Range(0, 8), Parallel_For_createPosteriorResponseMap(object->getTCLCHistograms(), binned, prMap, 8));
+    parallel_for_(cv::Range(0, 8), Parallel_For_createPosteriorResponseMap(object->getTCLCHistograms(), relocalization.binned, prMap, 8));
     
-    parallel_for_(cv::Range(0, (int)templateViews.size()), Parallel_For_exhaustiveSearch(object, templateViews, binned, prMap, level, 4, -1));
+    relocalization.prMask = BitMask(prMap);
     
-    parallel_for_(cv::Range(0, (int)templateViews.size()), Parallel_For_exhaustiveSearch(object, templateViews, binned, prMap, level, 1, 2));
+    integral(prMap/255, relocalization.prIntegral, CV_32S);
     
+    // the template tree is searched from its root and templates which are never reached do not match
+    const TemplateTree *templateTree = object->getTemplateTree();
+    if(templateTree->getRoot() >= 0)
+        relocalization.frontier.push_back(templateTree->getRoot());
     
-    // KEEP ONLY THE BEST MATCHING DISTANCE PER TEMPLATE
-    vector<pair<float, TemplateView*> > errorKVMap0;
+    int numTemplates = (int)object->getTemplateViews().size();
+    relocalization.searched.assign(numTemplates, 0);
+    relocalization.templateOffsets.assign(numTemplates, Point3f(0, 0, FLT_MAX));
     
-    for(int i = 0; i < templateViews.size(); i+=numDistances)
+    relocalization.stage = Relocalization::SEARCH_TEMPLATES;
+}
+
+
+bool PoseEstimator6D::continueRelocalization(Object3D *object, Relocalization &relocalization)
+{
+    vector<Mat> &imagePyramid = relocalization.imagePyramid;
+    
+    if(relocalization.stage == Relocalization::SEARCH_TEMPLATES)
     {
-        float minE = FLT_MAX;
-        int minIdx = -1;
-        for(int j = 0; j < numDistances; j++)
+        const vector<TemplateView*> &templateViews = object->getTemplateViews();
+        const TemplateTree *templateTree = object->getTemplateTree();
+        
+        int numDistances = object->getNumDistances();
+        
+        int level = templateTree->getLevel();
+        
+        // the number of nodes per tree level whose children are searched next
+        int beamWidth = 4;
+        
+        vector<Point3f> &offsets = relocalization.templateOffsets;
+        vector<int> &frontier = relocalization.frontier;
+        
+        if(!frontier.empty())
         {
-            TemplateView *templateView = templateViews[i+j];
-            Point3f offset = templateView->getCurrentOffset(level);
+            // skip all subtrees in which no template can overlap the posterior response map sufficiently
+            vector<uchar> feasible(frontier.size());
+            parallel_for_(cv::Range(0, (int)frontier.size()), Parallel_For_boundTemplateNodes(templateTree, templateViews, relocalization.prMask, relocalization.prIntegral, level, frontier, feasible));
+            
+            vector<int> nodes;
+            vector<int> representativeIndices;
+            vector<TemplateView*> representatives;
+            for(int n = 0; n < frontier.size(); n++)
+            {
+                if(!feasible[n])
+                    continue;
+                
+                nodes.push_back(frontier[n]);
+                
+                int t = templateTree->getNode(frontier[n]).templateIndex;
+                if(!relocalization.searched[t])
+                {
+                    representativeIndices.push_back(t);
+                    representatives.push_back(templateViews[t]);
+                    relocalization.searched[t] = 1;
+                }
+            }
+            
+            // search the representatives not searched at a higher tree level, first coarsely and then around the best offsets
+            vector<Point3f> representativeOffsets(representatives.size());
+            
+            parallel_for_(cv::Range(0, (int)representatives.size()), Parallel_For_exhaustiveSearch(object, representatives, relocalization.binned, relocalization.prMask, relocalization.prIntegral, level, 4, -1, representativeOffsets));
             
-            if(offset.z < minE)
+            parallel_for_(cv::Range(0, (int)representatives.size()), Parallel_For_exhaustiveSearch(object, representatives, relocalization.binned, relocalization.prMask, relocalization.prIntegral, level, 1, 2, representativeOffsets));
+            
+            for(int i = 0; i < representatives.size(); i++)
             {
-                minE = offset.z;
-                minIdx = j;
+                offsets[representativeIndices[i]] = representativeOffsets[i];
             }
+            
+            // continue with the children of the nodes whose representatives matched best
+            vector<pair<float, int> > ranking;
+            for(int n = 0; n < nodes.size(); n++)
+            {
+                const TemplateTree::Node &node = templateTree->getNode(nodes[n]);
+                if(!node.children.empty())
+                    ranking.push_back(pair<float, int>(offsets[node.templateIndex].z, nodes[n]));
+            }
+            
+            sort(ranking.begin(), ranking.end());
+            
+            frontier.clear();
+            for(int n = 0; n < min(beamWidth, (int)ranking.size()); n++)
+            {
+                const vector<int> &children = templateTree->getNode(ranking[n].second).children;
+                frontier.insert(frontier.end(), children.begin(), children.end());
+            }
+            
+            if(!frontier.empty())
+                return false;
         }
-        if(minE > 0.0f && minIdx >= 0)
+        
+        // KEEP ONLY THE BEST MATCHING DISTANCE PER TEMPLATE
+        vector<TemplateMatch> &errorKVMap0 = relocalization.baseCandidates;
+        
+        for(int i = 0; i < templateViews.size(); i+=numDistances)
         {
-            errorKVMap0.push_back(pair<float, TemplateView*>(minE, templateViews[i + minIdx]));
+            float minE = FLT_MAX;
+            int minIdx = -1;
+            for(int j = 0; j < numDistances; j++)
+            {
+                Point3f offset = offsets[i+j];
+                
+                if(offset.z < minE)
+                {
+                    minE = offset.z;
+                    minIdx = j;
+                }
+            }
+            if(minE > 0.0f && minIdx >= 0)
+            {
+                errorKVMap0.push_back(TemplateMatch(templateViews[i + minIdx], offsets[i + minIdx]));
+            }
         }
+        
+        sort(errorKVMap0.begin(), errorKVMap0.end(), sortTemplateMatch);
+        
+        level = 2;
+        
+        // PREPARE FRAME FOR 2ND LOWEST LEVEL
+        parallel_for_(cv::Range(0, 8), Parallel_For_convertToBins(imagePyramid[level], relocalization.binned, object->getTCLCHistograms()->getNumBins(), 8));
+        
+        relocalization.next = 0;
+        relocalization.stage = Relocalization::SEARCH_NEIGHBORS;
+        
+        return false;
     }
     
-    sort(errorKVMap0.begin(), errorKVMap0.end(), sortTemplateView);
-    
-    level = 2;
-    
-    // PREPARE FRAME FOR 2ND LOWEST LEVEL
-    parallel_for_(cv::Range(0, 8), Parallel_For_convertToBins(imagePyramid[level], binned, object->getTCLCHistograms()->getNumBins(), 8));
-    
-    vector<pair<float, TemplateView*> > errorKVMap;
-    
-    for(int i = 0; i < errorKVMap0.size()/2; i++)
+    if(relocalization.stage == Relocalization::SEARCH_NEIGHBORS)
     {
-        float kve = errorKVMap0[i].first;
-        TemplateView *templateView = errorKVMap0[i].second;
+        const vector<TemplateMatch> &errorKVMap0 = relocalization.baseCandidates;
+        vector<TemplateMatch> &errorKVMap = relocalization.candidates;
         
-        if(kve > 0.0f && kve < 1.0f)
+        int level = 2;
+        
+        // search the neighbors of the next base template
+        if(relocalization.next < errorKVMap0.size()/2)
         {
-            parallel_for_(cv::Range(0, (int)templateView->getNeighborTemplates().size()), Parallel_For_neighborSearch(object, templateView, binned, level, 1));
+            const TemplateMatch &baseMatch = errorKVMap0[relocalization.next];
+            const TemplateView *templateView = baseMatch.templateView;
+            
+            float kve = baseMatch.offset.z;
             
-            for(int n = 0; n < templateView->getNeighborTemplates().size(); n++)
+            if(kve > 0.0f && kve < 1.0f)
             {
-                TemplateView* kvn = templateView->getNeighborTemplates()[n];
+                const vector<TemplateView*> &neighbors = templateView->getNeighborTemplates();
                 
-                float e = kvn->getCurrentOffset(level).z;
+                vector<Point3f> &offsets = relocalization.neighborOffsets;
+                offsets.resize(neighbors.size());
                 
-                if(e > 0.0f && e < 1.0f)
-                    errorKVMap.push_back(pair<float, TemplateView*>(e, kvn));
+                parallel_for_(cv::Range(0, (int)neighbors.size()), Parallel_For_neighborSearch(object, templateView, baseMatch.offset, relocalization.binned, level, 1, offsets));
+                
+                for(int n = 0; n < neighbors.size(); n++)
+                {
+                    float e = offsets[n].z;
+                    
+                    if(e > 0.0f && e < 1.0f)
+                        errorKVMap.push_back(TemplateMatch(neighbors[n], offsets[n]));
+                }
             }
+            
+            relocalization.next++;
+            
+            return false;
         }
+        
+        sort(errorKVMap.begin(), errorKVMap.end(), sortTemplateMatch);
+        
+        parallel_for_(cv::Range(0, 8), Parallel_For_convertToBins(imagePyramid[0], relocalization.binned, object->getTCLCHistograms()->getNumBins(), 8));
+        
+        relocalization.next = 0;
+        relocalization.stage = Relocalization::REFINE_CANDIDATES;
+        
+        return false;
     }
     
-    sort(errorKVMap.begin(), errorKVMap.end(), sortTemplateView);
-    
-    parallel_for_(cv::Range(0, 8), Parallel_For_convertToBins(imagePyramid[0], binned, object->getTCLCHistograms()->getNumBins(), 8));
+    const vector<TemplateMatch> &errorKVMap = relocalization.candidates;
     
-    float minE = FLT_MAX;
-    int finalIdx = -1;
-    Matx44f finalPose;
+    int level = 2;
     
-    bool trackingLost = true;
-    
-    for(int i = 0; i < std::min(4, (int)errorKVMap.size()); i++)
+    // refine the next of the best matching candidates
+    if(relocalization.next < std::min(4, (int)errorKVMap.size()))
     {
-        TemplateView *templateView = errorKVMap[i].second;
+        const TemplateView *templateView = errorKVMap[relocalization.next].templateView;
         
-        Point3f offset = templateView->getCurrentOffset(level);;
+        Point3f offset = errorKVMap[relocalization.next].offset;
         int offsetX = offset.x;
         int offsetY = offset.y;
         float offsetE = offset.z;
@@ -297,58 +470,50 @@ void PoseEstimator6D::relocalize(Object3D *object, vector<Mat> &imagePyramid)
             
             object->setPose(pose);
             
-            renderingEngine->setLevel(0);
-            renderingEngine->renderSilhouette(vector<Model*>(objects.begin(), objects.end()), GL_FILL);
-            
-            Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-            Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
-            
-            float zNear = renderingEngine->getZNear();
-            float zFar = renderingEngine->getZFar();
-            
-            object->getTCLCHistograms()->updateCentersAndIds(mask, depth, K, zNear, zFar, 0);
+            // the contour is extracted from the mesh, since the optimization renders by itself
+            object->getTCLCHistograms()->updateCentersAndIds(K, imagePyramid[0].size());
             
             vector<Object3D*> tmp;
             tmp.push_back(object);
             
             optimizationEngine->minimize(imagePyramid, tmp, 2);
             
-            float e = evaluateEnergyFunction(object, binned, 0, 8);
+            float e = evaluateEnergyFunction(object, relocalization.binned, 0, 8);
             
-            if(e > 0.0f && e < minE)
+            if(e > 0.0f && e < relocalization.minE)
             {
-                minE = e;
-                finalPose = object->getPose();
+                relocalization.minE = e;
+                relocalization.finalPose = object->getPose();
                 
                 if(e < object->getQualityThreshold())
                 {
-                    trackingLost = false;
-                    finalIdx = i;
+                    relocalization.found = true;
                 }
             }
+            
+            // a lost object is not rendered while the relocalization continues in the next frames
+            object->setPose(Matx44f());
         }
+        
+        relocalization.next++;
+        
+        return false;
     }
-    if(!trackingLost)
+    
+    if(relocalization.found)
     {
-        object->setPose(finalPose);
+        object->setPose(relocalization.finalPose);
         object->setTrackingLost(false);
         
-        renderingEngine->setLevel(0);
-        renderingEngine->renderSilhouette(vector<Model*>(objects.begin(), objects.end()), GL_FILL);
-        
-        Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-        Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
-        
-        float zNear = renderingEngine->getZNear();
-        float zFar = renderingEngine->getZFar();
-        
-        object->getTCLCHistograms()->updateCentersAndIds(mask, depth, K, zNear, zFar, 0);
+        object->getTCLCHistograms()->updateCentersAndIds(K, imagePyramid[0].size());
         
     }
     else
     {
         object->setPose(Matx44f());
     }
+    
+    return true;
 }
 
 
@@ -388,8 +553,8 @@ float PoseEstimator6D::evaluateEnergyFunction(Object3D *object, const Mat &binne
     renderingEngine->setLevel(0);
     renderingEngine->renderSilhouette(vector<Model*>(objects.begin(), objects.end()), GL_FILL);
     
-    Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-    Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
+    Mat mask, depth;
+    renderingEngine->downloadMaskAndLinearDepth(mask, depth);
     
     return evaluateEnergyFunction(object, mask, depth, binned, level, 8);
 }
@@ -397,13 +562,10 @@ float PoseEstimator6D::evaluateEnergyFunction(Object3D *object, const Mat &binne
 
 float PoseEstimator6D::evaluateEnergyFunction(Object3D *object, const Mat &mask, const Mat &depth, const Mat &binned, int level, int threads)
 {
-    float zNear = renderingEngine->getZNear();
-    float zFar = renderingEngine->getZFar();
-    
     TCLCHistograms *tclcHistograms = object->getTCLCHistograms();
-    tclcHistograms->updateCentersAndIds(mask, depth, K, zNear, zFar, 0);
+    tclcHistograms->updateCentersAndIds(mask, depth, K, 0);
     
-    vector<Point3i> centersIDs = tclcHistograms->getCentersAndIDs();
+    const vector<Point3i> &centersIDs = tclcHistograms->getCentersAndIDs();
     
     if(centersIDs.size() > 0)
     {
@@ -412,13 +574,10 @@ float PoseEstimator6D::evaluateEnergyFunction(Object3D *object, const Mat &mask,
         Mat croppedMask = mask(roi).clone();
         Mat croppedDepth = depth(roi).clone();
         
-        Mat sdt, xyPos;
-        SDT2D->computeTransform(croppedMask, sdt, xyPos, 8, object->getModelID());
-        
-        Mat heaviside;
-        parallel_for_(cv::Range(0, 8), Parallel_For_convertToHeaviside(sdt, heaviside, 8));
+        SignedDistanceBand band;
+        SDT2D->computeTransform(croppedMask, band, 8, object->getModelID());
         
-        return evaluateEnergyFunction(tclcHistograms, centersIDs, binned, heaviside, roi, roi.x, roi.y, level, 8);
+        return evaluateEnergyFunction(tclcHistograms, centersIDs, binned, band.heaviside, roi, roi.x, roi.y, level, 8);
     }
     else
         return 0.0f;
@@ -464,7 +623,15 @@ void PoseEstimator6D::reset()
     for(int i = 0; i < objects.size(); i++)
     {
         objects[i]->reset();
+        
+        relocalizations[i] = Relocalization();
     }
     
     initialized = false;
 }
+
+
+void PoseEstimator6D::setRelocalizationBudget(float milliseconds)
+{
+    relocalizationBudget = milliseconds;
+}
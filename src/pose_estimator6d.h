@@ -45,6 +45,21 @@
 #include "optimization_engine.h"
 #include "signed_distance_transform2d.h"
 #include "template_view.h"
+#include "template_tree.h"
+
+/**
+ *  A template view together with the 2D offset at which it matched best with an
+ *  image and the corresponding matching score, as found by a template search.
+ */
+struct TemplateMatch
+{
+    const TemplateView *templateView;
+    
+    // The 2D offset with the matching score (x, y, score).
+    cv::Point3f offset;
+    
+    TemplateMatch(const TemplateView *templateView, const cv::Point3f &offset);
+};
 
 /**
  *  This class implements a region-based 6DOF pose estimator in form of a
@@ -73,11 +88,20 @@ public:
      *  @param  K The intrinsic camera matrix.
      *  @param  distCoeffs The cameras lens distortion coefficients.
      *  @param  objects A collection of all 3D objects to be tracked.
+     *  @param  renderingEngine The rendering engine to be used exclusively by this pose estimator (default = the rendering engine singleton).
      */
-    PoseEstimator6D(int width, int height, float zNear, float zFar, const cv::Matx33f &K, const cv::Matx14f &distCoeffs, std::vector<Object3D*> &objects);
+    PoseEstimator6D(int width, int height, float zNear, float zFar, const cv::Matx33f &K, const cv::Matx14f &distCoeffs, std::vector<Object3D*> &objects, RenderingEngine *renderingEngine = RenderingEngine::Instance());
     
     ~PoseEstimator6D();
     
+    /**
+     *  Returns whether the rendering engine could be initialized in the constructor.
+     *  If not, no objects have been added and the pose estimator must not be used.
+     *
+     *  @return  True if the pose estimator is ready to be used and false otherwise.
+     */
+    bool isValid();
+    
     /**
      *  Initializes/starts tracking based on the current camera frame
      *  for a specified 3D object using its initial pose by building
@@ -98,7 +122,8 @@ public:
      *  successful tracking, the pose is estimated frame-to-frame.
      *  If tracking has been lost for an object, the pose will be
      *  estimated using a template matching approach for pose detection
-     *  also based on tclc-histograms.
+     *  also based on tclc-histograms. This relocalization is spread over
+     *  several frames if a relocalization budget has been set.
      *  Within this method, the 3D objectives are updated with the
      *  new estimated poses which can be obtained by calling getPose()
      *  on each object afterwards.
@@ -115,7 +140,69 @@ public:
      */
     void reset();
     
+    /**
+     *  Sets the time per frame that may be spent on relocalizing objects for which
+     *  tracking has been lost. The relocalization of an object is then performed
+     *  incrementally on the frame in which it was started, in steps of one level of
+     *  the template tree, the neighbors of one template or one candidate refinement, and
+     *  continued in the following frames until it is finished, while the remaining
+     *  objects are tracked in every frame. At least one step is performed per frame
+     *  and lost object. Since the recovered pose belongs to an earlier frame, it is
+     *  then corrected by tracking in the next frame. With a budget of 0 (default),
+     *  every relocalization is completed within a single frame.
+     *
+     *  @param  milliseconds The time budget per frame for all relocalizations in milliseconds.
+     */
+    void setRelocalizationBudget(float milliseconds);
+    
 private:
+    /**
+     *  The state of an incremental relocalization of a single object.
+     */
+    struct Relocalization
+    {
+        enum Stage
+        {
+            INACTIVE,
+            SEARCH_TEMPLATES,
+            SEARCH_NEIGHBORS,
+            REFINE_CANDIDATES
+        };
+        
+        Stage stage;
+        
+        // the image pyramid of the frame in which the relocalization was started
+        std::vector<cv::Mat> imagePyramid;
+        
+        // the color bins of the image at the pyramid level of the current stage
+        cv::Mat binned;
+        
+        // the posterior response map used to skip offsets during the exhaustive search
+        BitMask prMask;
+        cv::Mat prIntegral;
+        
+        // the index of the next base template or candidate to be processed
+        int next;
+        
+        // the nodes of the template tree to be searched next and the base templates already searched
+        std::vector<int> frontier;
+        std::vector<uchar> searched;
+        
+        // the search results of all base templates and of the neighbors of the current base template
+        std::vector<cv::Point3f> templateOffsets;
+        std::vector<cv::Point3f> neighborOffsets;
+        
+        std::vector<TemplateMatch> baseCandidates;
+        std::vector<TemplateMatch> candidates;
+        
+        float minE;
+        cv::Matx44f finalPose;
+        bool found;
+        
+        Relocalization();
+    };
+    
+
     int width;
     int height;
     
@@ -134,11 +221,21 @@ private:
     
     cv::Mat lastFrame;
     
+    bool valid;
+    
     bool initialized;
     
     int tmp;
     
-    void relocalize(Object3D *object, std::vector<cv::Mat> &imagePyramid);
+    float relocalizationBudget;
+    
+    std::vector<Relocalization> relocalizations;
+    
+    void relocalize(int objectIndex, const std::vector<cv::Mat> &imagePyramid, int64 deadline);
+    
+    void startRelocalization(Object3D *object, Relocalization &relocalization, const std::vector<cv::Mat> &imagePyramid);
+    
+    bool continueRelocalization(Object3D *object, Relocalization &relocalization);
     
     cv::Rect computeBoundingBox(const std::vector<cv::Point3i> &centersIDs, int offset, int level, const cv::Size &maxSize);
     
@@ -168,7 +265,7 @@ private:
     float* histogramsFGData;
     float* histogramsBGData;
     
-    std::vector<cv::Point3i> _centersIDs;
+    const std::vector<cv::Point3i> &_centersIDs;
     
     uchar *initializedData;
     
@@ -193,7 +290,7 @@ private:
     int _threads;
     
 public:
-    Parallel_For_evaluateEnergy(TCLCHistograms *tclcHistograms, const std::vector<cv::Point3i> &centersIDs, const cv::Mat &bins, const cv::Mat& heaviside, const cv::Rect &roi, int offsetX, int offsetY, int level, cv::Mat &eCollection, int threads)
+    Parallel_For_evaluateEnergy(TCLCHistograms *tclcHistograms, const std::vector<cv::Point3i> &centersIDs, const cv::Mat &bins, const cv::Mat& heaviside, const cv::Rect &roi, int offsetX, int offsetY, int level, cv::Mat &eCollection, int threads): _centersIDs(centersIDs)
     {
         binsData = (int*)bins.ptr<int>();
         
@@ -203,8 +300,6 @@ public:
         histogramsFGData = (float*)localFG.ptr<float>();
         histogramsBGData = (float*)localBG.ptr<float>();
         
-        _centersIDs = centersIDs;
-        
         initializedData = tclcHistograms->getInitialized().data;
         
         numHistograms = (int)centersIDs.size();
@@ -379,26 +474,21 @@ public:
 /**
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
  *  computations. Within the corresponding for loop, for each pixel of a color
- *  input imagec (represented by the corrsponding histogram bin index) the
- *  average foreground and backgorund posterior probalility across a set of
- *  pre-computed tclc-histograms is computed. If that foregorund probablilty
- *  is greater than the background probability, the value of the pixel in the
- *  resulting posterior response map is set to 255 and 0 otherwise.
+ *  input imagec (represented by the corrsponding histogram bin index) it is looked
+ *  up whether the average foreground posterior probalility across all tclc-histograms
+ *  is greater than the background probability, in which case the value of the pixel
+ *  in the resulting posterior response map is set to 255 and 0 otherwise. The lookup
+ *  table is maintained by the tclc-histograms whenever they are updated.
  */
 class Parallel_For_createPosteriorResponseMap: public cv::ParallelLoopBody
 {
 private:
-    cv::Mat localFG;
-    cv::Mat localBG;
-    
-    uchar *initializedData;
-    
-    int numHistograms;
-    int numBins;
+    cv::Mat _posteriorLUT;
     
     cv::Mat _binned;
     cv::Mat _map;
     
+    uchar *lutData;
     int *binnedData;
     uchar *mapData;
     
@@ -407,20 +497,14 @@ private:
 public:
     Parallel_For_createPosteriorResponseMap(TCLCHistograms *tclcHistograms, const cv::Mat &binned, cv::Mat &map, int threads)
     {
-        localFG = tclcHistograms->getLocalForegroundHistograms();
-        localBG = tclcHistograms->getLocalBackgroundHistograms();
-        
-        initializedData = tclcHistograms->getInitialized().data;
-        
-        numHistograms = (int)tclcHistograms->getInitialized().cols;
-        
-        numBins = tclcHistograms->getNumBins();
+        _posteriorLUT = tclcHistograms->getPosteriorLUT();
         
         _binned = binned;
         
         map.create(_binned.rows, _binned.cols, CV_8UC1);
         _map = map;
         
+        lutData = _posteriorLUT.data;
         binnedData = (int*)_binned.ptr<int>();
         mapData = _map.data;
         
@@ -437,8 +521,6 @@ public:
             yEnd = _binned.rows;
         }
         
-        char *LUT = new char[numBins*numBins*numBins]();
-        
         for(int y = r.start*range; y < yEnd; y++)
         {
             int *binnedRow = binnedData + y*_binned.cols;
@@ -446,69 +528,9 @@ public:
             
             for(int x = 0; x < _binned.cols; x++)
             {
-                int binIdx = binnedRow[x];
-                
-                char resLUT = LUT[binIdx];
-                
-                if(resLUT)
-                {
-                    if(resLUT == 2)
-                    {
-                        mapRow[x] = 255;
-                    }
-                    else
-                    {
-                        mapRow[x] = 0;
-                    }
-                }
-                else
-                {
-                    float pYFVal = 0.0f;
-                    float pYBVal = 0.0f;
-                    
-                    int cnt = 0;
-                    
-                    for(int h = 0; h < numHistograms; h++)
-                    {
-                        if(initializedData[h])
-                        {
-                            float pyf = localFG.at<float>(h, binIdx);
-                            float pyb = localBG.at<float>(h, binIdx);
-                            
-                            if(pyf > 0.0f || pyb > 0.0f)
-                            {
-                                pyf += 0.0000001f;
-                                pyb += 0.0000001f;
-                                
-                                pYFVal += pyf / (pyf + pyb);
-                                pYBVal += pyb / (pyf + pyb);
-                            }
-                            cnt++;
-                        }
-                    }
-                    
-                    if(cnt)
-                    {
-                        pYFVal /= cnt;
-                        pYBVal /= cnt;
-                    }
-                    
-                    bool isFG = pYFVal > pYBVal;
-                    
-                    if(isFG)
-                    {
-                        mapRow[x] = 255;
-                        LUT[binIdx] = 2;
-                    }
-                    else
-                    {
-                        mapRow[x] = 0;
-                        LUT[binIdx] = 1;
-                    }
-                }
+                mapRow[x] = lutData[binnedRow[x]];
             }
         }
-        delete[] LUT;
     }
 };
 
@@ -517,13 +539,27 @@ public:
  *  computations. It is the super class for parallelized template matching using
  *  either base templates or neighboring templates. Fot this, it provides an
  *  efficient method for cost function evaluation based on a compressed template
- *  representation.
+ *  representation. The template matchers only reference the templates they are
+ *  constructed with, which must not be changed while the loop is running.
  */
 class Parallel_For_templateMatcher: public cv::ParallelLoopBody
 {
 public:
     
-    float evaluateEnergyFunction(TCLCHistograms *tclcHistograms, const std::vector<PixelData> &compressedPixelData, const cv::Mat &binned, const cv::Rect &roi, int offsetX, int offsetY) const
+    int countMapForeground(const cv::Mat &prIntegral, const cv::Rect &rect) const
+    {
+        int x0 = std::max(rect.x, 0);
+        int y0 = std::max(rect.y, 0);
+        int x1 = std::min(rect.x + rect.width, prIntegral.cols - 1);
+        int y1 = std::min(rect.y + rect.height, prIntegral.rows - 1);
+        
+        if(x1 <= x0 || y1 <= y0)
+            return 0;
+        
+        return prIntegral.at<int>(y1, x1) - prIntegral.at<int>(y0, x1) - prIntegral.at<int>(y1, x0) + prIntegral.at<int>(y0, x0);
+    }
+    
+    float evaluateEnergyFunction(TCLCHistograms *tclcHistograms, const CompressedPixelData &compressedPixelData, const cv::Mat &binned, const cv::Rect &roi, int offsetX, int offsetY) const
     {
         float e = 0.0f;
         int sum = 0;
@@ -538,14 +574,18 @@ public:
         int fullWidth = binned.cols;
         int fullHeight = binned.rows;
         
-        for(int p = 0; p < compressedPixelData.size(); p++)
+        const int *xData = compressedPixelData.x;
+        const int *yData = compressedPixelData.y;
+        const uchar *hsData = compressedPixelData.hsVal;
+        const int *idsOffsets = compressedPixelData.idsOffsets;
+        const int *ids = compressedPixelData.ids;
+        
+        for(int p = 0; p < compressedPixelData.numPixels; p++)
         {
-            PixelData pixelData = compressedPixelData[p];
+            float hsVal = hsData[p]*(1.0f/255.0f);
             
-            float hsVal = pixelData.hsVal;
-            
-            int px = pixelData.x+offsetX;
-            int py = pixelData.y+offsetY;
+            int px = xData[p]+offsetX;
+            int py = yData[p]+offsetY;
             
             if(py >= 0 && py < fullHeight && px >= 0 && px < fullWidth)
             {
@@ -556,9 +596,9 @@ public:
                 float pYBVal = 0;
                 
                 int cnt = 0;
-                for(int i = 0; i < pixelData.ids_size; i++)
+                for(int i = idsOffsets[p]; i < idsOffsets[p+1]; i++)
                 {
-                    int hID = pixelData.ids[i];
+                    int hID = ids[i];
                     if(initializedData[hID])
                     {
                         float pyf = localFG.at<float>(hID, binIdx);
@@ -586,7 +626,7 @@ public:
             }
         }
         
-        if(sum && (float)sum/compressedPixelData.size() > 0.5f)
+        if(sum && (float)sum/compressedPixelData.numPixels > 0.5f)
             e /= sum;
         else
             e = FLT_MAX;
@@ -598,74 +638,65 @@ public:
 
 /**
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
- *  computations. Within the corresponding for loop, tempalte matching for all
+ *  computations. Within the corresponding for loop, tempalte matching for a set of
  *  base templates across the whole image is performed in a sliding window manner.
  *  This is accelerated by using a posterior response map to quickly detect regions
- *  where the cost functioin must not be evaluated.
+ *  where the cost functioin must not be evaluated. The overlap of the response map
+ *  with a template mask is counted on bit-packed rows (64 pixels per AND and popcount),
+ *  after offsets have been rejected early if the number of foreground pixels of the
+ *  response map within the template's region (looked up in its integral image) is
+ *  already too small. The best offset and score (x, y, score) of every template are
+ *  written to the caller's offsets at the index of the template, from which the
+ *  search also starts if a diameter is given.
  */
 class Parallel_For_exhaustiveSearch: public Parallel_For_templateMatcher
 {
 private:
     Object3D *object;
-    std::vector<TemplateView*> templateViews;
+    const std::vector<TemplateView*> &templateViews;
     
     cv::Mat binned;
-    cv::Mat prMap;
+    
+    const BitMask *prMask;
+    cv::Mat prIntegral;
     
     int level;
     int step;
     int diameter;
     
+    cv::Point3f *offsetsData;
+    
 public:
-    Parallel_For_exhaustiveSearch(Object3D *object, std::vector<TemplateView*> &templateViews, const cv::Mat &binned, const cv::Mat &prMap, int level, int step, int diameter)
+    Parallel_For_exhaustiveSearch(Object3D *object, const std::vector<TemplateView*> &templateViews, const cv::Mat &binned, const BitMask &prMask, const cv::Mat &prIntegral, int level, int step, int diameter, std::vector<cv::Point3f> &offsets): templateViews(templateViews)
     {
         this->object = object;
-        this->templateViews = templateViews;
         
         this->binned = binned;
-        this->prMap = prMap;
+        
+        this->prMask = &prMask;
+        this->prIntegral = prIntegral;
         
         this->level = level;
         this->step = step;
         this->diameter = diameter;
+        
+        offsetsData = offsets.data();
     }
     
-    float computeMapMaskMatch(const cv::Mat &map, const cv::Mat &mask, int etaF, int offsetX, int offsetY, int innerOffset) const
+    float computeMapMaskMatch(const BitMask &mask, int etaF, int offsetX, int offsetY, int innerOffset) const
     {
-        float score = 0.0f;
+        cv::Rect inner(innerOffset, innerOffset, mask.cols() - 2*innerOffset, mask.rows() - 2*innerOffset);
         
-        uchar *mapData = map.data;
-        uchar *maskData = mask.data;
+        if(inner.width <= 0 || inner.height <= 0)
+            return 0.0f;
         
-        int fullWidth = map.cols;
-        int fullHeight = map.rows;
+        // the overlap can not exceed the foreground of the map within the template's region
+        if((float)countMapForeground(prIntegral, inner + cv::Point(offsetX, offsetY))/etaF <= 0.5f)
+            return 0.0f;
         
-        int cnt = 0;
+        int cnt = prMask->countOverlap(mask, inner, offsetX, offsetY);
         
-        for(int j = innerOffset; j < mask.rows - innerOffset; j++)
-        {
-            int idx = j*mask.cols + innerOffset;
-            
-            for(int i = innerOffset; i < mask.cols - innerOffset; i++, idx++)
-            {
-                int px = i+offsetX;
-                int py = j+offsetY;
-                
-                if(py >= 0 && py < fullHeight && px >= 0 && px < fullWidth)
-                {
-                    int pIdx = py * fullWidth + px;
-                    
-                    if(maskData[idx] && mapData[pIdx])
-                    {
-                        cnt++;
-                    }
-                }
-            }
-        }
-        
-        score = (float)cnt/etaF;
-        
-        return score;
+        return (float)cnt/etaF;
     }
     
     virtual void operator()( const cv::Range &r ) const
@@ -676,15 +707,14 @@ public:
             
             int innerOffset = tclcHistograms->getRadius()/pow(2, level);
             
-            TemplateView *tv = templateViews[t];
+            const TemplateView *tv = templateViews[t];
             cv::Rect roi = tv->getROI(level);
-            cv::Mat heaviside = tv->getHeaviside(level);
-            std::vector<cv::Point3i> centersIDs = tv->getCentersAndIDs(level);
+            const std::vector<cv::Point3i> &centersIDs = tv->getCentersAndIDs();
             
-            cv::Mat mask = tv->getMask(level);
+            const BitMask &mask = tv->getBitMask(level);
             int etaF = tv->getEtaF(level);
             
-            std::vector<PixelData> compressedPixelData = tv->getCompressedPixelData(level);
+            const CompressedPixelData &compressedPixelData = tv->getCompressedPixelData(level);
             
             int xStart, xEnd, yStart, yEnd;
             
@@ -697,7 +727,7 @@ public:
             }
             else
             {
-                cv::Point3f offset = tv->getCurrentOffset(level);
+                cv::Point3f offset = offsetsData[t];
                 xStart = offset.x - diameter;
                 xEnd = offset.x + diameter+1;
                 yStart = offset.y - diameter;
@@ -718,15 +748,12 @@ public:
             
             if((float)initCnt/centersIDs.size() > 0.5f)
             {
-                std::vector<cv::Point2i> offsets;
                 for(int offsetY = yStart; offsetY < yEnd; offsetY+=step)
                 {
                     for(int offsetX = xStart; offsetX < xEnd; offsetX+=step)
                     {
-                        if(computeMapMaskMatch(prMap, mask, etaF, offsetX, offsetY, innerOffset) > 0.5f)
+                        if(computeMapMaskMatch(mask, etaF, offsetX, offsetY, innerOffset) > 0.5f)
                         {
-                            offsets.push_back(cv::Point2i(offsetX, offsetY));
-                            
                             float e = evaluateEnergyFunction(tclcHistograms, compressedPixelData, binned, roi, offsetX, offsetY);
                             
                             if(e < minE)
@@ -740,8 +767,74 @@ public:
                 }
             }
             
-            cv::Point3f offset = cv::Point3f(finalX, finalY, minE);
-            tv->setCurrentOffset(offset, level);
+            offsetsData[t] = cv::Point3f(finalX, finalY, minE);
+        }
+    }
+};
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, it is decided for a set of
+ *  template tree nodes whether any template of their subtrees can overlap the
+ *  posterior response map by more than half of its silhouette at some offset. For
+ *  this, the overlap of the full mask of the node's representative is bounded with
+ *  the integral image and counted at all offsets, until it is large enough when
+ *  adding the number of pixels the representative misses of the subtree's templates.
+ */
+class Parallel_For_boundTemplateNodes: public Parallel_For_templateMatcher
+{
+private:
+    const TemplateTree *templateTree;
+    const std::vector<TemplateView*> &templateViews;
+    
+    const BitMask *prMask;
+    cv::Mat prIntegral;
+    
+    int level;
+    
+    const int *nodesData;
+    uchar *feasibleData;
+    
+public:
+    Parallel_For_boundTemplateNodes(const TemplateTree *templateTree, const std::vector<TemplateView*> &templateViews, const BitMask &prMask, const cv::Mat &prIntegral, int level, const std::vector<int> &nodes, std::vector<uchar> &feasible): templateViews(templateViews)
+    {
+        this->templateTree = templateTree;
+        
+        this->prMask = &prMask;
+        this->prIntegral = prIntegral;
+        
+        this->level = level;
+        
+        nodesData = nodes.data();
+        feasibleData = feasible.data();
+    }
+    
+    virtual void operator()( const cv::Range &r ) const
+    {
+        for(int n = r.start; n < r.end; n++)
+        {
+            const TemplateTree::Node &node = templateTree->getNode(nodesData[n]);
+            
+            const BitMask &mask = templateViews[node.templateIndex]->getBitMask(level);
+            cv::Rect roi(0, 0, mask.cols(), mask.rows());
+            
+            // the overlap the representative must exceed, such that a template of the subtree can exceed half of its silhouette
+            float minOverlap = 0.5f*node.minEtaF - node.maxMissing;
+            
+            bool feasible = node.minEtaF <= 0 || minOverlap < 0.0f;
+            
+            for(int offsetY = 1 - roi.height; offsetY < prMask->rows() && !feasible; offsetY++)
+            {
+                for(int offsetX = 1 - roi.width; offsetX < prMask->cols() && !feasible; offsetX++)
+                {
+                    if(countMapForeground(prIntegral, roi + cv::Point(offsetX, offsetY)) > minOverlap)
+                    {
+                        feasible = prMask->countOverlap(mask, roi, offsetX, offsetY) > minOverlap;
+                    }
+                }
+            }
+            
+            feasibleData[n] = feasible;
         }
     }
 };
@@ -751,14 +844,14 @@ public:
  *  computations. Within the corresponding for loop, template matching is performed
  *  for all neighboring templates corresponding to one base template at the 2D location
  *  where this base template matched best at the lower image pyramid level during the
- *  previous exhaustive search.
+ *  previous exhaustive search. The resulting offset and score (x, y, score) of every
+ *  neighbor are written to the caller's offsets at the index of the neighbor.
  */
 class Parallel_For_neighborSearch: public Parallel_For_templateMatcher
 {
 private:
     Object3D *object;
-    TemplateView *templateView;
-    std::vector<TemplateView*> neighbors;
+    const std::vector<TemplateView*> &neighbors;
     
     cv::Mat binned;
     
@@ -771,16 +864,15 @@ private:
     int level;
     int levelDiff;
     
+    cv::Point3f *offsetsData;
+    
 public:
-    Parallel_For_neighborSearch(Object3D *object, TemplateView *templateView, const cv::Mat &binned, int level, int levelDiff)
+    Parallel_For_neighborSearch(Object3D *object, const TemplateView *templateView, const cv::Point3f &offset0, const cv::Mat &binned, int level, int levelDiff, std::vector<cv::Point3f> &offsets): neighbors(templateView->getNeighborTemplates())
     {
         this->object = object;
-        this->templateView = templateView;
-        this->neighbors = templateView->getNeighborTemplates();
         
         this->binned = binned;
         
-        cv::Point3f offset0 = templateView->getCurrentOffset(level);
         cv::Rect roi0 = templateView->getROI(level);
         
         this->offsetX0 = offset0.x*pow(2, levelDiff);
@@ -791,6 +883,8 @@ public:
         
         this->level = level;
         this->levelDiff = levelDiff;
+        
+        offsetsData = offsets.data();
     }
     
     
@@ -800,12 +894,10 @@ public:
         {
             TCLCHistograms *tclcHistograms = object->getTCLCHistograms();
             
-            TemplateView *neighbor = neighbors[t];
+            const TemplateView *neighbor = neighbors[t];
             cv::Rect roi = neighbor->getROI(level);
-            cv::Mat heaviside = neighbor->getHeaviside(level);
-            std::vector<cv::Point3i> centersIDs = neighbor->getCentersAndIDs(level);
             
-            std::vector<PixelData> compressedPixelData = neighbor->getCompressedPixelData(level);
+            const CompressedPixelData &compressedPixelData = neighbor->getCompressedPixelData(level);
             
             int centerX = roi.x + roi.width/2;
             int centerY = roi.y + roi.height/2;
@@ -815,9 +907,7 @@ public:
             
             float e = evaluateEnergyFunction(tclcHistograms, compressedPixelData, binned, roi, offsetX, offsetY);
             
-            cv::Point3f offset(offsetX, offsetY, e);
-            
-            neighbor->setCurrentOffset(offset, level);
+            offsetsData[t] = cv::Point3f(offsetX, offsetY, e);
         }
     }
 };
@@ -0,0 +1,226 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "render_server.h"
+
+using namespace std;
+using namespace cv;
+
+RenderServer::RenderServer(RenderingEngine *renderingEngine, int queueSize) : queue(queueSize)
+{
+    this->renderingEngine = renderingEngine;
+    
+    running = false;
+    idle = false;
+}
+
+RenderServer::~RenderServer()
+{
+    stop();
+}
+
+
+void RenderServer::start()
+{
+    if(running)
+        return;
+    
+    renderingEngine->doneCurrent();
+    
+    running = true;
+    idle = false;
+    
+    StartupHandshake handshake;
+    future<void> ready = handshake.ready.get_future();
+    
+#ifdef RBOT_WITH_QT
+    ownerThread = QThread::currentThread();
+    future<QThread*> renderQThread = handshake.renderQThread.get_future();
+#endif
+    
+    renderThread = thread(&RenderServer::run, this, &handshake);
+    
+#ifdef RBOT_WITH_QT
+    // a Qt context can only be pushed to another thread from the thread it belongs to
+    QThread *target = renderQThread.get();
+    
+    QOpenGLContext *context = renderingEngine->getContext();
+    if(context)
+        context->moveToThread(target);
+    
+    handshake.contextMoved.set_value();
+#endif
+    
+    ready.wait();
+    
+    renderingEngine->setRenderServer(this);
+}
+
+
+void RenderServer::stop()
+{
+    if(!running)
+        return;
+    
+    running = false;
+    {
+        lock_guard<mutex> lock(idleMutex);
+    }
+    idleCondition.notify_all();
+    
+    renderThread.join();
+    renderThreadID = thread::id();
+    
+    renderingEngine->setRenderServer(NULL);
+    renderingEngine->makeCurrent();
+}
+
+
+bool RenderServer::isRunning()
+{
+    return running;
+}
+
+
+bool RenderServer::isRenderThread()
+{
+    return this_thread::get_id() == renderThreadID;
+}
+
+
+void RenderServer::enqueue(function<void()> command)
+{
+    if(!running)
+    {
+        command();
+        return;
+    }
+    
+    while(!queue.push(command))
+    {
+        this_thread::yield();
+    }
+    
+    // make the new command visible before checking whether the render thread sleeps
+    atomic_thread_fence(memory_order_seq_cst);
+    
+    if(idle)
+    {
+        lock_guard<mutex> lock(idleMutex);
+        idleCondition.notify_one();
+    }
+}
+
+
+void RenderServer::run(StartupHandshake *handshake)
+{
+    renderThreadID = this_thread::get_id();
+    
+#ifdef RBOT_WITH_QT
+    future<void> contextMoved = handshake->contextMoved.get_future();
+    handshake->renderQThread.set_value(QThread::currentThread());
+    contextMoved.wait();
+#endif
+    
+    renderingEngine->makeCurrent();
+    
+    handshake->ready.set_value();
+    
+    function<void()> command;
+    
+    while(true)
+    {
+        if(queue.pop(command))
+        {
+            command();
+            command = nullptr;
+            continue;
+        }
+        
+        // all pending commands are executed before stopping
+        if(!running)
+            break;
+        
+        unique_lock<mutex> lock(idleMutex);
+        idle = true;
+        idleCondition.wait(lock, [this]() { return !queue.empty() || !running; });
+        idle = false;
+    }
+    
+    renderingEngine->doneCurrent();
+    
+#ifdef RBOT_WITH_QT
+    QOpenGLContext *context = renderingEngine->getContext();
+    if(context)
+        context->moveToThread(ownerThread);
+#endif
+}
+
+
+future<Mat> RenderServer::renderSilhouette(const vector<Model*> &models, int level, RenderingEngine::FrameType type)
+{
+    RenderingEngine *engine = renderingEngine;
+    
+    // the poses are copied now, such that the models may change while the command is pending
+    RenderingEngine::SilhouetteScene scene = RenderingEngine::captureSilhouetteScene(models);
+    
+    return submit([engine, scene, level, type]()
+    {
+        engine->setLevel(level);
+        engine->renderSilhouette(scene, GL_FILL);
+        
+        return engine->downloadFrame(type);
+    });
+}
+
+
+future<RenderServer::SilhouetteFrames> RenderServer::renderSilhouettes(const vector<Model*> &models, int level, const Rect &roi)
+{
+    RenderingEngine *engine = renderingEngine;
+    
+    RenderingEngine::SilhouetteScene scene = RenderingEngine::captureSilhouetteScene(models);
+    
+    return submit([engine, scene, level, roi]()
+    {
+        SilhouetteFrames frames;
+        
+        engine->setLevel(level);
+        engine->setROI(roi);
+        engine->renderSilhouettes(scene, GL_FILL, frames.mask, frames.depth, frames.depthInv);
+        engine->setROI(Rect());
+        
+        return frames;
+    });
+}
@@ -0,0 +1,363 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef RBOT_WITH_QT
+#include <QThread>
+#endif
+
+#include <opencv2/core.hpp>
+
+#include "rendering_engine.h"
+
+/**
+ *  This class implements a bounded multi-producer multi-consumer queue that does not
+ *  require any locks. Each cell carries a sequence number that tells producers and
+ *  consumers whether it is free or holds an element for the position they claimed.
+ */
+template<class T>
+class BoundedQueue
+{
+public:
+    /**
+     *  Creates an empty queue.
+     *
+     *  @param  capacity The maximum number of elements, rounded up to the next power of 2.
+     */
+    BoundedQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while(size < capacity)
+            size *= 2;
+        
+        cells = std::vector<Cell>(size);
+        mask = size - 1;
+        
+        for(size_t i = 0; i < size; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+    
+    /**
+     *  Appends an element to the queue. The element is only moved from if it has
+     *  been appended successfully.
+     *
+     *  @param  value The element to be appended.
+     *
+     *  @return  True if the element has been appended and false if the queue is full.
+     */
+    bool push(T &value)
+    {
+        Cell *cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        
+        while(true)
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)sequence - (intptr_t)pos;
+            
+            if(dif == 0)
+            {
+                if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        
+        return true;
+    }
+    
+    /**
+     *  Removes the first element from the queue.
+     *
+     *  @param  value The removed element.
+     *
+     *  @return  True if an element has been removed and false if the queue is empty.
+     */
+    bool pop(T &value)
+    {
+        Cell *cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        
+        while(true)
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)sequence - (intptr_t)(pos + 1);
+            
+            if(dif == 0)
+            {
+                if(dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        
+        value = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        
+        return true;
+    }
+    
+    /**
+     *  Returns whether the queue is empty. Elements that are being appended
+     *  concurrently are already counted, even if they cannot be removed yet.
+     *
+     *  @return  True if the queue is empty and false otherwise.
+     */
+    bool empty() const
+    {
+        return enqueuePos.load() == dequeuePos.load();
+    }
+    
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    
+    std::vector<Cell> cells;
+    size_t mask;
+    
+    // keep producers and consumers on separate cache lines
+    char pad0[64];
+    std::atomic<size_t> enqueuePos;
+    char pad1[64];
+    std::atomic<size_t> dequeuePos;
+    char pad2[64];
+};
+
+
+/**
+ *  This class implements a render server, i.e. a dedicated thread that owns the OpenGL
+ *  context of a rendering engine and executes all rendering and readback commands
+ *  submitted to it in order. Commands are passed through a lock-free queue and their
+ *  results are returned as futures, such that the submitting threads can continue with
+ *  CPU work (e.g. signed distance transforms, histogram updates or building image
+ *  pyramids) while the GPU is busy. A command may contain any number of renderings and
+ *  readbacks to be executed as a batch.
+ *
+ *  While the server is running, all rendering and download calls of the rendering engine
+ *  made from other threads are forwarded to the server and executed synchronously, so
+ *  that existing code keeps working without making the context current itself. Note that
+ *  asynchronous commands change the state of the rendering engine (e.g. the pyramid
+ *  level), so they should not overlap with direct calls from other threads.
+ */
+class RenderServer
+{
+public:
+    /**
+     *  The results of a batched silhouette rendering as obtained with
+     *  RenderingEngine::renderSilhouettes.
+     */
+    struct SilhouetteFrames
+    {
+        cv::Mat mask;
+        cv::Mat depth;
+        std::vector<cv::Mat> depthInv;
+    };
+    
+    /**
+     *  Creates a render server for a given rendering engine that has already
+     *  been initialized.
+     *
+     *  @param  renderingEngine The rendering engine to be used (default = the rendering engine singleton).
+     *  @param  queueSize The maximum number of pending commands (default = 64).
+     */
+    RenderServer(RenderingEngine *renderingEngine = RenderingEngine::Instance(), int queueSize = 64);
+    
+    ~RenderServer();
+    
+    /**
+     *  Starts the render thread. The OpenGL context of the rendering engine is
+     *  released in the calling thread and made current in the render thread.
+     */
+    void start();
+    
+    /**
+     *  Executes all pending commands and stops the render thread. Afterwards the
+     *  OpenGL context of the rendering engine is made current in the calling thread.
+     */
+    void stop();
+    
+    /**
+     *  Returns whether the render thread is running.
+     *
+     *  @return  True if the render thread is running and false otherwise.
+     */
+    bool isRunning();
+    
+    /**
+     *  Returns whether the calling thread is the render thread.
+     *
+     *  @return  True if called from within the render thread and false otherwise.
+     */
+    bool isRenderThread();
+    
+    /**
+     *  Submits a command to be executed in the render thread. If the server is not
+     *  running, the command is executed immediately in the calling thread.
+     *
+     *  @param  command The function to be executed.
+     *
+     *  @return  A future for the result of the command.
+     */
+    template<class F>
+    std::future<typename std::result_of<F()>::type> submit(F command)
+    {
+        typedef typename std::result_of<F()>::type R;
+        
+        std::shared_ptr<std::packaged_task<R()> > task = std::make_shared<std::packaged_task<R()> >(command);
+        std::future<R> result = task->get_future();
+        
+        enqueue([task]() { (*task)(); });
+        
+        return result;
+    }
+    
+    /**
+     *  Executes a command in the render thread and waits for its result. If called from
+     *  within the render thread or if the server is not running, the command is executed
+     *  immediately in the calling thread.
+     *
+     *  @param  command The function to be executed.
+     *
+     *  @return  The result of the command.
+     */
+    template<class F>
+    typename std::result_of<F()>::type invoke(F command)
+    {
+        if(isRenderThread() || !running)
+            return command();
+        
+        return submit(command).get();
+    }
+    
+    /**
+     *  Renders multiple models in a common scene as silhouettes at a given pyramid level
+     *  and downloads the resulting frame. The poses of the models are copied when the
+     *  command is submitted, such that they may be changed while it is pending.
+     *
+     *  @param  models The models to be rendered.
+     *  @param  level The pyramid level to be used for rendering.
+     *  @param  type The frame type to be downloaded (e.g. MASK or MASK_LINEAR_DEPTH).
+     *
+     *  @return  A future for the downloaded frame.
+     */
+    std::future<cv::Mat> renderSilhouette(const std::vector<Model*> &models, int level, RenderingEngine::FrameType type);
+    
+    /**
+     *  Renders the common silhouette mask and linear depth of multiple models together with
+     *  the linear depths of their farthest surfaces (see RenderingEngine::renderSilhouettes)
+     *  at a given pyramid level. The poses of the models are copied when the command is
+     *  submitted, such that they may be changed while it is pending.
+     *
+     *  @param  models The models to be rendered.
+     *  @param  level The pyramid level to be used for rendering.
+     *  @param  roi The region of interest to be rendered wrt the pyramid level (default = empty, i.e. the whole image).
+     *
+     *  @return  A future for the downloaded frames.
+     */
+    std::future<SilhouetteFrames> renderSilhouettes(const std::vector<Model*> &models, int level, const cv::Rect &roi = cv::Rect());
+    
+private:
+    RenderingEngine *renderingEngine;
+    
+    BoundedQueue<std::function<void()> > queue;
+    
+    std::thread renderThread;
+    std::thread::id renderThreadID;
+    
+    std::atomic<bool> running;
+    std::atomic<bool> idle;
+    
+    std::mutex idleMutex;
+    std::condition_variable idleCondition;
+    
+#ifdef RBOT_WITH_QT
+    QThread *ownerThread;
+#endif
+    
+    struct StartupHandshake
+    {
+        std::promise<void> ready;
+#ifdef RBOT_WITH_QT
+        std::promise<QThread*> renderQThread;
+        std::promise<void> contextMoved;
+#endif
+    };
+    
+    void enqueue(std::function<void()> command);
+    
+    void run(StartupHandshake *handshake);
+};
+
+#endif /* RENDER_SERVER_H */
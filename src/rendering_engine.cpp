@@ -34,8 +34,14 @@
  */
 
 #include "rendering_engine.h"
+#include "render_server.h"
+
+// GLSL sources of all shaders in src/, generated by CMake
+#include "embedded_shaders.h"
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 
 using namespace std;
 using namespace cv;
@@ -45,22 +51,27 @@ RenderingEngine* RenderingEngine::instance;
 
 RenderingEngine::RenderingEngine(void)
 {
-    QSurfaceFormat glFormat;
-    glFormat.setVersion(3, 3);
-    glFormat.setProfile(QSurfaceFormat::CoreProfile);
-    glFormat.setRenderableType(QSurfaceFormat::OpenGL);
+    backend = OPENGL;
+    
+    glContext = NULL;
+    
+    renderServer = NULL;
+    
+    renderCacheSize = 8;
+    renderCacheHits = 0;
+    renderCacheMisses = 0;
+    currentRendering = NULL;
+    renderPending = false;
     
-    surface = new QOffscreenSurface();
-    surface->setFormat(glFormat);
-    surface->create();
+    softwareRasterizer = new SoftwareRasterizer();
+    softwareInvertDepth = false;
     
-    glContext = new QOpenGLContext();
-    glContext->setFormat(surface->requestedFormat());
-    glContext->create();
+    silhouetteShaderProgram = new ShaderProgram();
+    phongblinnShaderProgram = new ShaderProgram();
+    normalsShaderProgram = new ShaderProgram();
     
-    silhouetteShaderProgram = new QOpenGLShaderProgram();
-    phongblinnShaderProgram = new QOpenGLShaderProgram();
-    normalsShaderProgram = new QOpenGLShaderProgram();
+    shaderFolder = "src/";
+    shaderCacheFolder = ShaderProgram::getDefaultBinaryCacheFolder();
     
     calibrationMatrices.push_back(Matx44f::eye());
     
@@ -73,21 +84,35 @@ RenderingEngine::RenderingEngine(void)
 
 RenderingEngine::~RenderingEngine(void)
 {
-    glDeleteTextures(1, &colorTextureID);
-    glDeleteTextures(1, &depthTextureID);
-    glDeleteFramebuffers(1, &frameBufferID);
+    if(glContext)
+    {
+        makeCurrent();
+        
+        glDeleteTextures(1, &colorTextureID);
+        glDeleteTextures(1, &depthTextureID);
+        glDeleteTextures(1, &maskLinearDepthTextureID);
+        glDeleteFramebuffers(1, &frameBufferID);
+    }
+    
+    delete softwareRasterizer;
     
     delete phongblinnShaderProgram;
     delete normalsShaderProgram;
     delete silhouetteShaderProgram;
-    delete surface;
+    delete glContext;
 }
 
 void RenderingEngine::destroy()
 {
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if(this != instance)
+        return;
+    
+    if(glContext)
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
     
     delete instance;
     instance = NULL;
@@ -96,19 +121,35 @@ void RenderingEngine::destroy()
 
 void RenderingEngine::makeCurrent()
 {
-    glContext->makeCurrent(surface);
+    // the context is owned by the render thread while a render server is running
+    if(glContext && (!renderServer || renderServer->isRenderThread()))
+        glContext->makeCurrent();
 }
 
 
 void RenderingEngine::doneCurrent()
 {
-    glContext->doneCurrent();
+    if(glContext && (!renderServer || renderServer->isRenderThread()))
+        glContext->doneCurrent();
 }
 
+void RenderingEngine::setRenderServer(RenderServer *renderServer)
+{
+    this->renderServer = renderServer;
+}
+
+
+RenderServer* RenderingEngine::getRenderServer()
+{
+    return renderServer;
+}
+
+#ifdef RBOT_WITH_QT
 QOpenGLContext* RenderingEngine::getContext()
 {
-    return glContext;
+    return glContext ? glContext->getQOpenGLContext() : NULL;
 }
+#endif
 
 
 GLuint RenderingEngine::getFrameBufferID()
@@ -128,6 +169,11 @@ GLuint RenderingEngine::getDepthTextureID()
     return depthTextureID;
 }
 
+GLuint RenderingEngine::getMaskLinearDepthTextureID()
+{
+    return maskLinearDepthTextureID;
+}
+
 float RenderingEngine::getZNear()
 {
     return zNear;
@@ -138,12 +184,17 @@ float RenderingEngine::getZFar()
     return zFar;
 }
 
+Size RenderingEngine::getSize()
+{
+    return Size(width, height);
+}
+
 Matx44f RenderingEngine::getCalibrationMatrix()
 {
     return calibrationMatrices[currentLevel];
 }
 
-void RenderingEngine::init(const Matx33f& K, int width, int height, float zNear, float zFar, int numLevels)
+bool RenderingEngine::init(const Matx33f& K, int width, int height, float zNear, float zFar, int numLevels)
 {
     this->width = width;
     this->height = height;
@@ -158,15 +209,6 @@ void RenderingEngine::init(const Matx33f& K, int width, int height, float zNear,
     
     projectionMatrix = Transformations::perspectiveMatrix(K, width, height, zNear, zFar, true);
     
-    makeCurrent();
-    
-    initializeOpenGLFunctions();
-    
-    //FIX FOR NEW OPENGL
-    uint vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    
     calibrationMatrices.clear();
     
     for(int i = 0; i < numLevels; i++)
@@ -182,6 +224,32 @@ void RenderingEngine::init(const Matx33f& K, int width, int height, float zNear,
         calibrationMatrices.push_back(K_l);
     }
     
+    // the software backend does not require any OpenGL context
+    if(backend == SOFTWARE)
+        return true;
+    
+    if(glContext == NULL)
+    {
+        glContext = new OffscreenContext();
+        if(!glContext->create())
+        {
+            delete glContext;
+            glContext = NULL;
+            
+            cout << "error initializing rendering engine" << endl;
+            return false;
+        }
+    }
+    
+    makeCurrent();
+    
+    initializeOpenGLFunctions();
+    
+    //FIX FOR NEW OPENGL
+    uint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    
     cout << "GL Version " << glGetString(GL_VERSION) << endl << "GLSL Version " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
     
     glEnable(GL_DEPTH);
@@ -196,9 +264,11 @@ void RenderingEngine::init(const Matx33f& K, int width, int height, float zNear,
     
     glClearColor(0.0, 0.0, 0.0, 1.0);
     
-    initRenderingBuffers();
+    // downloaded rows are tightly packed also for region of interest widths
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     
-    shaderFolder = "src/";
+    initRenderingBuffers();
     
     initShaderProgram(silhouetteShaderProgram, "silhouette");
     initShaderProgram(phongblinnShaderProgram, "phongblinn");
@@ -209,6 +279,33 @@ void RenderingEngine::init(const Matx33f& K, int width, int height, float zNear,
     lightPosition = cv::Vec3f(0, 0, 0);
     
     doneCurrent();
+    
+    return true;
+}
+
+void RenderingEngine::setBackend(Backend backend)
+{
+    if(glContext)
+    {
+        cout << "error setting rendering backend after initialization" << endl;
+        return;
+    }
+    this->backend = backend;
+}
+
+RenderingEngine::Backend RenderingEngine::getBackend()
+{
+    return backend;
+}
+
+void RenderingEngine::setShaderFolder(const string &folder)
+{
+    shaderFolder = folder;
+}
+
+void RenderingEngine::setShaderCacheFolder(const string &folder)
+{
+    shaderCacheFolder = folder;
 }
 
 int RenderingEngine::getNumLevels()
@@ -218,6 +315,9 @@ int RenderingEngine::getNumLevels()
 
 void RenderingEngine::setLevel(int level)
 {
+    // frames downloaded afterwards do not belong to the previous rendering anymore
+    invalidateCurrentRendering();
+    
     currentLevel = level;
     int s = pow(2, currentLevel);
     width = fullWidth/s;
@@ -225,6 +325,43 @@ void RenderingEngine::setLevel(int level)
     
     width += width%4;
     height += height%4;
+    
+    if(currentROI.area() > 0)
+    {
+        currentROI = Rect();
+        projectionMatrix = Transformations::perspectiveMatrix(calibrationMatrices[0].get_minor<3, 3>(0, 0), fullWidth, fullHeight, zNear, zFar, true);
+    }
+}
+
+
+void RenderingEngine::setROI(const Rect &roi)
+{
+    if(roi.area() <= 0)
+    {
+        setLevel(currentLevel);
+        return;
+    }
+    
+    invalidateCurrentRendering();
+    
+    currentROI = roi;
+    
+    width = roi.width;
+    height = roi.height;
+    
+    // shift the principal point of the current level such that
+    // the viewport exactly covers the region of interest
+    Matx33f K_roi = calibrationMatrices[currentLevel].get_minor<3, 3>(0, 0);
+    K_roi(0, 2) -= roi.x;
+    K_roi(1, 2) -= roi.y;
+    
+    projectionMatrix = Transformations::perspectiveMatrix(K_roi, width, height, zNear, zFar, true);
+}
+
+
+Rect RenderingEngine::getROI()
+{
+    return currentROI;
 }
 
 
@@ -236,6 +373,8 @@ int RenderingEngine::getLevel()
 
 bool RenderingEngine::initRenderingBuffers()
 {
+    numTiles = 1;
+    
     glGenTextures(1, &colorTextureID);
     glBindTexture(GL_TEXTURE_2D, colorTextureID);
     
@@ -251,13 +390,26 @@ bool RenderingEngine::initRenderingBuffers()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     
+    glGenTextures(1, &maskLinearDepthTextureID);
+    glBindTexture(GL_TEXTURE_2D, maskLinearDepthTextureID);
+    
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    
     glGenFramebuffers(1, &frameBufferID);
     glBindFramebuffer(GL_FRAMEBUFFER, frameBufferID);
     
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTextureID, 0);
     
+    // the silhouette shader additionally writes the model ID and the linear depth
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, maskLinearDepthTextureID, 0);
+    
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTextureID, 0);
     
+    GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+    
     if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
         cout << "error creating rendering buffers" << endl;
@@ -268,14 +420,37 @@ bool RenderingEngine::initRenderingBuffers()
 
 
 
-bool RenderingEngine::initShaderProgram(QOpenGLShaderProgram *program, QString shaderName)
+static string loadShaderSource(const string &shaderFolder, const string &name)
 {
-    if (!program->addShaderFromSourceFile(QOpenGLShader::Vertex, shaderFolder + shaderName + "_vertex_shader.glsl")) {
-        cout << "error adding vertex shader from source file" << endl;
+    // prefer the source file so that shaders can be edited without rebuilding
+    ifstream file((shaderFolder + name + ".glsl").c_str());
+    if(file.is_open())
+    {
+        stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+    
+    for(int i = 0; embeddedShaders[i].name; i++)
+    {
+        if(name == embeddedShaders[i].name)
+        {
+            return string(embeddedShaders[i].source);
+        }
+    }
+    return string();
+}
+
+bool RenderingEngine::initShaderProgram(ShaderProgram *program, const string &shaderName)
+{
+    program->setBinaryCacheFolder(shaderCacheFolder);
+    
+    if (!program->addShaderFromSourceCode(ShaderProgram::VERTEX, loadShaderSource(shaderFolder, shaderName + "_vertex_shader"))) {
+        cout << "error adding vertex shader " << shaderName << endl;
         return false;
     }
-    if (!program->addShaderFromSourceFile(QOpenGLShader::Fragment, shaderFolder + shaderName + "_fragment_shader.glsl")) {
-        cout << "error adding fragment shader from source file" << endl;
+    if (!program->addShaderFromSourceCode(ShaderProgram::FRAGMENT, loadShaderSource(shaderFolder, shaderName + "_fragment_shader"))) {
+        cout << "error adding fragment shader " << shaderName << endl;
         return false;
     }
     
@@ -319,8 +494,140 @@ void RenderingEngine::renderNormals(Model* model, GLenum polyonMode, bool drawAl
 }
 
 
+void RenderingEngine::resizeRenderingBuffers(int tiles)
+{
+    if(tiles == numTiles)
+        return;
+    
+    numTiles = tiles;
+    
+    // the attachments are respecified in place and stay bound to the frame buffer
+    glBindTexture(GL_TEXTURE_2D, colorTextureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, fullWidth, fullHeight*numTiles, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    
+    glBindTexture(GL_TEXTURE_2D, depthTextureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, fullWidth, fullHeight*numTiles, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    
+    glBindTexture(GL_TEXTURE_2D, maskLinearDepthTextureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, fullWidth, fullHeight*numTiles, 0, GL_RG, GL_FLOAT, NULL);
+    
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cout << "error resizing rendering buffers" << endl;
+    }
+}
+
+
+void RenderingEngine::drawSilhouette(Model* model, const Matx44f &pose, const Point3f &color, GLenum polyonMode)
+{
+    Matx44f normalization = model->getNormalization();
+    
+    Matx44f modelViewMatrix = lookAtMatrix*(pose*normalization);
+    
+    Matx44f modelViewProjectionMatrix = projectionMatrix*modelViewMatrix;
+    
+    silhouetteShaderProgram->bind();
+    silhouetteShaderProgram->setUniformValue("uMVPMatrix", modelViewProjectionMatrix);
+    silhouetteShaderProgram->setUniformValue("uAlpha", 1.0f);
+    silhouetteShaderProgram->setUniformValue("uColor", Vec3f(color.x, color.y, color.z));
+    
+    glPolygonMode(GL_FRONT_AND_BACK, polyonMode);
+    
+    model->draw(silhouetteShaderProgram, GL_TRIANGLES, true);
+}
+
+
 void RenderingEngine::renderSilhouette(vector<Model*> models, GLenum polyonMode, bool invertDepth, const std::vector<cv::Point3f>& colors, bool drawAll)
 {
+    // the poses are taken in the calling thread, since the rendering may be deferred or forwarded
+    renderSilhouette(captureSilhouetteScene(models, colors, drawAll), polyonMode, invertDepth);
+}
+
+
+void RenderingEngine::renderSilhouette(const SilhouetteScene &scene, GLenum polyonMode, bool invertDepth)
+{
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        renderServer->invoke([&]() { renderSilhouette(scene, polyonMode, invertDepth); });
+        return;
+    }
+    
+    invalidateCurrentRendering();
+    
+    if(renderCacheSize > 0)
+    {
+        vector<float> key = renderCacheKey(scene, polyonMode, invertDepth);
+        
+        for(list<CachedRendering>::iterator it = renderCache.begin(); it != renderCache.end(); ++it)
+        {
+            if(it->key == key)
+            {
+                // skip the rendering unless a frame is requested that has not been cached
+                renderCache.splice(renderCache.begin(), renderCache, it);
+                currentRendering = &renderCache.front();
+                
+                renderPending = true;
+                pendingScene = scene;
+                pendingPolygonMode = polyonMode;
+                pendingInvertDepth = invertDepth;
+                
+                return;
+            }
+        }
+        
+        CachedRendering rendering;
+        rendering.key = key;
+        rendering.frames.resize(MASK_LINEAR_DEPTH + 1);
+        
+        renderCache.push_front(rendering);
+        if(renderCache.size() > renderCacheSize)
+        {
+            renderCache.pop_back();
+        }
+        currentRendering = &renderCache.front();
+    }
+    
+    renderSilhouetteScene(scene, polyonMode, invertDepth);
+}
+
+
+RenderingEngine::SilhouetteScene RenderingEngine::captureSilhouetteScene(const vector<Model*> &models, const vector<Point3f> &colors, bool drawAll)
+{
+    SilhouetteScene scene;
+    
+    for(int i = 0; i < models.size(); i++)
+    {
+        Model* model = models[i];
+        
+        scene.models.push_back(model);
+        scene.poses.push_back(model->getPose());
+        scene.ids.push_back(model->getModelID());
+        
+        if(i < colors.size())
+        {
+            scene.colors.push_back(colors[i]);
+        }
+        else
+        {
+            scene.colors.push_back(Point3f((float)(model->getModelID())/255.0f, 0.0f, 0.0f));
+        }
+        
+        scene.drawn.push_back(model->isInitialized() || drawAll);
+    }
+    
+    return scene;
+}
+
+
+void RenderingEngine::renderSilhouetteScene(const SilhouetteScene &scene, GLenum polyonMode, bool invertDepth)
+{
+    if(backend == SOFTWARE)
+    {
+        renderSilhouetteSoftware(scene, invertDepth);
+        return;
+    }
+    
     glViewport(0, 0, width, height);
     
     if(invertDepth)
@@ -331,49 +638,285 @@ void RenderingEngine::renderSilhouette(vector<Model*> models, GLenum polyonMode,
     
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
     
-    for(int i = 0; i < models.size(); i++)
+    for(int i = 0; i < scene.models.size(); i++)
     {
-        Model* model = models[i];
+        if(scene.drawn[i])
+        {
+            drawSilhouette(scene.models[i], scene.poses[i], scene.colors[i], polyonMode);
+        }
+    }
+    
+    glClearDepth(0.0f);
+    glDepthFunc(GL_GREATER);
+    
+    glFinish();
+}
+
+
+void RenderingEngine::renderSilhouettes(const vector<Model*> &models, GLenum polyonMode, Mat &mask, Mat &depth, vector<Mat> &depthInv, bool drawAll)
+{
+    renderSilhouettes(captureSilhouetteScene(models, vector<Point3f>(), drawAll), polyonMode, mask, depth, depthInv);
+}
+
+
+void RenderingEngine::renderSilhouettes(const SilhouetteScene &scene, GLenum polyonMode, Mat &mask, Mat &depth, vector<Mat> &depthInv)
+{
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        renderServer->invoke([&]() { renderSilhouettes(scene, polyonMode, mask, depth, depthInv); });
+        return;
+    }
+    
+    invalidateCurrentRendering();
+    
+    int numModels = (int)scene.models.size();
+    
+    depthInv.assign(numModels, Mat());
+    
+    if(backend == SOFTWARE)
+    {
+        renderSilhouetteSoftware(scene, false);
+        mask = softwareMask;
+        depth = linearizeSoftwareDepth();
         
-        if(model->isInitialized() || drawAll)
+        // each model individually by drawing only this one of the scene
+        SilhouetteScene single = scene;
+        for(int i = 0; i < numModels; i++)
         {
-            Matx44f pose = model->getPose();
-            Matx44f normalization = model->getNormalization();
-            
-            Matx44f modelViewMatrix = lookAtMatrix*(pose*normalization);
-            
-            Matx44f modelViewProjectionMatrix = projectionMatrix*modelViewMatrix;
-            
-            silhouetteShaderProgram->bind();
-            silhouetteShaderProgram->setUniformValue("uMVPMatrix", QMatrix4x4(modelViewProjectionMatrix.val));
-            silhouetteShaderProgram->setUniformValue("uAlpha", 1.0f);
-            
-            Point3f color;
-            if(i < colors.size())
+            if(scene.drawn[i])
             {
-                 color = colors[i];
+                single.drawn.assign(numModels, 0);
+                single.drawn[i] = 1;
+                
+                renderSilhouetteSoftware(single, true);
+                depthInv[i] = linearizeSoftwareDepth();
             }
-            else
-            {
-                color = Point3f((float)(model->getModelID())/255.0f, 0.0f, 0.0f);
-            }
-            silhouetteShaderProgram->setUniformValue("uColor", QVector3D(color.x, color.y, color.z));
+        }
+        return;
+    }
+    
+    vector<int> tiles(numModels, 0);
+    int tilesUsed = 1;
+    for(int i = 0; i < numModels; i++)
+    {
+        if(scene.drawn[i])
+        {
+            tiles[i] = tilesUsed++;
+        }
+    }
+    
+    // the buffers only grow with the number of tracked models
+    if(tilesUsed > numTiles)
+        resizeRenderingBuffers(tilesUsed);
+    
+    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    
+    // the common scene in the first tile
+    glViewport(0, 0, width, height);
+    
+    for(int i = 0; i < numModels; i++)
+    {
+        if(tiles[i])
+        {
+            drawSilhouette(scene.models[i], scene.poses[i], scene.colors[i], polyonMode);
+        }
+    }
+    
+    // each model individually in its own tile, where the flipped depth range makes
+    // the unchanged depth test keep the farthest surface
+    glDepthRange(0, 1);
+    
+    for(int i = 0; i < numModels; i++)
+    {
+        if(tiles[i])
+        {
+            glViewport(0, tiles[i]*height, width, height);
+            drawSilhouette(scene.models[i], scene.poses[i], scene.colors[i], polyonMode);
+        }
+    }
+    
+    glDepthRange(1, 0);
+    
+    glFinish();
+    
+    Mat packedTiles(height*tilesUsed, width, CV_32FC2);
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glReadPixels(0, 0, packedTiles.cols, packedTiles.rows, GL_RG, GL_FLOAT, packedTiles.data);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    
+    vector<Mat> channels;
+    split(packedTiles.rowRange(0, height), channels);
+    
+    channels[0].convertTo(mask, CV_8UC1);
+    depth = channels[1];
+    
+    for(int i = 0; i < numModels; i++)
+    {
+        if(tiles[i])
+        {
+            extractChannel(packedTiles.rowRange(tiles[i]*height, (tiles[i]+1)*height), depthInv[i], 1);
+        }
+    }
+}
+
+
+void RenderingEngine::renderSilhouetteBatch(Model *model, const vector<Matx44f> &poses, vector<Mat> &masks, vector<Mat> &depths, const Point3f &color)
+{
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        renderServer->invoke([&]() { renderSilhouetteBatch(model, poses, masks, depths, color); });
+        return;
+    }
+    
+    invalidateCurrentRendering();
+    
+    masks.assign(poses.size(), Mat());
+    depths.assign(poses.size(), Mat());
+    
+    if(backend == SOFTWARE)
+    {
+        SilhouetteScene scene = captureSilhouetteScene(vector<Model*>(1, model), vector<Point3f>(1, color), true);
+        
+        for(int i = 0; i < poses.size(); i++)
+        {
+            scene.poses[0] = poses[i];
+            renderSilhouetteSoftware(scene, false);
+            masks[i] = softwareMask.clone();
+            depths[i] = linearizeSoftwareDepth();
+        }
+        return;
+    }
+    
+    // the number of tiles is bounded by the maximum texture size and the memory of the attachments
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    int batchSize = max(1, min(16, (int)maxTextureSize/fullHeight));
+    
+    // the buffers are only enlarged for the batch and shrunk back to the tiles used for tracking afterwards
+    int trackingTiles = numTiles;
+    resizeRenderingBuffers(max(trackingTiles, min(batchSize, (int)poses.size())));
+    
+    for(int b = 0; b < poses.size(); b += batchSize)
+    {
+        int tilesUsed = min(batchSize, (int)poses.size() - b);
+        
+        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        
+        for(int t = 0; t < tilesUsed; t++)
+        {
+            glViewport(0, t*height, width, height);
+            drawSilhouette(model, poses[b + t], color, GL_FILL);
+        }
+        
+        glFinish();
+        
+        Mat packedTiles(height*tilesUsed, width, CV_32FC2);
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+        glReadPixels(0, 0, packedTiles.cols, packedTiles.rows, GL_RG, GL_FLOAT, packedTiles.data);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        
+        for(int t = 0; t < tilesUsed; t++)
+        {
+            vector<Mat> channels;
+            split(packedTiles.rowRange(t*height, (t+1)*height), channels);
             
-            glPolygonMode(GL_FRONT_AND_BACK, polyonMode);
+            channels[0].convertTo(masks[b + t], CV_8UC1);
+            depths[b + t] = channels[1];
+        }
+    }
+    
+    resizeRenderingBuffers(trackingTiles);
+}
+
+
+void RenderingEngine::renderSilhouettePyramid(const vector<Model*> &models, int level, vector<Mat> &masks, vector<Mat> &depths, bool invertDepth, const vector<Point3f> &colors, bool drawAll)
+{
+    masks.assign(numLevels, Mat());
+    depths.assign(numLevels, Mat());
+    
+    setLevel(level);
+    renderSilhouette(models, GL_FILL, invertDepth, colors, drawAll);
+    downloadMaskAndLinearDepth(masks[level], depths[level]);
+    
+    for(int l = level + 1; l < numLevels; l++)
+    {
+        reduceSilhouette(masks[l-1], depths[l-1], masks[l], depths[l], invertDepth);
+    }
+}
+
+
+void RenderingEngine::reduceSilhouette(const Mat &mask, const Mat &depth, Mat &coarseMask, Mat &coarseDepth, bool invertDepth)
+{
+    parallel_for_(cv::Range(0, 8), Parallel_For_reduceSilhouette(mask, depth, coarseMask, coarseDepth, invertDepth, 8));
+}
+
+
+void RenderingEngine::renderSilhouetteSoftware(const SilhouetteScene &scene, bool invertDepth)
+{
+    vector<Model*> drawnModels;
+    vector<Matx44f> mvpMatrices;
+    vector<uchar> maskValues;
+    
+    for(int i = 0; i < scene.models.size(); i++)
+    {
+        Model* model = scene.models[i];
+        
+        if(scene.drawn[i])
+        {
+            Matx44f normalization = model->getNormalization();
+            
+            Matx44f modelViewMatrix = lookAtMatrix*(scene.poses[i]*normalization);
             
-            model->draw(silhouetteShaderProgram);
+            float red = scene.colors[i].x;
+            
+            drawnModels.push_back(model);
+            mvpMatrices.push_back(projectionMatrix*modelViewMatrix);
+            // same conversion as for the red channel of the OpenGL color buffer
+            maskValues.push_back(saturate_cast<uchar>(red*255.0f));
         }
     }
     
-    glClearDepth(0.0f);
-    glDepthFunc(GL_GREATER);
+    // render into new buffers, such that previously downloaded frames stay valid
+    softwareMask = Mat();
+    softwareDepth = Mat();
+    softwareInvertDepth = invertDepth;
     
-    glFinish();
+    softwareRasterizer->renderSilhouette(drawnModels, mvpMatrices, maskValues, Size(width, height), invertDepth, softwareMask, softwareDepth);
+}
+
+
+Mat RenderingEngine::linearizeSoftwareDepth()
+{
+    Mat linear;
+    
+    // the depth buffer is cleared to 1 in case of an inverted depth test and to 0 otherwise
+    float background = softwareInvertDepth ? 1.0f : 0.0f;
+    
+    parallel_for_(cv::Range(0, 8), Parallel_For_linearizeDepth(softwareDepth, linear, zNear, zFar, background, 8));
+    
+    return linear;
 }
 
 
 void RenderingEngine::renderShaded(vector<Model*> models, GLenum polyonMode, const std::vector<cv::Point3f>& colors, bool drawAll)
 {
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        renderServer->invoke([&]() { renderShaded(models, polyonMode, colors, drawAll); });
+        return;
+    }
+    
+    invalidateCurrentRendering();
+    
+    if(backend == SOFTWARE)
+    {
+        cout << "error shaded rendering is not supported by the software backend" << endl;
+        return;
+    }
+    
     glViewport(0, 0, width, height);
     
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
@@ -384,25 +927,6 @@ void RenderingEngine::renderShaded(vector<Model*> models, GLenum polyonMode, con
         
         if(model->isInitialized() || drawAll)
         {
-            Matx44f pose = model->getPose();
-            Matx44f normalization = model->getNormalization();
-            
-            Matx44f modelViewMatrix = lookAtMatrix*(pose*normalization);
-            
-            Matx33f normalMatrix = modelViewMatrix.get_minor<3, 3>(0, 0).inv().t();
-            
-            Matx44f modelViewProjectionMatrix = projectionMatrix*modelViewMatrix;
-            
-            phongblinnShaderProgram->bind();
-            phongblinnShaderProgram->setUniformValue("uMVMatrix", QMatrix4x4(modelViewMatrix.val));
-            phongblinnShaderProgram->setUniformValue("uMVPMatrix", QMatrix4x4(modelViewProjectionMatrix.val));
-            phongblinnShaderProgram->setUniformValue("uNormalMatrix", QMatrix3x3(normalMatrix.val));
-            phongblinnShaderProgram->setUniformValue("uLightPosition1", QVector3D(0.1, 0.1, -0.02));
-            phongblinnShaderProgram->setUniformValue("uLightPosition2", QVector3D(-0.1, 0.1, -0.02));
-            phongblinnShaderProgram->setUniformValue("uLightPosition3", QVector3D(0.0, 0.0, 0.1));
-            phongblinnShaderProgram->setUniformValue("uShininess", 100.0f);
-            phongblinnShaderProgram->setUniformValue("uAlpha", 1.0f);
-            
             Point3f color;
             if(i < colors.size())
             {
@@ -412,19 +936,138 @@ void RenderingEngine::renderShaded(vector<Model*> models, GLenum polyonMode, con
             {
                 color = Point3f(1.0, 0.5, 0.0);
             }
-            phongblinnShaderProgram->setUniformValue("uColor", QVector3D(color.x, color.y, color.z));
-            
-            glPolygonMode(GL_FRONT_AND_BACK, polyonMode);
-            
-            model->draw(phongblinnShaderProgram);
+            drawShaded(model, color, polyonMode);
         }
     }
     
     glFinish();
 }
 
+
+void RenderingEngine::drawShaded(Model* model, const Point3f &color, GLenum polyonMode)
+{
+    Matx44f pose = model->getPose();
+    Matx44f normalization = model->getNormalization();
+    
+    Matx44f modelViewMatrix = lookAtMatrix*(pose*normalization);
+    
+    Matx33f normalMatrix = modelViewMatrix.get_minor<3, 3>(0, 0).inv().t();
+    
+    Matx44f modelViewProjectionMatrix = projectionMatrix*modelViewMatrix;
+    
+    phongblinnShaderProgram->bind();
+    phongblinnShaderProgram->setUniformValue("uMVMatrix", modelViewMatrix);
+    phongblinnShaderProgram->setUniformValue("uMVPMatrix", modelViewProjectionMatrix);
+    phongblinnShaderProgram->setUniformValue("uNormalMatrix", normalMatrix);
+    phongblinnShaderProgram->setUniformValue("uLightPosition1", Vec3f(0.1, 0.1, -0.02));
+    phongblinnShaderProgram->setUniformValue("uLightPosition2", Vec3f(-0.1, 0.1, -0.02));
+    phongblinnShaderProgram->setUniformValue("uLightPosition3", Vec3f(0.0, 0.0, 0.1));
+    phongblinnShaderProgram->setUniformValue("uShininess", 100.0f);
+    phongblinnShaderProgram->setUniformValue("uAlpha", 1.0f);
+    phongblinnShaderProgram->setUniformValue("uColor", Vec3f(color.x, color.y, color.z));
+    
+    glPolygonMode(GL_FRONT_AND_BACK, polyonMode);
+    
+    model->draw(phongblinnShaderProgram);
+}
+
+
+Mat RenderingEngine::renderOverlay(const Mat &frame, const vector<Model*> &models, const vector<Point3f> &colors, bool drawAll)
+{
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        Mat result;
+        renderServer->invoke([&]() { result = renderOverlay(frame, models, colors, drawAll); });
+        return result;
+    }
+    
+    Mat result = frame.clone();
+    
+    if(backend == SOFTWARE)
+    {
+        cout << "error overlay rendering is not supported by the software backend" << endl;
+        return result;
+    }
+    
+    Rect frameRect = currentROI.area() > 0 ? currentROI : Rect(0, 0, width, height);
+    if(frame.type() != CV_8UC3 || frame.cols != frameRect.width || frame.rows != frameRect.height)
+    {
+        cout << "error overlay image does not match the rendering size" << endl;
+        return result;
+    }
+    
+    // only the image region covered by the models has to be composited
+    Rect roi;
+    for(int i = 0; i < models.size(); i++)
+    {
+        if(models[i]->isInitialized() || drawAll)
+        {
+            vector<Point2f> projections;
+            Rect boundingRect;
+            projectBoundingBox(models[i], projections, boundingRect);
+            
+            roi |= boundingRect;
+        }
+    }
+    roi = Rect(roi.x - frameRect.x - 1, roi.y - frameRect.y - 1, roi.width + 2, roi.height + 2) & Rect(0, 0, frame.cols, frame.rows);
+    if(roi.area() == 0)
+    {
+        return result;
+    }
+    
+    Rect previousROI = currentROI;
+    setROI(roi + frameRect.tl());
+    
+    // upload the image region as the background of the rendering, with the
+    // rows of the full image skipped in between those of the region
+    Mat frameROI = frame(roi);
+    glBindTexture(GL_TEXTURE_2D, colorTextureID);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(frameROI.step/frameROI.elemSize()));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, roi.width, roi.height, GL_BGR, GL_UNSIGNED_BYTE, frameROI.data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    
+    glViewport(0, 0, width, height);
+    
+    glClear(GL_DEPTH_BUFFER_BIT);
+    
+    for(int i = 0; i < models.size(); i++)
+    {
+        if(models[i]->isInitialized() || drawAll)
+        {
+            Point3f color = i < colors.size() ? colors[i] : Point3f(1.0, 0.5, 0.0);
+            drawShaded(models[i], color, GL_FILL);
+        }
+    }
+    
+    // download the composition directly into the region of the result
+    Mat resultROI = result(roi);
+    glPixelStorei(GL_PACK_ROW_LENGTH, (GLint)(resultROI.step/resultROI.elemSize()));
+    glReadPixels(0, 0, roi.width, roi.height, GL_BGR, GL_UNSIGNED_BYTE, resultROI.data);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    
+    setROI(previousROI);
+    
+    return result;
+}
+
 void RenderingEngine::renderNormals(vector<Model*> models, GLenum polyonMode, bool drawAll)
 {
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        renderServer->invoke([&]() { renderNormals(models, polyonMode, drawAll); });
+        return;
+    }
+    
+    invalidateCurrentRendering();
+    
+    if(backend == SOFTWARE)
+    {
+        cout << "error normal rendering is not supported by the software backend" << endl;
+        return;
+    }
+    
     glViewport(0, 0, width, height);
     
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
@@ -445,9 +1088,9 @@ void RenderingEngine::renderNormals(vector<Model*> models, GLenum polyonMode, bo
             Matx44f modelViewProjectionMatrix = projectionMatrix*modelViewMatrix;
             
             normalsShaderProgram->bind();
-            normalsShaderProgram->setUniformValue("uMVMatrix", QMatrix4x4(modelViewMatrix.val));
-            normalsShaderProgram->setUniformValue("uMVPMatrix", QMatrix4x4(modelViewProjectionMatrix.val));
-            normalsShaderProgram->setUniformValue("uNormalMatrix", QMatrix3x3(normalMatrix.val));
+            normalsShaderProgram->setUniformValue("uMVMatrix", modelViewMatrix);
+            normalsShaderProgram->setUniformValue("uMVPMatrix", modelViewProjectionMatrix);
+            normalsShaderProgram->setUniformValue("uNormalMatrix", normalMatrix);
             normalsShaderProgram->setUniformValue("uAlpha", 1.0f);
             
             glPolygonMode(GL_FRONT_AND_BACK, polyonMode);
@@ -513,8 +1156,70 @@ void RenderingEngine::projectBoundingBox(Model* model, std::vector<cv::Point2f>&
 }
 
 Mat RenderingEngine::downloadFrame(RenderingEngine::FrameType type)
+{
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        return renderServer->invoke([&]() { return downloadFrame(type); });
+    }
+    
+    if(currentRendering)
+    {
+        if(!currentRendering->frames[type].empty())
+        {
+            renderCacheHits++;
+            return currentRendering->frames[type];
+        }
+        renderCacheMisses++;
+    }
+    
+    renderPendingSilhouettes();
+    
+    Mat res = readFrame(type);
+    
+    if(currentRendering)
+    {
+        currentRendering->frames[type] = res;
+    }
+    
+    return res;
+}
+
+
+Mat RenderingEngine::readFrame(RenderingEngine::FrameType type)
 {
     Mat res;
+    
+    // the software backend renders directly into host memory
+    if(backend == SOFTWARE)
+    {
+        switch (type)
+        {
+            case MASK:
+                res = softwareMask;
+                break;
+            case DEPTH:
+                res = softwareDepth;
+                break;
+            case LINEAR_DEPTH:
+                res = linearizeSoftwareDepth();
+                break;
+            case MASK_LINEAR_DEPTH:
+            {
+                vector<Mat> channels(2);
+                softwareMask.convertTo(channels[0], CV_32FC1);
+                channels[1] = linearizeSoftwareDepth();
+                merge(channels, res);
+                break;
+            }
+            default:
+                cout << "error frame type not supported by the software backend" << endl;
+                res = Mat::zeros(height, width, CV_8UC1);
+                break;
+        }
+        return res;
+    }
+    
     switch (type)
     {
         case MASK:
@@ -533,9 +1238,158 @@ Mat RenderingEngine::downloadFrame(RenderingEngine::FrameType type)
             res = Mat(height, width, CV_32FC1);
             glReadPixels(0, 0, res.cols, res.rows, GL_DEPTH_COMPONENT, GL_FLOAT,  res.data);
             break;
+        case LINEAR_DEPTH:
+            res = Mat(height, width, CV_32FC1);
+            glReadBuffer(GL_COLOR_ATTACHMENT1);
+            glReadPixels(0, 0, res.cols, res.rows, GL_GREEN, GL_FLOAT, res.data);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            break;
+        case MASK_LINEAR_DEPTH:
+            res = Mat(height, width, CV_32FC2);
+            glReadBuffer(GL_COLOR_ATTACHMENT1);
+            glReadPixels(0, 0, res.cols, res.rows, GL_RG, GL_FLOAT, res.data);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            break;
         default:
             res = Mat::zeros(height, width, CV_8UC1);
             break;
     }
     return res;
 }
+
+
+void RenderingEngine::downloadMaskAndLinearDepth(Mat &mask, Mat &depth)
+{
+    // execute within the thread owning the OpenGL context
+    if(renderServer && !renderServer->isRenderThread())
+    {
+        renderServer->invoke([&]() { downloadMaskAndLinearDepth(mask, depth); });
+        return;
+    }
+    
+    if(currentRendering)
+    {
+        if(!currentRendering->frames[MASK].empty() && !currentRendering->frames[LINEAR_DEPTH].empty())
+        {
+            renderCacheHits++;
+            mask = currentRendering->frames[MASK];
+            depth = currentRendering->frames[LINEAR_DEPTH];
+            return;
+        }
+        renderCacheMisses++;
+    }
+    
+    renderPendingSilhouettes();
+    
+    if(backend == SOFTWARE)
+    {
+        mask = softwareMask;
+        depth = linearizeSoftwareDepth();
+    }
+    else
+    {
+        Mat packed = readFrame(MASK_LINEAR_DEPTH);
+        
+        vector<Mat> channels;
+        split(packed, channels);
+        
+        channels[0].convertTo(mask, CV_8UC1);
+        depth = channels[1];
+    }
+    
+    if(currentRendering)
+    {
+        currentRendering->frames[MASK] = mask;
+        currentRendering->frames[LINEAR_DEPTH] = depth;
+    }
+}
+
+
+void RenderingEngine::setRenderCacheSize(int size)
+{
+    renderCacheSize = size;
+    
+    invalidateCurrentRendering();
+    
+    while(renderCache.size() > max(renderCacheSize, 0))
+    {
+        renderCache.pop_back();
+    }
+}
+
+
+void RenderingEngine::clearRenderCache()
+{
+    invalidateCurrentRendering();
+    
+    renderCache.clear();
+}
+
+
+int RenderingEngine::getRenderCacheHits()
+{
+    return renderCacheHits;
+}
+
+
+int RenderingEngine::getRenderCacheMisses()
+{
+    return renderCacheMisses;
+}
+
+
+void RenderingEngine::resetRenderCacheStatistics()
+{
+    renderCacheHits = 0;
+    renderCacheMisses = 0;
+}
+
+
+vector<float> RenderingEngine::renderCacheKey(const SilhouetteScene &scene, GLenum polyonMode, bool invertDepth)
+{
+    vector<float> key;
+    
+    key.push_back(currentLevel);
+    key.push_back(currentROI.x);
+    key.push_back(currentROI.y);
+    key.push_back(currentROI.width);
+    key.push_back(currentROI.height);
+    key.push_back(width);
+    key.push_back(height);
+    key.push_back(invertDepth);
+    key.push_back(polyonMode);
+    
+    for(int i = 0; i < scene.models.size(); i++)
+    {
+        if(scene.drawn[i])
+        {
+            Point3f color = scene.colors[i];
+            
+            key.push_back(scene.ids[i]);
+            key.push_back(color.x);
+            key.push_back(color.y);
+            key.push_back(color.z);
+            
+            key.insert(key.end(), scene.poses[i].val, scene.poses[i].val + 16);
+        }
+    }
+    
+    return key;
+}
+
+
+void RenderingEngine::invalidateCurrentRendering()
+{
+    currentRendering = NULL;
+    renderPending = false;
+}
+
+
+void RenderingEngine::renderPendingSilhouettes()
+{
+    if(renderPending)
+    {
+        renderPending = false;
+        renderSilhouetteScene(pendingScene, pendingPolygonMode, pendingInvertDepth);
+    }
+}
@@ -37,36 +37,64 @@
 #define RENDERING_ENGINE
 
 #include <iostream>
-
-#include <QOpenGLContext>
-#include <QOffscreenSurface>
-
-#include <QGLFramebufferObject>
-#include <QOpenGLShaderProgram>
-#include <QOpenGLFunctions_3_3_Core>
+#include <list>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "gl_functions.h"
+#include "offscreen_context.h"
+#include "shader_program.h"
 #include "transformations.h"
 #include "model.h"
+#include "software_rasterizer.h"
+
+class RenderServer;
 
 /**
  *  This class implements an OpenGL-based offscreen rendering engine for generating
  *  images of projected 3D meshes based on given object poses and camera instrinsics.
  *  It supports one or mutiple objects to be rendered as binary masks, depth maps,
  *  normal maps or phong-shaded. It also allows to perform all renderings according
- *  to a specified image pyramid level at lower resolutions. The class is  implemented
- *  as a singleton.
+ *  to a specified image pyramid level at lower resolutions. Each instance has its own
+ *  OpenGL context and frame buffer, such that e.g. one instance per tracker can be used
+ *  in parallel threads. A process-wide default instance is provided as a singleton
+ *  via Instance(). Note that the rendering buffers of a model live in the context of
+ *  the instance that was active when they were initialized, so each model must only be
+ *  rendered by that instance. Alternatively to OpenGL, silhouette masks and depth maps can be
+ *  rendered with a multi-threaded CPU rasterizer that requires no rendering context
+ *  (e.g. on machines without a GPU).
  */
-class RenderingEngine : public QOpenGLFunctions_3_3_Core
+class RenderingEngine : public GLFunctions
 {
 public:
     enum FrameType {
         MASK,
         RGB,
         RGB_32F,
-        DEPTH
+        DEPTH,
+        LINEAR_DEPTH,
+        MASK_LINEAR_DEPTH
+    };
+    
+    enum Backend {
+        OPENGL,
+        SOFTWARE
+    };
+    
+    /**
+     *  A snapshot of the models of a silhouette rendering, i.e. the pose, ID and color
+     *  of each model and whether it is drawn, taken when the rendering is requested.
+     *  The rendering only reads the geometry of the models, such that their poses can
+     *  be changed before it is actually performed.
+     */
+    struct SilhouetteScene
+    {
+        std::vector<Model*> models;
+        std::vector<cv::Matx44f> poses;
+        std::vector<int> ids;
+        std::vector<cv::Point3f> colors;
+        std::vector<uchar> drawn;
     };
     
     RenderingEngine(void);
@@ -94,8 +122,46 @@ public:
      *  @param  zNear The distance of the OpenGL near plane.
      *  @param  zFar The distance of the OpenGL far plane.
      *  @param  numLevels Number of supported pyramid levels with a downscale factor of 2.
+     *  @return  True if the rendering engine has been initialized successfully and false if its OpenGL context could not be created.
+     */
+    bool init(const cv::Matx33f &K, int width, int height, float zNear, float zFar, int numLevels);
+    
+    /**
+     *  Sets the backend used for rendering. This must be called before init(). With
+     *  the SOFTWARE backend no OpenGL context is created and only silhouette renderings
+     *  are supported, of which the MASK, DEPTH, LINEAR_DEPTH and MASK_LINEAR_DEPTH
+     *  frames can be downloaded. The default backend is OPENGL.
+     *
+     *  @param  backend The backend to be used for rendering (e.g. OPENGL or SOFTWARE).
+     */
+    void setBackend(Backend backend);
+    
+    /**
+     *  Returns the backend used for rendering.
+     *
+     *  @return  The backend used for rendering.
+     */
+    Backend getBackend();
+    
+    /**
+     *  Sets the folder from which the GLSL shader sources are loaded. This must be called
+     *  before init(). Shaders that are not found in this folder are taken from the copies
+     *  embedded into the binary at build time, so that the sources only have to be present
+     *  when modifying them. The default folder is "src/".
+     *
+     *  @param  folder The folder containing the GLSL shader sources.
      */
-    void init(const cv::Matx33f &K, int width, int height, float zNear, float zFar, int numLevels);
+    void setShaderFolder(const std::string &folder);
+    
+    /**
+     *  Sets the folder in which compiled shader program binaries are cached across runs.
+     *  This must be called before init(). An empty folder disables the cache. The default
+     *  is given by ShaderProgram::getDefaultBinaryCacheFolder(). With Qt, the folder is
+     *  ignored and the shader disk cache of Qt is used instead.
+     *
+     *  @param  folder The folder for caching shader program binaries.
+     */
+    void setShaderCacheFolder(const std::string &folder);
     
     /**
      *  Returns the number of supported pyramid levels for rendering.
@@ -106,12 +172,32 @@ public:
     
     /**
      *  Sets a pyramid level to be used for rendering between 0 (full resolution)
-     *  and getNumLevels() (the smallest resolution).
+     *  and getNumLevels() (the smallest resolution). This also resets the region of
+     *  interest to the whole image.
      *
      *  @param level The pyramid level to be used for rendering.
      */
     void setLevel(int level);
     
+    /**
+     *  Restricts all following renderings to a region of interest within the image
+     *  at the current pyramid level. The viewport then only covers this region and
+     *  an off-center projection is used, such that the rendered and downloaded images
+     *  equal the corresponding crop of a full image rendering at the current level,
+     *  while only the pixels within the region are processed. An empty rect resets
+     *  the region of interest to the whole image.
+     *
+     *  @param roi The region of interest in pixels wrt the current pyramid level.
+     */
+    void setROI(const cv::Rect &roi);
+    
+    /**
+     *  Returns the current region of interest used for rendering.
+     *
+     *  @return  The current region of interest (empty if the whole image is rendered).
+     */
+    cv::Rect getROI();
+    
     /**
      *  Returns the current pyramid level used for rendering.
      *
@@ -120,7 +206,8 @@ public:
     int getLevel();
     
     /**
-     *  Activates the OpenGL context of the rendering engine.
+     *  Activates the OpenGL context of the rendering engine. While a render server
+     *  is running this has no effect outside of the render thread.
      */
     void makeCurrent();
     
@@ -129,12 +216,31 @@ public:
      */
     void doneCurrent();
     
+    /**
+     *  Sets the render server whose thread owns the OpenGL context. While set, all
+     *  rendering and download calls from other threads are forwarded to the render
+     *  thread and executed synchronously. This is called by RenderServer::start()
+     *  and RenderServer::stop().
+     *
+     *  @param  renderServer The render server owning the context or NULL.
+     */
+    void setRenderServer(RenderServer *renderServer);
+    
+    /**
+     *  Returns the render server whose thread owns the OpenGL context.
+     *
+     *  @return  The render server owning the context or NULL if none is running.
+     */
+    RenderServer *getRenderServer();
+    
+#ifdef RBOT_WITH_QT
     /**
      *  Returns the OpenGL context of the rendering engine.
      *
      *  @return  The OpenGL context of the rendering engine.
      */
     QOpenGLContext *getContext();
+#endif
     
     /**
      *  Returns the OpenGL ID of the frame buffer object used for offscreen rendering.
@@ -157,6 +263,14 @@ public:
      */
     GLuint getDepthTextureID();
     
+    /**
+     *  Returns the OpenGL texture ID of the packed model ID and linear depth image
+     *  rendered along with silhouettes.
+     *
+     *  @return  The OpenGL texture ID of the packed model ID and linear depth image.
+     */
+    GLuint getMaskLinearDepthTextureID();
+    
     /**
      *  Returns the Z-distance of the near plane.
      *
@@ -171,6 +285,14 @@ public:
      */
     float getZFar();
     
+    /**
+     *  Returns the size of the rendered images wrt the current pyramid level
+     *  and region of interest.
+     *
+     *  @return  The size of the rendered images.
+     */
+    cv::Size getSize();
+    
     /**
      *  Returns a 4x4 float version of the intrinsic camera matrix wrt the current
      *  pyramid level
@@ -235,6 +357,110 @@ public:
      */
     void renderSilhouette(std::vector<Model*> models, GLenum polyonMode, bool invertDepth = false, const std::vector<cv::Point3f> &colors = std::vector<cv::Point3f>(), bool drawAll = false);
     
+    /**
+     *  Renders the models of a previously captured scene as silhouettes, where the poses,
+     *  colors and drawn models are taken from the snapshot instead of the models.
+     *
+     *  @param scene The snapshot of the models to be rendered.
+     *  @param polyonMode The OpenGL polygon mode to be used (e.g. GL_FILL).
+     *  @param invertDepth Whether to invert the depth test during rendering (default = false).
+     */
+    void renderSilhouette(const SilhouetteScene &scene, GLenum polyonMode, bool invertDepth = false);
+    
+    /**
+     *  Renders multiple models in a common scene into a silhouette mask and a depth buffer
+     *  and additionally the inverse depth buffer (i.e. the farthest surface) of each model
+     *  individually, all within a single frame buffer and downloaded with a single readback
+     *  of the packed model ID and linear depth target. Therefore the frame buffer is split
+     *  into vertically stacked tiles, where the first contains the common scene and each
+     *  subsequent one a single model rendered with a flipped depth range. Each model is
+     *  rendered with a constant color corresponding to its model index in the red channel.
+     *  The results are equal to those of a call of renderSilhouette for all models followed
+     *  by downloadMaskAndLinearDepth and a call of renderSilhouette for each model individually
+     *  with an inverted depth test followed by downloading the LINEAR_DEPTH frame.
+     *
+     *  @param models The models to be rendered.
+     *  @param polyonMode The OpenGL polygon mode to be used (e.g. GL_FILL).
+     *  @param mask The resulting common silhouette mask (single channel, uchar).
+     *  @param depth The resulting common linear depth in camera space (single channel, float, 0 for the background).
+     *  @param depthInv The resulting linear depths of the farthest surface per model (single channel, float, 0 for the background, empty for models that have not been drawn).
+     *  @param drawAll Whether to draw all models even if they been not yet initlaized for tracking (default = false).
+     */
+    void renderSilhouettes(const std::vector<Model*> &models, GLenum polyonMode, cv::Mat &mask, cv::Mat &depth, std::vector<cv::Mat> &depthInv, bool drawAll = false);
+    
+    /**
+     *  Renders the common silhouette mask and linear depth of the models of a previously
+     *  captured scene together with the linear depths of their farthest surfaces, as
+     *  renderSilhouettes does for the current state of the models.
+     *
+     *  @param scene The snapshot of the models to be rendered.
+     *  @param polyonMode The OpenGL polygon mode to be used (e.g. GL_FILL).
+     *  @param mask The resulting common silhouette mask (single channel, uchar).
+     *  @param depth The resulting common linear depth in camera space (single channel, float, 0 for the background).
+     *  @param depthInv The resulting linear depths of the farthest surface per model (single channel, float, 0 for the background, empty for models that have not been drawn).
+     */
+    void renderSilhouettes(const SilhouetteScene &scene, GLenum polyonMode, cv::Mat &mask, cv::Mat &depth, std::vector<cv::Mat> &depthInv);
+    
+    /**
+     *  Takes a snapshot of the current poses, IDs and colors of multiple models, such
+     *  that they can be rendered later or in another thread while the models change.
+     *
+     *  @param models The models to be captured.
+     *  @param colors A vector of colors to be used for each model (default = empty, i.e. the model index in the red channel).
+     *  @param drawAll Whether to draw all models even if they been not yet initlaized for tracking (default = false).
+     *  @return  The snapshot of the models.
+     */
+    static SilhouetteScene captureSilhouetteScene(const std::vector<Model*> &models, const std::vector<cv::Point3f> &colors = std::vector<cv::Point3f>(), bool drawAll = false);
+    
+    /**
+     *  Renders multiple models in a common scene as silhouettes only once at a given pyramid
+     *  level and derives the silhouette masks and linear depths of all coarser levels from
+     *  it on the CPU with reduceSilhouette, instead of rendering and downloading each level
+     *  individually. Each model is rendered with a constant color corresponding to its model
+     *  index in the red channel, if no colors are specified.
+     *
+     *  @param models The models to be rendered.
+     *  @param level The finest pyramid level to be rendered.
+     *  @param masks The resulting silhouette masks per pyramid level (single channel, uchar, empty for levels finer than level).
+     *  @param depths The resulting linear depths per pyramid level (single channel, float, 0 for the background, empty for levels finer than level).
+     *  @param invertDepth Whether to invert the depth test during rendering, i.e. to obtain the farthest surfaces (default = false).
+     *  @param colors A vector of colors to be used for each model (default = empty).
+     *  @param drawAll Whether to draw all models even if they been not yet initlaized for tracking (default = false).
+     */
+    void renderSilhouettePyramid(const std::vector<Model*> &models, int level, std::vector<cv::Mat> &masks, std::vector<cv::Mat> &depths, bool invertDepth = false, const std::vector<cv::Point3f> &colors = std::vector<cv::Point3f>(), bool drawAll = false);
+    
+    /**
+     *  Renders the silhouette of a single model at multiple poses, e.g. for generating
+     *  templates. The renderings are batched into vertically stacked tiles of the frame
+     *  buffer, such that each batch is downloaded with a single readback of the packed
+     *  model ID and linear depth target. The model is drawn regardless of whether it has
+     *  been initialized and its own pose is not changed.
+     *
+     *  @param model The model to be rendered.
+     *  @param poses The poses at which the model is to be rendered.
+     *  @param masks The resulting silhouette masks per pose (single channel, uchar).
+     *  @param depths The resulting linear depths in camera space per pose (single channel, float, 0 for the background).
+     *  @param color The constant color of the model (default = white).
+     */
+    void renderSilhouetteBatch(Model *model, const std::vector<cv::Matx44f> &poses, std::vector<cv::Mat> &masks, std::vector<cv::Mat> &depths, const cv::Point3f &color = cv::Point3f(1.0f, 1.0f, 1.0f));
+    
+    /**
+     *  Reduces a silhouette mask and the corresponding linear depth to the next coarser
+     *  pyramid level, i.e. to half their width and height, where each pixel is derived from
+     *  a block of 2x2 pixels. A pixel is considered foreground if at least two pixels of its
+     *  block are foreground (i.e. the center of the coarser pixel, which lies on the corner
+     *  shared by the block, is covered by the majority). It then gets the mask value and
+     *  depth of the closest surface within the block (or of the farthest surface in case
+     *  of an inverted depth test), while background pixels get 0 for both.
+     *
+     *  @param mask The silhouette mask to be reduced (single channel, uchar).
+     *  @param depth The corresponding linear depth (single channel, float, 0 for the background).
+     *  @param coarseMask The resulting reduced silhouette mask (single channel, uchar).
+     *  @param coarseDepth The resulting reduced linear depth (single channel, float).
+     *  @param invertDepth Whether the depth has been rendered with an inverted depth test (default = false).
+     */
+    static void reduceSilhouette(const cv::Mat &mask, const cv::Mat &depth, cv::Mat &coarseMask, cv::Mat &coarseDepth, bool invertDepth = false);
+    
     /**
      *  Renders a multiple models in a common scene wrt their current poses using Phong shading.
      *
@@ -256,6 +482,22 @@ public:
      */
     void renderNormals(std::vector<Model*> models, GLenum polyonMode, bool drawAll = false);
     
+    /**
+     *  Composites multiple models rendered with Phong shading wrt their current poses on top
+     *  of a given camera image, e.g. for visualizing the tracking results. The image region
+     *  covered by the projected bounding boxes of the models is uploaded into the color buffer,
+     *  which the models are then rendered over with only the depth buffer cleared, such that
+     *  the composition is done by OpenGL and requires a single RGB download of that region.
+     *  The image must have the size of the current pyramid level.
+     *
+     *  @param frame The camera image to draw the models on (BGR, uchar).
+     *  @param models The models to be rendered.
+     *  @param colors A vector of colors to be used for each model (default = empty).
+     *  @param drawAll Whether to draw the model even if it has not yet been initlaized for tracking (default = false).
+     *  @return  A copy of the camera image with the shaded models drawn on top.
+     */
+    cv::Mat renderOverlay(const cv::Mat &frame, const std::vector<Model*> &models, const std::vector<cv::Point3f> &colors = std::vector<cv::Point3f>(), bool drawAll = false);
+    
     /**
      *  Projects the eight corners of a model's bouding box into the image and computes the
      *  enclosing 2D bounding rect of these projections wrt the model's poae.
@@ -271,16 +513,74 @@ public:
      *  it to an OpenCV image depending on a given frametype. Use MASK to obtain a silhouette
      *  mask image (single channel, uchar), RGB to obtain a color image (RGB, uchar), RGB_32F
      *  to obtain color image with normalized intensities in [0, 1] (RGB, float) or DEPTH to
-     *  obtain the depth buffer.
+     *  obtain the depth buffer. For silhouette renderings LINEAR_DEPTH yields the Z-distance
+     *  to the camera of the rendered surface per pixel (single channel, float, 0 for the
+     *  background), so that no conversion of depth buffer values with the near and far plane
+     *  is required, and MASK_LINEAR_DEPTH yields the mask value and the linear depth packed
+     *  into one image (two channels, float). If the rendering is taken from the render cache,
+     *  the returned image is shared with the cache and must not be modified, i.e. it has to
+     *  be cloned before writing into it (see setRenderCacheSize).
      *
-     *  @param type The frame type to be downloaded and returned (e.g. MASK, RGB, RGB32F or DEPTH).
+     *  @param type The frame type to be downloaded and returned (e.g. MASK, RGB, RGB32F, DEPTH, LINEAR_DEPTH or MASK_LINEAR_DEPTH).
      *
      *  @return  The most recently rendered image according to the desired frame type.
      */
     cv::Mat downloadFrame(RenderingEngine::FrameType type);
     
     /**
-     *  Destroys and deletes the current rendering engine singleton instance.
+     *  Downloads the silhouette mask and the linear depth of the most recently rendered
+     *  silhouettes with a single readback of the MASK_LINEAR_DEPTH frame. If the rendering
+     *  is taken from the render cache, both images are shared with the cache and must not
+     *  be modified, i.e. they have to be cloned before writing into them (see setRenderCacheSize).
+     *
+     *  @param mask The resulting silhouette mask (single channel, uchar).
+     *  @param depth The resulting linear depth in camera space (single channel, float, 0 for the background).
+     */
+    void downloadMaskAndLinearDepth(cv::Mat &mask, cv::Mat &depth);
+    
+    /**
+     *  Sets the maximum number of silhouette renderings whose downloaded frames are kept
+     *  in the render cache. The cache is keyed by the model IDs, poses and colors of all
+     *  drawn models together with the pyramid level, the region of interest and the depth
+     *  test. When renderSilhouette is called again with a scene in the cache, rendering is
+     *  skipped and the frames downloaded before are returned. Such a rendering is only
+     *  performed if a frame is requested that has not been downloaded yet. The frames
+     *  returned from the cache are shared and must not be modified. The default size is 8
+     *  and a size of 0 disables the cache.
+     *
+     *  @param  size The maximum number of cached silhouette renderings.
+     */
+    void setRenderCacheSize(int size);
+    
+    /**
+     *  Removes all renderings from the render cache.
+     */
+    void clearRenderCache();
+    
+    /**
+     *  Returns the number of silhouette frame downloads that have been served from
+     *  the render cache.
+     *
+     *  @return  The number of render cache hits.
+     */
+    int getRenderCacheHits();
+    
+    /**
+     *  Returns the number of silhouette frame downloads that required a readback (and
+     *  possibly a rendering) because they were not found in the render cache.
+     *
+     *  @return  The number of render cache misses.
+     */
+    int getRenderCacheMisses();
+    
+    /**
+     *  Resets the render cache hit and miss counters to 0.
+     */
+    void resetRenderCacheStatistics();
+    
+    /**
+     *  Destroys and deletes the current rendering engine singleton instance. This has
+     *  no effect for other instances, which are deleted by their owner instead.
      */
     void destroy();
 
@@ -301,30 +601,250 @@ private:
     
     int currentLevel;
     
+    cv::Rect currentROI;
+    
     std::vector<cv::Matx44f> calibrationMatrices;
     cv::Matx44f projectionMatrix;
     cv::Matx44f lookAtMatrix;
     
-    QOffscreenSurface *surface;
-    QOpenGLContext *glContext;
+    Backend backend;
+    
+    OffscreenContext *glContext;
+    
+    RenderServer *renderServer;
+    
+    SoftwareRasterizer *softwareRasterizer;
+    
+    cv::Mat softwareMask;
+    cv::Mat softwareDepth;
+    
+    bool softwareInvertDepth;
     
     GLuint frameBufferID;
     GLuint colorTextureID;
     GLuint depthTextureID;
+    GLuint maskLinearDepthTextureID;
+    
+    int numTiles;
+    
+    struct CachedRendering
+    {
+        std::vector<float> key;
+        std::vector<cv::Mat> frames;
+    };
+    
+    std::list<CachedRendering> renderCache;
+    int renderCacheSize;
+    
+    int renderCacheHits;
+    int renderCacheMisses;
+    
+    // the cache entry of the most recent silhouette rendering (or NULL)
+    CachedRendering *currentRendering;
+    
+    // the snapshot of a cached silhouette rendering that has been skipped
+    bool renderPending;
+    SilhouetteScene pendingScene;
+    GLenum pendingPolygonMode;
+    bool pendingInvertDepth;
     
     int angle;
     
     cv::Vec3f lightPosition;
     
-    QString shaderFolder;
-    QOpenGLShaderProgram *silhouetteShaderProgram;
-    QOpenGLShaderProgram *phongblinnShaderProgram;
-    QOpenGLShaderProgram *normalsShaderProgram;
+    std::string shaderFolder;
+    std::string shaderCacheFolder;
+    ShaderProgram *silhouetteShaderProgram;
+    ShaderProgram *phongblinnShaderProgram;
+    ShaderProgram *normalsShaderProgram;
     
     bool initRenderingBuffers();
     
-    bool initShaderProgram(QOpenGLShaderProgram *program, QString shaderName);
+    void resizeRenderingBuffers(int tiles);
+    
+    void drawSilhouette(Model *model, const cv::Matx44f &pose, const cv::Point3f &color, GLenum polyonMode);
     
+    void drawShaded(Model *model, const cv::Point3f &color, GLenum polyonMode);
+    
+    void renderSilhouetteScene(const SilhouetteScene &scene, GLenum polyonMode, bool invertDepth);
+    
+    std::vector<float> renderCacheKey(const SilhouetteScene &scene, GLenum polyonMode, bool invertDepth);
+    
+    void invalidateCurrentRendering();
+    
+    void renderPendingSilhouettes();
+    
+    cv::Mat readFrame(RenderingEngine::FrameType type);
+    
+    bool initShaderProgram(ShaderProgram *program, const std::string &shaderName);
+    
+    void renderSilhouetteSoftware(const SilhouetteScene &scene, bool invertDepth);
+    
+    cv::Mat linearizeSoftwareDepth();
+    
+};
+
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, a silhouette mask and its linear
+ *  depth are reduced to half their resolution, where each pixel covered by at least two
+ *  pixels of its 2x2 block gets the mask value and depth of the closest (or farthest)
+ *  surface within the block.
+ */
+class Parallel_For_reduceSilhouette: public cv::ParallelLoopBody
+{
+private:
+    cv::Mat _mask;
+    cv::Mat _depth;
+    
+    cv::Mat _coarseMask;
+    cv::Mat _coarseDepth;
+    
+    bool _invertDepth;
+    
+    int _threads;
+    
+public:
+    Parallel_For_reduceSilhouette(const cv::Mat &mask, const cv::Mat &depth, cv::Mat &coarseMask, cv::Mat &coarseDepth, bool invertDepth, int threads)
+    {
+        _mask = mask;
+        _depth = depth;
+        
+        coarseMask = cv::Mat(mask.rows/2, mask.cols/2, CV_8UC1);
+        coarseDepth = cv::Mat(mask.rows/2, mask.cols/2, CV_32FC1);
+        
+        _coarseMask = coarseMask;
+        _coarseDepth = coarseDepth;
+        
+        _invertDepth = invertDepth;
+        
+        _threads = threads;
+    }
+    
+    virtual void operator()( const cv::Range &r ) const
+    {
+        int range = _coarseMask.rows/_threads;
+        
+        int yEnd = r.end*range;
+        if(r.end == _threads)
+        {
+            yEnd = _coarseMask.rows;
+        }
+        
+        for(int y = r.start*range; y < yEnd; y++)
+        {
+            const uchar *maskRows[2] = {(uchar*)_mask.ptr<uchar>(2*y), (uchar*)_mask.ptr<uchar>(2*y+1)};
+            const float *depthRows[2] = {(float*)_depth.ptr<float>(2*y), (float*)_depth.ptr<float>(2*y+1)};
+            
+            uchar *coarseMaskRow = (uchar*)_coarseMask.ptr<uchar>(y);
+            float *coarseDepthRow = (float*)_coarseDepth.ptr<float>(y);
+            
+            for(int x = 0; x < _coarseMask.cols; x++)
+            {
+                int covered = 0;
+                
+                uchar m = 0;
+                float d = 0.0f;
+                
+                for(int j = 0; j < 2; j++)
+                {
+                    for(int i = 2*x; i < 2*x+2; i++)
+                    {
+                        float di = depthRows[j][i];
+                        
+                        if(maskRows[j][i] == 0 && di == 0.0f)
+                            continue;
+                        
+                        if(covered == 0 || (_invertDepth ? di > d : di < d))
+                        {
+                            m = maskRows[j][i];
+                            d = di;
+                        }
+                        covered++;
+                    }
+                }
+                
+                if(covered >= 2)
+                {
+                    coarseMaskRow[x] = m;
+                    coarseDepthRow[x] = d;
+                }
+                else
+                {
+                    coarseMaskRow[x] = 0;
+                    coarseDepthRow[x] = 0.0f;
+                }
+            }
+        }
+    }
+};
+
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, the values of a depth buffer
+ *  rendered with an inverted depth range are converted into linear Z-distances to the
+ *  camera, where pixels equal to the cleared background value are set to 0.
+ */
+class Parallel_For_linearizeDepth: public cv::ParallelLoopBody
+{
+private:
+    cv::Mat _depth;
+    cv::Mat _linear;
+    
+    float _zNear;
+    float _zFar;
+    
+    float _background;
+    
+    int _threads;
+    
+public:
+    Parallel_For_linearizeDepth(const cv::Mat &depth, cv::Mat &linear, float zNear, float zFar, float background, int threads)
+    {
+        _depth = depth;
+        
+        linear.create(depth.rows, depth.cols, CV_32FC1);
+        _linear = linear;
+        
+        _zNear = zNear;
+        _zFar = zFar;
+        
+        _background = background;
+        
+        _threads = threads;
+    }
+    
+    virtual void operator()( const cv::Range &r ) const
+    {
+        int range = _depth.rows/_threads;
+        
+        int yEnd = r.end*range;
+        if(r.end == _threads)
+        {
+            yEnd = _depth.rows;
+        }
+        
+        for(int y = r.start*range; y < yEnd; y++)
+        {
+            const float *depthRow = (float*)_depth.ptr<float>(y);
+            float *linearRow = (float*)_linear.ptr<float>(y);
+            
+            for(int x = 0; x < _depth.cols; x++)
+            {
+                if(depthRow[x] == _background)
+                {
+                    linearRow[x] = 0.0f;
+                }
+                else
+                {
+                    float d = 1.0f - depthRow[x];
+                    linearRow[x] = 2.0f * _zNear * _zFar / (_zFar + _zNear - (2.0f*d - 1.0) * (_zFar - _zNear));
+                }
+            }
+        }
+    }
 };
 
 
@@ -0,0 +1,436 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shader_program.h"
+#include "file_utils.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+
+static bool readSourceFile(const string &fileName, string &source)
+{
+    ifstream file(fileName.c_str());
+    if(!file.is_open())
+    {
+        cout << "error opening shader source file " << fileName << endl;
+        return false;
+    }
+    stringstream buffer;
+    buffer << file.rdbuf();
+    source = buffer.str();
+    
+    return true;
+}
+
+string ShaderProgram::getDefaultBinaryCacheFolder()
+{
+    return getCacheFolder("RBOT_SHADER_CACHE", "");
+}
+
+#ifdef RBOT_WITH_QT
+
+ShaderProgram::ShaderProgram()
+{
+    program = new QOpenGLShaderProgram();
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    delete program;
+}
+
+bool ShaderProgram::addShaderFromSourceFile(ShaderType type, const string &fileName)
+{
+    string source;
+    if(!readSourceFile(fileName, source))
+    {
+        return false;
+    }
+    return addShaderFromSourceCode(type, source);
+}
+
+bool ShaderProgram::addShaderFromSourceCode(ShaderType type, const string &source)
+{
+    // Qt only compiles cacheable shaders on link if the program binary is not in its disk cache
+    return program->addCacheableShaderFromSourceCode(type == VERTEX ? QOpenGLShader::Vertex : QOpenGLShader::Fragment, source.c_str());
+}
+
+void ShaderProgram::setBinaryCacheFolder(const string &)
+{
+    // the location of the Qt shader disk cache is managed by Qt itself
+}
+
+bool ShaderProgram::link()
+{
+    return program->link();
+}
+
+void ShaderProgram::bind()
+{
+    program->bind();
+}
+
+void ShaderProgram::setUniformValue(const char *name, float value)
+{
+    program->setUniformValue(name, value);
+}
+
+void ShaderProgram::setUniformValue(const char *name, const Vec3f &value)
+{
+    program->setUniformValue(name, QVector3D(value[0], value[1], value[2]));
+}
+
+void ShaderProgram::setUniformValue(const char *name, const Matx33f &value)
+{
+    program->setUniformValue(name, QMatrix3x3(value.val));
+}
+
+void ShaderProgram::setUniformValue(const char *name, const Matx44f &value)
+{
+    program->setUniformValue(name, QMatrix4x4(value.val));
+}
+
+void ShaderProgram::enableAttributeArray(const char *name)
+{
+    program->enableAttributeArray(name);
+}
+
+void ShaderProgram::disableAttributeArray(const char *name)
+{
+    program->disableAttributeArray(name);
+}
+
+void ShaderProgram::setAttributeBuffer(const char *name, GLenum type, int offset, int tupleSize, int stride)
+{
+    program->setAttributeBuffer(name, type, offset, tupleSize, stride);
+}
+
+#else
+
+ShaderProgram::ShaderProgram()
+{
+    programID = 0;
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    if(programID)
+    {
+        glDeleteProgram(programID);
+    }
+}
+
+bool ShaderProgram::addShaderFromSourceFile(ShaderType type, const string &fileName)
+{
+    string source;
+    if(!readSourceFile(fileName, source))
+    {
+        return false;
+    }
+    return addShaderFromSourceCode(type, source);
+}
+
+bool ShaderProgram::addShaderFromSourceCode(ShaderType type, const string &source)
+{
+    if(source.empty())
+    {
+        cout << "error adding empty shader source" << endl;
+        return false;
+    }
+    sources.push_back(make_pair(type, source));
+    
+    return true;
+}
+
+void ShaderProgram::setBinaryCacheFolder(const string &folder)
+{
+    binaryCacheFolder = folder;
+}
+
+bool ShaderProgram::link()
+{
+    if(!programID)
+    {
+        programID = glCreateProgram();
+    }
+    
+    string cacheFile = binaryCacheFile();
+    if(!cacheFile.empty() && loadBinary(cacheFile))
+    {
+        return true;
+    }
+    
+    if(!compileShaders())
+    {
+        return false;
+    }
+    
+    if(!cacheFile.empty())
+    {
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    
+    glLinkProgram(programID);
+    
+    GLint status;
+    glGetProgramiv(programID, GL_LINK_STATUS, &status);
+    if(!status)
+    {
+        char log[1024];
+        glGetProgramInfoLog(programID, sizeof(log), NULL, log);
+        cout << "error linking shader program: " << log << endl;
+        return false;
+    }
+    
+    if(!cacheFile.empty())
+    {
+        saveBinary(cacheFile);
+    }
+    
+    return true;
+}
+
+bool ShaderProgram::compileShaders()
+{
+    for(int i = 0; i < sources.size(); i++)
+    {
+        const char *sourceData = sources[i].second.c_str();
+        
+        GLuint shaderID = glCreateShader(sources[i].first == VERTEX ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER);
+        glShaderSource(shaderID, 1, &sourceData, NULL);
+        glCompileShader(shaderID);
+        
+        GLint status;
+        glGetShaderiv(shaderID, GL_COMPILE_STATUS, &status);
+        if(!status)
+        {
+            char log[1024];
+            glGetShaderInfoLog(shaderID, sizeof(log), NULL, log);
+            cout << "error compiling " << (sources[i].first == VERTEX ? "vertex" : "fragment") << " shader: " << log << endl;
+            glDeleteShader(shaderID);
+            return false;
+        }
+        
+        glAttachShader(programID, shaderID);
+        // the shader is only flagged for deletion and released with the program
+        glDeleteShader(shaderID);
+    }
+    
+    return true;
+}
+
+string ShaderProgram::binaryCacheFile()
+{
+    if(binaryCacheFolder.empty())
+    {
+        return string();
+    }
+    
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if(numFormats <= 0)
+    {
+        return string();
+    }
+    
+    // FNV-1a hash over the driver identification and all shader sources, since
+    // program binaries are only valid for the exact driver they were created with
+    vector<string> keys;
+    const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION};
+    for(int i = 0; i < 4; i++)
+    {
+        const GLubyte *value = glGetString(names[i]);
+        keys.push_back(value ? string((const char*)value) : string());
+    }
+    for(int i = 0; i < sources.size(); i++)
+    {
+        keys.push_back(sources[i].first == VERTEX ? "vertex" : "fragment");
+        keys.push_back(sources[i].second);
+    }
+    
+    uint64_t hash = 14695981039346656037ULL;
+    for(int i = 0; i < keys.size(); i++)
+    {
+        // include the terminating zero to separate consecutive keys
+        for(int j = 0; j <= keys[i].size(); j++)
+        {
+            hash ^= (unsigned char)keys[i].c_str()[j];
+            hash *= 1099511628211ULL;
+        }
+    }
+    
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    
+    return binaryCacheFolder + "/" + name;
+}
+
+static const char binaryMagic[8] = {'R', 'B', 'O', 'T', 'P', 'R', 'G', '1'};
+
+bool ShaderProgram::loadBinary(const string &fileName)
+{
+    ifstream file(fileName.c_str(), ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    
+    char magic[8];
+    GLint format = 0;
+    GLint length = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&format, sizeof(format));
+    file.read((char*)&length, sizeof(length));
+    if(!file.good() || memcmp(magic, binaryMagic, sizeof(magic)) != 0 || length <= 0)
+    {
+        return false;
+    }
+    
+    vector<char> binary(length);
+    file.read(&binary[0], length);
+    if(!file.good())
+    {
+        return false;
+    }
+    
+    glProgramBinary(programID, format, &binary[0], length);
+    
+    // the driver rejects binaries it can no longer use, e.g. after an update
+    GLint status;
+    glGetProgramiv(programID, GL_LINK_STATUS, &status);
+    
+    return status == GL_TRUE;
+}
+
+void ShaderProgram::saveBinary(const string &fileName)
+{
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+    {
+        return;
+    }
+    
+    vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(programID, length, NULL, &format, &binary[0]);
+    
+    createFolders(binaryCacheFolder);
+    
+    // write to a temporary file first so that concurrent processes never read a partial binary
+    string tmpFileName = fileName + ".tmp";
+    ofstream file(tmpFileName.c_str(), ios::binary);
+    if(!file.is_open())
+    {
+        cout << "error writing shader program binary " << fileName << endl;
+        return;
+    }
+    
+    GLint formatValue = format;
+    file.write(binaryMagic, sizeof(binaryMagic));
+    file.write((const char*)&formatValue, sizeof(formatValue));
+    file.write((const char*)&length, sizeof(length));
+    file.write(&binary[0], length);
+    file.close();
+    
+    if(!file.good() || rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        cout << "error writing shader program binary " << fileName << endl;
+        remove(tmpFileName.c_str());
+    }
+}
+
+void ShaderProgram::bind()
+{
+    glUseProgram(programID);
+}
+
+void ShaderProgram::setUniformValue(const char *name, float value)
+{
+    glUniform1f(glGetUniformLocation(programID, name), value);
+}
+
+void ShaderProgram::setUniformValue(const char *name, const Vec3f &value)
+{
+    glUniform3f(glGetUniformLocation(programID, name), value[0], value[1], value[2]);
+}
+
+void ShaderProgram::setUniformValue(const char *name, const Matx33f &value)
+{
+    glUniformMatrix3fv(glGetUniformLocation(programID, name), 1, GL_TRUE, value.val);
+}
+
+void ShaderProgram::setUniformValue(const char *name, const Matx44f &value)
+{
+    glUniformMatrix4fv(glGetUniformLocation(programID, name), 1, GL_TRUE, value.val);
+}
+
+void ShaderProgram::enableAttributeArray(const char *name)
+{
+    GLint location = glGetAttribLocation(programID, name);
+    if(location >= 0)
+    {
+        glEnableVertexAttribArray(location);
+    }
+}
+
+void ShaderProgram::disableAttributeArray(const char *name)
+{
+    GLint location = glGetAttribLocation(programID, name);
+    if(location >= 0)
+    {
+        glDisableVertexAttribArray(location);
+    }
+}
+
+void ShaderProgram::setAttributeBuffer(const char *name, GLenum type, int offset, int tupleSize, int stride)
+{
+    GLint location = glGetAttribLocation(programID, name);
+    if(location >= 0)
+    {
+        glVertexAttribPointer(location, tupleSize, type, GL_FALSE, stride, (const GLvoid*)(size_t)offset);
+    }
+}
+
+#endif
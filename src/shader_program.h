@@ -0,0 +1,177 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "gl_functions.h"
+
+#ifdef RBOT_WITH_QT
+#include <QOpenGLShaderProgram>
+#endif
+
+/**
+ *  A minimal GLSL shader program class providing the functionality required for
+ *  rendering the models. With Qt it wraps a QOpenGLShaderProgram, otherwise the
+ *  program is compiled, linked and fed with plain OpenGL calls. All matrices are
+ *  expected in the row-major layout of OpenCV. Shaders are only compiled when the
+ *  program is linked, such that a previously cached program binary can be loaded
+ *  instead if available (with Qt using the shader disk cache of Qt).
+ */
+class ShaderProgram
+{
+public:
+    enum ShaderType {
+        VERTEX,
+        FRAGMENT
+    };
+    
+    ShaderProgram();
+    
+    ~ShaderProgram();
+    
+    /**
+     *  Adds a shader from a given GLSL source file to the program.
+     *
+     *  @param  type The type of the shader (e.g. VERTEX or FRAGMENT).
+     *  @param  fileName The path to the GLSL source file.
+     *  @return  True if the source file could be read and false otherwise.
+     */
+    bool addShaderFromSourceFile(ShaderType type, const std::string &fileName);
+    
+    /**
+     *  Adds a shader from given GLSL source code to the program.
+     *
+     *  @param  type The type of the shader (e.g. VERTEX or FRAGMENT).
+     *  @param  source The GLSL source code.
+     *  @return  True if the shader has been added successfully and false otherwise.
+     */
+    bool addShaderFromSourceCode(ShaderType type, const std::string &source);
+    
+    /**
+     *  Sets a folder in which the binaries of linked programs are cached. The binaries are
+     *  keyed by the OpenGL vendor, renderer and version together with a hash of all shader
+     *  sources, so that a program only has to be compiled once per driver. This has to be
+     *  called before link() and is ignored with Qt, where the shader disk cache of Qt is
+     *  used instead. An empty folder disables the cache (default).
+     *
+     *  @param  folder The folder for caching program binaries.
+     */
+    void setBinaryCacheFolder(const std::string &folder);
+    
+    /**
+     *  Returns the default folder for caching program binaries, which is taken from the
+     *  environment variable RBOT_SHADER_CACHE if set and otherwise is the subfolder rbot
+     *  of the user's cache directory (see getCacheFolder()). It is only used without Qt.
+     *
+     *  @return  The default binary cache folder or an empty string if none could be determined.
+     */
+    static std::string getDefaultBinaryCacheFolder();
+    
+    /**
+     *  Compiles all previously added shaders and links them into the program, unless the
+     *  program binary could be loaded from the cache.
+     *
+     *  @return  True if the program has been linked successfully and false otherwise.
+     */
+    bool link();
+    
+    /**
+     *  Makes the program the currently active one.
+     */
+    void bind();
+    
+    void setUniformValue(const char *name, float value);
+    
+    void setUniformValue(const char *name, const cv::Vec3f &value);
+    
+    void setUniformValue(const char *name, const cv::Matx33f &value);
+    
+    void setUniformValue(const char *name, const cv::Matx44f &value);
+    
+    /**
+     *  Enables the vertex attribute array of a given name. Attributes that are not
+     *  used by the program are ignored.
+     *
+     *  @param  name The name of the attribute.
+     */
+    void enableAttributeArray(const char *name);
+    
+    /**
+     *  Disables the vertex attribute array of a given name. Attributes that are not
+     *  used by the program are ignored.
+     *
+     *  @param  name The name of the attribute.
+     */
+    void disableAttributeArray(const char *name);
+    
+    /**
+     *  Sets the layout of a vertex attribute within the currently bound vertex buffer.
+     *  Attributes that are not used by the program are ignored.
+     *
+     *  @param  name The name of the attribute.
+     *  @param  type The data type of the attribute components (e.g. GL_FLOAT).
+     *  @param  offset The offset of the first attribute in bytes.
+     *  @param  tupleSize The number of components per attribute.
+     *  @param  stride The distance in bytes between consecutive attributes.
+     */
+    void setAttributeBuffer(const char *name, GLenum type, int offset, int tupleSize, int stride);
+    
+private:
+#ifdef RBOT_WITH_QT
+    QOpenGLShaderProgram *program;
+#else
+    GLuint programID;
+    
+    std::vector<std::pair<ShaderType, std::string> > sources;
+    
+    std::string binaryCacheFolder;
+    
+    bool compileShaders();
+    
+    std::string binaryCacheFile();
+    
+    bool loadBinary(const std::string &fileName);
+    
+    void saveBinary(const std::string &fileName);
+#endif
+};
+
+#endif /* SHADER_PROGRAM_H */
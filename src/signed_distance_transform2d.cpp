@@ -52,22 +52,13 @@ SignedDistanceTransform2D::~SignedDistanceTransform2D()
     
 }
 
-void SignedDistanceTransform2D::computeTransform(const Mat &src, Mat &sdt, Mat &xyPos, int threads, uchar key)
+float SignedDistanceTransform2D::getMaxDist() const
+{
+    return maxDist;
+}
+
+static void distanceTransformRows(const Mat &src, Mat &dd, Mat &xPos, int *v, int *z, int threads, uchar key)
 {
-    sdt.create(src.size(), CV_32FC1);
-    Mat dd(src.size(), CV_32SC1);
-    Mat xPos(src.size(), CV_32SC1);
-    xyPos.create(src.size(), CV_32SC2);
-    
-    sdt.setTo(0);
-    xyPos.setTo(-1);
-    
-    int n = (src.cols > src.rows) ? src.cols : src.rows;
-    
-    int* v = (int *)malloc(threads*n*sizeof(int));
-    int* z = (int *)malloc(threads*(n+1)*sizeof(int));
-    int* f = (int *)malloc(threads*n*sizeof(int));
-    
     int type = src.type();
     uchar depth = type & CV_MAT_DEPTH_MASK;
     
@@ -90,6 +81,43 @@ void SignedDistanceTransform2D::computeTransform(const Mat &src, Mat &sdt, Mat &
     {
         cout << "WRONG IMAGE TYPE FOR SIGNED DISTANCE TRANSFORMATION! NOTE: USE FLOAT OR UCHAR." << endl;
     }
+}
+
+
+static void createBand(const Size &size, SignedDistanceBand &band)
+{
+    band.sdt.create(size, CV_32FC1);
+    band.xyPos.create(size, CV_32SC2);
+    band.heaviside.create(size, CV_32FC1);
+    band.dirac.create(size, CV_32FC1);
+    band.dX.create(size, CV_32FC1);
+    band.dY.create(size, CV_32FC1);
+    
+    band.sdt.setTo(0);
+    band.xyPos.setTo(-1);
+    
+    band.dX.col(0).setTo(0);
+    band.dX.col(band.dX.cols-1).setTo(0);
+}
+
+
+void SignedDistanceTransform2D::computeTransform(const Mat &src, Mat &sdt, Mat &xyPos, int threads, uchar key)
+{
+    sdt.create(src.size(), CV_32FC1);
+    Mat dd(src.size(), CV_32SC1);
+    Mat xPos(src.size(), CV_32SC1);
+    xyPos.create(src.size(), CV_32SC2);
+    
+    sdt.setTo(0);
+    xyPos.setTo(-1);
+    
+    int n = (src.cols > src.rows) ? src.cols : src.rows;
+    
+    int* v = (int *)malloc(threads*n*sizeof(int));
+    int* z = (int *)malloc(threads*(n+1)*sizeof(int));
+    int* f = (int *)malloc(threads*n*sizeof(int));
+    
+    distanceTransformRows(src, dd, xPos, v, z, threads, key);
     
     parallel_for_(cv::Range(0, threads), Parallel_For_distanceTransformCols(dd, sdt, xPos, xyPos, maxDist, v, z, f, threads));
     
@@ -100,6 +128,81 @@ void SignedDistanceTransform2D::computeTransform(const Mat &src, Mat &sdt, Mat &
 }
 
 
+void SignedDistanceTransform2D::computeTransform(const Mat &src, SignedDistanceBand &band, int threads, uchar key)
+{
+    createBand(src.size(), band);
+    
+    Mat dd(src.size(), CV_32SC1);
+    Mat xPos(src.size(), CV_32SC1);
+    
+    int n = (src.cols > src.rows) ? src.cols : src.rows;
+    
+    int* v = (int *)malloc(threads*n*sizeof(int));
+    int* z = (int *)malloc(threads*(n+1)*sizeof(int));
+    int* f = (int *)malloc(threads*n*sizeof(int));
+    
+    distanceTransformRows(src, dd, xPos, v, z, threads, key);
+    
+    // the column pass also produces the heaviside, dirac and y-derivative planes
+    parallel_for_(cv::Range(0, threads), Parallel_For_distanceTransformCols(dd, band, xPos, maxDist, v, z, f, threads));
+    
+    // the x-derivatives require the neighbouring columns to be finished
+    parallel_for_(cv::Range(0, threads), Parallel_For_distanceTransformDX<float>(band.sdt, band.dX, threads));
+    
+    free(z);
+    free(v);
+    free(f);
+}
+
+
+void SignedDistanceTransform2D::computeTransforms(const Mat &src, const vector<uchar> &keys, const vector<Rect> &rois, vector<SignedDistanceBand> &bands, int threads)
+{
+    if(src.type() != CV_8UC1)
+    {
+        cout << "WRONG IMAGE TYPE FOR MULTI-LABEL SIGNED DISTANCE TRANSFORMATION! NOTE: USE UCHAR." << endl;
+        return;
+    }
+    
+    bands.resize(rois.size());
+    
+    vector<Mat> dds(rois.size());
+    vector<Mat> xPoss(rois.size());
+    
+    int n = 0;
+    
+    for(int l = 0; l < rois.size(); l++)
+    {
+        Size size = rois[l].size();
+        
+        createBand(size, bands[l]);
+        dds[l].create(size, CV_32SC1);
+        xPoss[l].create(size, CV_32SC1);
+        
+        n = max(n, max(size.width, size.height));
+    }
+    
+    if(n == 0)
+        return;
+    
+    int* v = (int *)malloc(threads*n*sizeof(int));
+    int* z = (int *)malloc(threads*(n+1)*sizeof(int));
+    int* f = (int *)malloc(threads*n*sizeof(int));
+    
+    parallel_for_(cv::Range(0, threads), Parallel_For_distanceTransformRowsMultiLabel(src, keys, rois, dds, xPoss, v, z, n, threads));
+    
+    parallel_for_(cv::Range(0, threads), Parallel_For_distanceTransformColsMultiLabel(dds, xPoss, bands, maxDist, v, z, f, n, threads));
+    
+    for(int l = 0; l < bands.size(); l++)
+    {
+        parallel_for_(cv::Range(0, threads), Parallel_For_distanceTransformDX<float>(bands[l].sdt, bands[l].dX, threads));
+    }
+    
+    free(z);
+    free(v);
+    free(f);
+}
+
+
 void SignedDistanceTransform2D::computeDerivatives(const cv::Mat &sdt, cv::Mat &dX, cv::Mat &dY, int threads)
 {
     dX.create(sdt.size(), CV_32FC1);
@@ -37,11 +37,63 @@
 #define SIGNED_DISTANCE_TRANSFORM2D_H
 
 #include <iostream>
+#include <vector>
 
 #include <emmintrin.h>
 
 #include <opencv2/core.hpp>
 
+/**
+ *  The slope of the smoothed Heaviside function used for the pixel-wise
+ *  posterior segmentation energy.
+ */
+const float HEAVISIDE_SLOPE = 1.2f;
+
+/**
+ *  Returns the smoothed Heaviside value for a given signed distance.
+ */
+inline float heavisideValue(float dist)
+{
+    float s = HEAVISIDE_SLOPE;
+    return 1.0f/float(CV_PI)*(-atan(dist*s)) + 0.5f;
+}
+
+/**
+ *  Returns the smoothed Dirac delta value for a given signed distance,
+ *  i.e. the negative derivative of the smoothed Heaviside function.
+ */
+inline float diracValue(float dist)
+{
+    float s = HEAVISIDE_SLOPE;
+    float s2 = s*s;
+    return (1.0f / float(CV_PI)) * (s/(dist*s2*dist + 1.0f));
+}
+
+
+/**
+ *  The narrow band representation of a silhouette produced in a single pass by
+ *  SignedDistanceTransform2D::computeTransform. All fields have the same size and
+ *  are stored as separate planes (structure of arrays), such that downstream
+ *  kernels can read precomputed values instead of deriving them from the
+ *  distances of neighbouring pixels.
+ */
+struct SignedDistanceBand
+{
+    // The 2D Euclidean signed distance transform (single channel, float).
+    cv::Mat sdt;
+    // The 2D coordinates of the closest contour points within the band (two channel, integer).
+    cv::Mat xyPos;
+    // The smoothed Heaviside values within the band, -1 outside (single channel, float).
+    cv::Mat heaviside;
+    // The smoothed Dirac delta values within the band, 0 outside (single channel, float).
+    cv::Mat dirac;
+    // The central differences of the distances in x-direction (single channel, float).
+    cv::Mat dX;
+    // The central differences of the distances in y-direction (single channel, float).
+    cv::Mat dY;
+};
+
+
 /**
  *  This class implements a signed 2D Euclidean distance transform
  *  of an arbitrary binary image (e.g. an object silhouette mask).
@@ -61,12 +113,20 @@ public:
      *  Initializes the an instance with a specified maximum distance at wich the
      *  clostest contour points for every pixel are still computed.
      *
-     *  @param  maxDist The maximal absolute distance at which the closest contour points are being comuted.
+     *  @param  maxDist The maximal absolute distance at which the closest contour points are being comuted (default = 8).
      */
-    SignedDistanceTransform2D(float maxDist);
+    SignedDistanceTransform2D(float maxDist = 8.0f);
     
     ~SignedDistanceTransform2D();
     
+    /**
+     *  Returns the maximal absolute distance at which the closest contour points
+     *  are computed, i.e. the half width of the narrow band.
+     *
+     *  @return  The maximal absolute distance of the transform.
+     */
+    float getMaxDist() const;
+    
     /**
      *  Computes the 2D Euclidean signed distance transform of a given input image as
      *  well as the coordinates of the clostest contour location for every pixel with
@@ -80,6 +140,36 @@ public:
      */
     void computeTransform(const cv::Mat &src, cv::Mat &sdt, cv::Mat &xyPos, int threads, uchar key = 0);
     
+    /**
+     *  Computes the 2D Euclidean signed distance transform of a given input image together
+     *  with its full narrow band representation in a single fused pass with CPU
+     *  multi-threading. The final column pass directly writes the smoothed Heaviside and
+     *  Dirac delta values as well as the derivatives in y-direction, while the derivatives
+     *  in x-direction are obtained by a subsequent light row pass.
+     *
+     *  @param  src The input image of which the distance transform shall be computed (single channel, float of uchar).
+     *  @param  band The output narrow band representation of src.
+     *  @param  threads The number of threads to be used for parallelization.
+     *  @param  key In case of a uchar input image that is not binary, the value specidfies the intensitiy to be considered foregorund (default = 0, i.e. anything not equal to 0 is considered foreground).
+     */
+    void computeTransform(const cv::Mat &src, SignedDistanceBand &band, int threads, uchar key = 0);
+    
+    /**
+     *  Computes the 2D Euclidean signed distance transforms of several labels within a
+     *  common uchar label image (e.g. the common silhouette mask of multiple objects) in a
+     *  single pass with CPU multi-threading. Each image row is visited once for all labels
+     *  and the columns of all labels are processed together. For every label the transform
+     *  is computed within its region of interest, i.e. the results are equivalent to calling
+     *  computeTransform on src(rois[i]) with keys[i] for each label individually.
+     *
+     *  @param  src The common input label image (single channel, uchar).
+     *  @param  keys The intensities of the labels to be considered foreground in each transform.
+     *  @param  rois The regions of interest per label in which the transforms shall be computed.
+     *  @param  bands The output narrow band representations per label (each of roi size, closest contour points relative to the roi).
+     *  @param  threads The number of threads to be used for parallelization.
+     */
+    void computeTransforms(const cv::Mat &src, const std::vector<uchar> &keys, const std::vector<cv::Rect> &rois, std::vector<SignedDistanceBand> &bands, int threads);
+    
     /**
      *  Computes the first order derivatives of a given 2D Euclidean signed distance
      *  level-set in x- and y- direction at each pixel using central differences with
@@ -98,6 +188,340 @@ private:
 };
 
 
+/**
+ *  Foreground predicate for the 1D row transform considering every pixel
+ *  with a non-zero intensity as foreground.
+ */
+struct NonZeroForeground
+{
+    template <class type>
+    bool operator()(type val) const
+    {
+        return !!val;
+    }
+};
+
+/**
+ *  Foreground predicate for the 1D row transform considering only pixels
+ *  with a given key intensity as foreground.
+ */
+struct KeyForeground
+{
+    uchar key;
+    
+    KeyForeground(uchar key) : key(key) {}
+    
+    bool operator()(uchar val) const
+    {
+        return val == key;
+    }
+};
+
+
+/**
+ *  Computes the per pixel 1D signed distance transform of a single image row. Here, also
+ *  the x locations of the closest contour points per pixel are calculated. The squared
+ *  distances are stored transposed (i.e. column by column) as required by the subsequent
+ *  transformation of the columns.
+ *
+ *  @param  src_row The first pixel of the row to be transformed.
+ *  @param  cols The number of pixels within the row.
+ *  @param  rows The total number of rows of the (sub-)image the row belongs to.
+ *  @param  y The index of the row within the (sub-)image.
+ *  @param  isForeground The predicate telling whether a pixel intensity belongs to the foreground.
+ *  @param  dd The transposed output squared signed distances of the (sub-)image.
+ *  @param  xPos The output x locations of the closest contour points of the (sub-)image.
+ *  @param  v Thread local temporary memory of at least cols elements.
+ *  @param  z Thread local temporary memory of at least cols+1 elements.
+ */
+template <class type, class Foreground>
+inline void distanceTransformRow(const type *src_row, int cols, int rows, int y, const Foreground &isForeground, int *dd, int *xPos, int *v, int *z)
+{
+    int j;
+    int k =-1;
+    for(j = 1; j < cols; j++)
+    {
+        if(isForeground(src_row[j-1]) != isForeground(src_row[j]))
+        {
+            int q;
+            int s;
+            q=(j<<1)-1;
+            s=k<0?0:((v[k]+q)>>2)+1;
+            v[++k]=q;
+            z[k]=s;
+        }
+    }
+    if(k<0)
+    {
+        for(j = 0; j < cols; j++)
+        {
+            dd[j * rows + y] = INT_MAX + isForeground(src_row[j]);
+            xPos[y * cols + j] = -1;
+        }
+    }
+    else
+    {
+        int zk;
+        z[k+1] = cols;
+        j = k = 0;
+        do{
+            int d1;
+            int d2;
+            d1=(j<<1)-v[k];
+            
+            int zeroPosX = (v[k]+1)/2;
+            bool bg = !isForeground(src_row[zeroPosX]);
+            if(bg)
+                zeroPosX -=1;
+            
+            d2=d1*d1;
+            d1=(d1+1)<<2;
+            zk=z[++k];
+            for(;;)
+            {
+                dd[j * rows + y] = !isForeground(src_row[j]) ? d2 : -d2;
+                xPos[y * cols + j] = zeroPosX;
+                
+                if(++j >= zk) break;
+                d2+=d1;
+                d1+=8;
+            }
+        }
+        while(zk < cols);
+    }
+}
+
+
+/**
+ *  Computes the per pixel 2D signed distance transform of a single image column based on
+ *  the previously transformed rows. Here, also the 2D locations of the closest contour points
+ *  per pixel are calculated.
+ *
+ *  @param  dd The transposed squared signed distances of the transformed rows.
+ *  @param  d The output 2D Euclidean signed distance transform.
+ *  @param  xPos The x locations of the closest contour points of the transformed rows.
+ *  @param  xyPos The output 2D locations of the closest contour points (two channel).
+ *  @param  rows The number of rows of the image.
+ *  @param  cols The number of columns of the image.
+ *  @param  x The index of the column to be transformed.
+ *  @param  maxDist The maximal absolute distance at which the closest contour points are being computed.
+ *  @param  v Thread local temporary memory of at least rows elements.
+ *  @param  z Thread local temporary memory of at least rows+1 elements.
+ *  @param  f Thread local temporary memory of at least rows elements.
+ *  @param  hs The optional output smoothed Heaviside values within the band of maxDist (-1 outside, NULL = skipped).
+ *  @param  dirac The optional output smoothed Dirac delta values within the band of maxDist (0 outside, NULL = skipped).
+ *  @param  dY The optional output central differences of the distances in y-direction (NULL = skipped).
+ *  @return False if the column does not contain a single foreground pixel and true otherwise.
+ */
+inline bool distanceTransformColumn(const int *dd, float *_d, const int *xPos, int *xyPos, int rows, int cols, int x, float maxDist, int *v, int *z, int *f, float *hs = NULL, float *dirac = NULL, float *dY = NULL)
+{
+    int psign;
+    int v2;
+    int q2;
+    int k=-1;
+    int i;
+    
+    psign=dd[x*rows+0]<0;
+    
+    for(i=0,q2=1;i<rows;i++)
+    {
+        int sign;
+        int d;
+        d=dd[x*rows+i];
+        sign=d<0;
+        if(sign!=psign)
+        {
+            int q;
+            int s;
+            q=(i<<1)-1;
+            if(k<0)
+            {
+                s=0;
+            }
+            else
+            {
+                for(;;)
+                {
+                    s=q2-v2-f[k];
+                    if(s>0)
+                    {
+                        s=s/((q-v[k])<<2)+1;
+                        if(s>z[k])
+                            break;
+                        }
+                        else
+                        {
+                            s=0;
+                        }
+                    if(--k<0)
+                        break;
+                    v2=v[k]*v[k];
+                }
+            }
+            v[++k]=q;
+            f[k]=0;
+            z[k]=s;
+            v2=q2;
+        }
+        if(sign==d-sign+!sign<0)
+        {
+            int fq;
+            int q;
+            int s;
+            int t;
+            fq=abs(d);
+            q=(i<<1)-1;
+            if(k<0)
+            {
+                s=0;
+                t=1;
+            }
+            else
+            {
+                for(;;)
+                {
+                    t=(q+1-v[k])*(q+1-v[k])+f[k]-fq;
+                    if(t>0)
+                    {
+                        s=q2-v2+fq-f[k];
+                        s=s<=0?0:s/((q-v[k])<<2)+1;
+                    }
+                    else
+                    {
+                        s=(q2+(i<<3)-v2+fq-f[k])/((q+2-v[k])<<2)+1;
+                    }
+                    if(s>z[k]||--k<0)
+                        break;
+                    v2=v[k]*v[k];
+                }
+            }
+            if(t>0)
+            {
+                if(s<i)
+                {
+                    v[++k]=q;
+                    f[k]=fq;
+                    z[k]=s;
+                }
+                v[++k]=q+1;
+                f[k]=fq;
+                z[k]=i;
+                s=i+1;
+            }
+            if(s<rows)
+            {
+                v[++k]=q+2;
+                f[k]=fq;
+                z[k]=s;
+                v2=q2+(i<<3);
+            }
+        }
+        psign=sign;
+        q2+=i<<3;
+    }
+    if(k<0) // NOT A SINGLE FOREGROUND PIXEL!!
+    {
+        for(i = 0; i < rows; i++)
+        {
+            _d[i*cols+x] = INT_MAX;
+            
+            if(hs) hs[i*cols+x] = -1.0f;
+            if(dirac) dirac[i*cols+x] = 0.0f;
+            if(dY) dY[i*cols+x] = 0.0f;
+        }
+        return false;
+    }
+    
+    int zk;
+    z[k+1]=rows;
+    i=k=0;
+    do{
+        int d2;
+        int d1;
+        d1=(i<<1)-v[k];
+        d2=d1*d1+f[k];
+        
+        int zeroPosY = (v[k]+1)/2;
+        bool isSameX = f[k] == 0;
+        
+        d1=(d1+1)<<2;
+        zk=z[++k];
+        for(;;)
+        {
+            if(i >= rows)
+                break;
+            float ds = sqrt(d2);
+            
+            bool bg = dd[x*rows+i] > 0;
+            ds = bg ? ds : -ds;
+            ds = (ds+1)/2;
+            
+            _d[i*cols+x] = ds;
+            
+            if(hs) hs[i*cols+x] = (fabs(ds) <= maxDist) ? heavisideValue(ds) : -1.0f;
+            if(dirac) dirac[i*cols+x] = (fabs(ds) <= maxDist) ? diracValue(ds) : 0.0f;
+            
+            if(fabs(ds) <= maxDist)
+            {
+                int py = (i < zeroPosY) ? zeroPosY-!bg : zeroPosY-bg;
+                
+                if(i == zeroPosY && bg && !isSameX)
+                    py += 1;
+                
+                int px = 0;
+                if(isSameX)
+                {
+                    px = x;
+                }
+                else
+                {
+                    px = xPos[py*cols + x];
+                    
+                    if(i >= zeroPosY && py > 0)
+                    {
+                        int px2 = xPos[(py-1)*cols + x];
+                        if(!(abs(x-px) <= abs(x-px2) || px2 == 0))
+                        {
+                            px = px2;
+                            py -= bg;
+                        }
+                    }
+                    if(i < zeroPosY && py < rows-1)
+                    {
+                        int px2 = xPos[(py+1)*cols + x];
+                        if(!(abs(x-px) <= abs(x-px2) || px2 == 0))
+                        {
+                            px = px2;
+                            py += bg;
+                        }
+                    }
+                }
+                
+                xyPos[2*(i*cols+x) + 0] = px;
+                xyPos[2*(i*cols+x) + 1] = py;
+            }
+            if(++i>=zk)break;
+            d2+=d1;
+            d1+=8;
+        }
+    }
+    while(zk<rows);
+    
+    // the column is complete, so its central differences can be taken right away
+    if(dY)
+    {
+        dY[x] = 0;
+        for(i = 1; i < rows-1; i++)
+        {
+            dY[i*cols+x] = (_d[(i+1)*cols+x] - _d[(i-1)*cols+x])/2.0f;
+        }
+        dY[(rows-1)*cols+x] = 0;
+    }
+    
+    return true;
+}
+
+
 /**
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
  *  computations. Within the corresponding for loop, for every row in a binary input image
@@ -152,58 +576,7 @@ public:
             int *v = _v + r.start * _src.cols;
             int *z = _z + r.start * (_src.cols + 1);
             
-            int j;
-            int k =-1;
-            for(j = 1; j < _src.cols; j++)
-            {
-                if(!!src_row[j-1] != !!src_row[j])
-                {
-                    int q;
-                    int s;
-                    q=(j<<1)-1;
-                    s=k<0?0:((v[k]+q)>>2)+1;
-                    v[++k]=q;
-                    z[k]=s;
-                }
-            }
-            if(k<0)
-            {
-                for(j = 0; j < _src.cols; j++)
-                {
-                    dd[j * _src.rows + y] = INT_MAX + !!src_row[j];
-                    xPos[y * _src.cols + j] = -1;
-                }
-            }
-            else
-            {
-                int zk;
-                z[k+1] = _src.cols;
-                j = k = 0;
-                do{
-                    int d1;
-                    int d2;
-                    d1=(j<<1)-v[k];
-                    
-                    int zeroPosX = (v[k]+1)/2;
-                    bool bg = !src_row[zeroPosX];
-                    if(bg)
-                        zeroPosX -=1;
-                    
-                    d2=d1*d1;
-                    d1=(d1+1)<<2;
-                    zk=z[++k];
-                    for(;;)
-                    {
-                        dd[j * _src.rows + y] = !src_row[j] ? d2 : -d2;
-                        xPos[y * _src.cols + j] = zeroPosX;
-                        
-                        if(++j >= zk) break;
-                        d2+=d1;
-                        d1+=8;
-                    }
-                }
-                while(zk < _src.cols);
-            }
+            distanceTransformRow(src_row, _src.cols, _src.rows, y, NonZeroForeground(), dd, xPos, v, z);
         }
     }
 };
@@ -267,58 +640,7 @@ public:
             int *v = _v + r.start * _src.cols;
             int *z = _z + r.start * (_src.cols + 1);
             
-            int j;
-            int k =-1;
-            for(j = 1; j < _src.cols; j++)
-            {
-                if((src_row[j-1] == _key) != (src_row[j] == _key))
-                {
-                    int q;
-                    int s;
-                    q=(j<<1)-1;
-                    s=k<0?0:((v[k]+q)>>2)+1;
-                    v[++k]=q;
-                    z[k]=s;
-                }
-            }
-            if(k<0)
-            {
-                for(j = 0; j < _src.cols; j++)
-                {
-                    dd[j * _src.rows + y] = INT_MAX + (src_row[j] == _key);
-                    xPos[y * _src.cols + j] = -1;
-                }
-            }
-            else
-            {
-                int zk;
-                z[k+1] = _src.cols;
-                j = k = 0;
-                do{
-                    int d1;
-                    int d2;
-                    d1=(j<<1)-v[k];
-                    
-                    int zeroPosX = (v[k]+1)/2;
-                    bool bg = (src_row[zeroPosX] != _key);
-                    if(bg)
-                        zeroPosX -=1;
-                    
-                    d2=d1*d1;
-                    d1=(d1+1)<<2;
-                    zk=z[++k];
-                    for(;;)
-                    {
-                        dd[j * _src.rows + y] = (src_row[j] != _key) ? d2 : -d2;
-                        xPos[y * _src.cols + j] = zeroPosX;
-                        
-                        if(++j >= zk) break;
-                        d2+=d1;
-                        d1+=8;
-                    }
-                }
-                while(zk < _src.cols);
-            }
+            distanceTransformRow(src_row, _src.cols, _src.rows, y, KeyForeground(_key), dd, xPos, v, z);
         }
     }
 };
@@ -339,6 +661,10 @@ private:
     cv::Mat _xPos;
     cv::Mat _xyPos;
     
+    cv::Mat _heaviside;
+    cv::Mat _dirac;
+    cv::Mat _dY;
+    
     int *_v;
     int *_z;
     int *_f;
@@ -365,6 +691,27 @@ public:
         _f = f;
     }
     
+    Parallel_For_distanceTransformCols(const cv::Mat &src, SignedDistanceBand &band, const cv::Mat &xPos, float maxDist, int *v, int *z, int *f, int threads)
+    {
+        _src = src;
+        _dst = band.sdt;
+        
+        _xPos = xPos;
+        _xyPos = band.xyPos;
+        
+        _heaviside = band.heaviside;
+        _dirac = band.dirac;
+        _dY = band.dY;
+        
+        _maxDist = maxDist;
+        
+        _threads = threads;
+        
+        _v = v;
+        _z = z;
+        _f = f;
+    }
+    
     virtual void operator()( const cv::Range &r ) const
     {
         int *dd = (int*)_src.ptr<int>();
@@ -373,6 +720,12 @@ public:
         int *xPos = (int*)_xPos.ptr<int>();
         int *xyPos = (int*)_xyPos.ptr<int>();
         
+        bool band = !_heaviside.empty();
+        
+        float *hs = band ? (float*)_heaviside.ptr<float>() : NULL;
+        float *dirac = band ? (float*)_dirac.ptr<float>() : NULL;
+        float *dY = band ? (float*)_dY.ptr<float>() : NULL;
+        
         int range = _src.cols/_threads;
         
         int xEnd = r.end*range;
@@ -387,192 +740,193 @@ public:
             int *z = _z + r.start * (_src.rows + 1);
             int *f = _f + r.start * _src.rows;
             
-            int psign;
-            int v2;
-            int q2;
-            int k=-1;
-            int i;
-            
-            psign=dd[x*_src.rows+0]<0;
-            
-            for(i=0,q2=1;i<_src.rows;i++)
+            // in band mode every column is written, such that the band is
+            // completely defined even for images without any contour
+            if(!distanceTransformColumn(dd, _d, xPos, xyPos, _src.rows, _src.cols, x, _maxDist, v, z, f, hs, dirac, dY) && !band)
             {
-                int sign;
-                int d;
-                d=dd[x*_src.rows+i];
-                sign=d<0;
-                if(sign!=psign)
-                {
-                    int q;
-                    int s;
-                    q=(i<<1)-1;
-                    if(k<0)
-                    {
-                        s=0;
-                    }
-                    else
-                    {
-                        for(;;)
-                        {
-                            s=q2-v2-f[k];
-                            if(s>0)
-                            {
-                                s=s/((q-v[k])<<2)+1;
-                                if(s>z[k])
-                                    break;
-                                }
-                                else
-                                {
-                                    s=0;
-                                }
-                            if(--k<0)
-                                break;
-                            v2=v[k]*v[k];
-                        }
-                    }
-                    v[++k]=q;
-                    f[k]=0;
-                    z[k]=s;
-                    v2=q2;
-                }
-                if(sign==d-sign+!sign<0)
-                {
-                    int fq;
-                    int q;
-                    int s;
-                    int t;
-                    fq=abs(d);
-                    q=(i<<1)-1;
-                    if(k<0)
-                    {
-                        s=0;
-                        t=1;
-                    }
-                    else
-                    {
-                        for(;;)
-                        {
-                            t=(q+1-v[k])*(q+1-v[k])+f[k]-fq;
-                            if(t>0)
-                            {
-                                s=q2-v2+fq-f[k];
-                                s=s<=0?0:s/((q-v[k])<<2)+1;
-                            }
-                            else
-                            {
-                                s=(q2+(i<<3)-v2+fq-f[k])/((q+2-v[k])<<2)+1;
-                            }
-                            if(s>z[k]||--k<0)
-                                break;
-                            v2=v[k]*v[k];
-                        }
-                    }
-                    if(t>0)
-                    {
-                        if(s<i)
-                        {
-                            v[++k]=q;
-                            f[k]=fq;
-                            z[k]=s;
-                        }
-                        v[++k]=q+1;
-                        f[k]=fq;
-                        z[k]=i;
-                        s=i+1;
-                    }
-                    if(s<_src.rows)
-                    {
-                        v[++k]=q+2;
-                        f[k]=fq;
-                        z[k]=s;
-                        v2=q2+(i<<3);
-                    }
-                }
-                psign=sign;
-                q2+=i<<3;
+                break;
             }
-            if(k<0) // NOT A SINGLE FOREGROUND PIXEL!!
+        }
+    }
+};
+
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, every row of a common label image
+ *  is transformed once for all labels whose regions of interest contain that row. For
+ *  each label the per pixel 1D signed distance transform within its region is computed
+ *  with the label as foreground key. Here, also the x locations of the closest contour
+ *  points per pixel are calculated.
+ */
+class Parallel_For_distanceTransformRowsMultiLabel: public cv::ParallelLoopBody
+{
+private:
+    cv::Mat _src;
+    
+    std::vector<uchar> _keys;
+    std::vector<cv::Rect> _rois;
+    
+    std::vector<cv::Mat> _dds;
+    std::vector<cv::Mat> _xPoss;
+    
+    int *_v;
+    int *_z;
+    
+    int _n;
+    
+    int _yStart;
+    int _yEnd;
+    
+    int _threads;
+    
+public:
+    Parallel_For_distanceTransformRowsMultiLabel(const cv::Mat &src, const std::vector<uchar> &keys, const std::vector<cv::Rect> &rois, std::vector<cv::Mat> &dds, std::vector<cv::Mat> &xPoss, int *v, int *z, int n, int threads)
+    {
+        _src = src;
+        
+        _keys = keys;
+        _rois = rois;
+        
+        _dds = dds;
+        _xPoss = xPoss;
+        
+        _v = v;
+        _z = z;
+        
+        _n = n;
+        
+        // only the rows covered by at least one roi need to be visited
+        _yStart = src.rows;
+        _yEnd = 0;
+        for(int l = 0; l < rois.size(); l++)
+        {
+            if(rois[l].y < _yStart) _yStart = rois[l].y;
+            if(rois[l].y + rois[l].height > _yEnd) _yEnd = rois[l].y + rois[l].height;
+        }
+        
+        _threads = threads;
+    }
+    
+    virtual void operator()( const cv::Range &r ) const
+    {
+        uchar *src_pixels = (uchar *)_src.ptr<uchar>();
+        
+        int *v = _v + r.start * _n;
+        int *z = _z + r.start * (_n + 1);
+        
+        int range = (_yEnd - _yStart)/_threads;
+        
+        int yEnd = _yStart + r.end*range;
+        if(r.end == _threads)
+        {
+            yEnd = _yEnd;
+        }
+        
+        for(int y = _yStart + r.start*range; y < yEnd; y++)
+        {
+            uchar *src_row = src_pixels + y * _src.cols;
+            
+            for(int l = 0; l < _rois.size(); l++)
             {
-                for(i = 0; i < _src.rows; i++)
-                {
-                    _d[i*_src.cols+x] = INT_MAX;
-                }
-                break;
+                cv::Rect roi = _rois[l];
+                
+                if(y < roi.y || y >= roi.y + roi.height)
+                    continue;
+                
+                int *dd = (int *)_dds[l].ptr<int>();
+                int *xPos = (int *)_xPoss[l].ptr<int>();
+                
+                distanceTransformRow(src_row + roi.x, roi.width, roi.height, y - roi.y, KeyForeground(_keys[l]), dd, xPos, v, z);
             }
-            else
+        }
+    }
+};
+
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, the per pixel 2D signed distance
+ *  transform is computed for the columns of all labels at once, based on their previously
+ *  transformed rows. Here, the columns of all regions of interest are concatenated and
+ *  evenly distributed among the threads. Also the 2D locations of the closest contour
+ *  points, the smoothed Heaviside and Dirac delta values as well as the derivatives in
+ *  y-direction are calculated per pixel.
+ */
+class Parallel_For_distanceTransformColsMultiLabel: public cv::ParallelLoopBody
+{
+private:
+    std::vector<cv::Mat> _dds;
+    std::vector<cv::Mat> _xPoss;
+    
+    std::vector<SignedDistanceBand> _bands;
+    
+    std::vector<int> _colOffsets;
+    
+    int *_v;
+    int *_z;
+    int *_f;
+    
+    int _n;
+    
+    float _maxDist;
+    
+    int _threads;
+    
+public:
+    Parallel_For_distanceTransformColsMultiLabel(const std::vector<cv::Mat> &dds, const std::vector<cv::Mat> &xPoss, std::vector<SignedDistanceBand> &bands, float maxDist, int *v, int *z, int *f, int n, int threads)
+    {
+        _dds = dds;
+        _xPoss = xPoss;
+        
+        _bands = bands;
+        
+        _maxDist = maxDist;
+        
+        _v = v;
+        _z = z;
+        _f = f;
+        
+        _n = n;
+        
+        // the index of the first column of each label within the concatenation of all columns
+        _colOffsets.push_back(0);
+        for(int l = 0; l < bands.size(); l++)
+        {
+            _colOffsets.push_back(_colOffsets[l] + bands[l].sdt.cols);
+        }
+        
+        _threads = threads;
+    }
+    
+    virtual void operator()( const cv::Range &r ) const
+    {
+        int *v = _v + r.start * _n;
+        int *z = _z + r.start * (_n + 1);
+        int *f = _f + r.start * _n;
+        
+        int totalCols = _colOffsets.back();
+        
+        int range = totalCols/_threads;
+        
+        int cEnd = r.end*range;
+        if(r.end == _threads)
+        {
+            cEnd = totalCols;
+        }
+        
+        int l = 0;
+        for(int c = r.start*range; c < cEnd; c++)
+        {
+            while(c >= _colOffsets[l+1])
             {
-                int zk;
-                z[k+1]=_src.rows;
-                i=k=0;
-                do{
-                    int d2;
-                    int d1;
-                    d1=(i<<1)-v[k];
-                    d2=d1*d1+f[k];
-                    
-                    int zeroPosY = (v[k]+1)/2;
-                    bool isSameX = f[k] == 0;
-                    
-                    d1=(d1+1)<<2;
-                    zk=z[++k];
-                    for(;;)
-                    {
-                        if(i >= _src.rows)
-                            break;
-                        float ds = sqrt(d2);
-                        
-                        bool bg = dd[x*_src.rows+i] > 0;
-                        ds = bg ? ds : -ds;
-                        ds = (ds+1)/2;
-                        
-                        _d[i*_src.cols+x] = ds;
-                        
-                        if(fabs(ds) <= _maxDist)
-                        {
-                            int py = (i < zeroPosY) ? zeroPosY-!bg : zeroPosY-bg;
-                            
-                            if(i == zeroPosY && bg && !isSameX)
-                                py += 1;
-                            
-                            int px = 0;
-                            if(isSameX)
-                            {
-                                px = x;
-                            }
-                            else
-                            {
-                                px = xPos[py*_xPos.cols + x];
-                                
-                                if(i >= zeroPosY && py > 0)
-                                {
-                                    int px2 = xPos[(py-1)*_xPos.cols + x];
-                                    if(!(abs(x-px) <= abs(x-px2) || px2 == 0))
-                                    {
-                                        px = px2;
-                                        py -= bg;
-                                    }
-                                }
-                                if(i < zeroPosY && py < _xPos.rows-1)
-                                {
-                                    int px2 = xPos[(py+1)*_xPos.cols + x];
-                                    if(!(abs(x-px) <= abs(x-px2) || px2 == 0))
-                                    {
-                                        px = px2;
-                                        py += bg;
-                                    }
-                                }
-                            }
-                            
-                            xyPos[2*(i*_xyPos.cols+x) + 0] = px;
-                            xyPos[2*(i*_xyPos.cols+x) + 1] = py;
-                        }
-                        if(++i>=zk)break;
-                        d2+=d1;
-                        d1+=8;
-                    }
-                }
-                while(zk<_src.rows);
+                l++;
             }
+            
+            const SignedDistanceBand &band = _bands[l];
+            
+            distanceTransformColumn(_dds[l].ptr<int>(), (float*)band.sdt.ptr<float>(), _xPoss[l].ptr<int>(), (int*)band.xyPos.ptr<int>(), band.sdt.rows, band.sdt.cols, c - _colOffsets[l], _maxDist, v, z, f,
+                                    (float*)band.heaviside.ptr<float>(), (float*)band.dirac.ptr<float>(), (float*)band.dY.ptr<float>());
         }
     }
 };
@@ -39,8 +39,12 @@ uniform vec3 uColor;
 uniform float uAlpha;
 
 layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragIDDepth;
 
 void main()
 {
 	fragColor = vec4(uColor, uAlpha);
+	
+	// the mask value as in the red channel of the color attachment and the linear camera space depth
+	fragIDDepth = vec2(round(uColor.r*255.0), 1.0/gl_FragCoord.w);
 }
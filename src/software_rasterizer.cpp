@@ -0,0 +1,79 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "software_rasterizer.h"
+
+using namespace std;
+using namespace cv;
+
+
+SoftwareRasterizer::SoftwareRasterizer(int threads)
+{
+    this->threads = threads;
+}
+
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+    
+}
+
+
+void SoftwareRasterizer::renderSilhouette(const vector<Model*> &models, const vector<Matx44f> &mvpMatrices, const vector<uchar> &maskValues, const Size &viewport, bool invertDepth, Mat &mask, Mat &depth, const Rect &roi)
+{
+    Rect _roi = roi.area() > 0 ? roi & Rect(Point(0, 0), viewport) : Rect(Point(0, 0), viewport);
+    
+    mask.create(_roi.size(), CV_8UC1);
+    depth.create(_roi.size(), CV_32FC1);
+    
+    // clear the buffers wrt the depth test
+    mask.setTo(0);
+    depth.setTo(invertDepth ? 1.0f : 0.0f);
+    
+    if(_roi.area() == 0)
+        return;
+    
+    for(int i = 0; i < models.size(); i++)
+    {
+        const vector<Vec3f> &vertices = models[i]->getSilhouetteVertices();
+        const vector<GLuint> &indices = models[i]->getSilhouetteIndices();
+        
+        windowCoords.resize(vertices.size());
+        
+        parallel_for_(cv::Range(0, threads), Parallel_For_projectVertices(vertices, windowCoords, mvpMatrices[i], viewport, threads));
+        
+        parallel_for_(cv::Range(0, threads), Parallel_For_rasterizeTriangles(windowCoords, indices, maskValues[i], invertDepth, mask, depth, _roi, threads));
+    }
+}
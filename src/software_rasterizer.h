@@ -0,0 +1,294 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "model.h"
+
+/**
+ *  This class implements a multi-threaded CPU rasterizer for flat silhouette
+ *  and depth renderings of 3D models. It exactly follows the conventions of the
+ *  OpenGL rendering engine, i.e. the same projection matrices and viewports are
+ *  used, pixels are sampled at their centers and the depth buffer is inverted
+ *  (a depth of 1 corresponds to the near plane and 0 to the far plane or the
+ *  background), such that the results can directly be used in place of downloaded
+ *  OpenGL frames. No rendering context is required. Triangles with vertices
+ *  behind the camera are skipped instead of being clipped.
+ */
+class SoftwareRasterizer
+{
+public:
+    /**
+     *  Initializes the rasterizer with a number of threads to be used
+     *  for parallelization.
+     *
+     *  @param  threads The number of threads to be used for parallelization (default = 8).
+     */
+    SoftwareRasterizer(int threads = 8);
+    
+    ~SoftwareRasterizer();
+    
+    /**
+     *  Renders multiple models in a common scene with a constant intensity each into a
+     *  silhouette mask and a depth buffer limited to a given region of interest of the
+     *  viewport. Models are drawn in the given order with a depth test, such that the
+     *  closest surface wins (or the farthest in case of an inverted depth test).
+     *
+     *  @param  models The models to be rendered.
+     *  @param  mvpMatrices The model view projection matrices per model (including their normalization).
+     *  @param  maskValues The intensities written into the mask per model.
+     *  @param  viewport The size of the viewport in pixels.
+     *  @param  invertDepth Whether to invert the depth test, i.e. to keep the farthest surface.
+     *  @param  mask The output silhouette mask of the size of roi (single channel, uchar).
+     *  @param  depth The output inverted depth buffer of the size of roi (single channel, float).
+     *  @param  roi The region of interest within the viewport to be rendered (default = empty, i.e. the whole viewport).
+     */
+    void renderSilhouette(const std::vector<Model*> &models, const std::vector<cv::Matx44f> &mvpMatrices, const std::vector<uchar> &maskValues, const cv::Size &viewport, bool invertDepth, cv::Mat &mask, cv::Mat &depth, const cv::Rect &roi = cv::Rect());
+    
+private:
+    int threads;
+    
+    std::vector<cv::Vec4f> windowCoords;
+};
+
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, all vertices of a model are
+ *  projected into window coordinates (x, y, depth) of the given viewport, where
+ *  the fourth component tells whether the vertex is located in front of the camera.
+ */
+class Parallel_For_projectVertices: public cv::ParallelLoopBody
+{
+private:
+    const cv::Vec3f *_vertices;
+    cv::Vec4f *_windowCoords;
+    
+    int _numVertices;
+    
+    cv::Matx44f _mvp;
+    
+    float _width;
+    float _height;
+    
+    int _threads;
+    
+public:
+    Parallel_For_projectVertices(const std::vector<cv::Vec3f> &vertices, std::vector<cv::Vec4f> &windowCoords, const cv::Matx44f &mvp, const cv::Size &viewport, int threads)
+    {
+        _vertices = vertices.data();
+        _windowCoords = windowCoords.data();
+        
+        _numVertices = (int)vertices.size();
+        
+        _mvp = mvp;
+        
+        _width = viewport.width;
+        _height = viewport.height;
+        
+        _threads = threads;
+    }
+    
+    virtual void operator()( const cv::Range &r ) const
+    {
+        int range = _numVertices/_threads;
+        
+        int vEnd = r.end*range;
+        if(r.end == _threads)
+        {
+            vEnd = _numVertices;
+        }
+        
+        const float *m = _mvp.val;
+        
+        for(int v = r.start*range; v < vEnd; v++)
+        {
+            cv::Vec3f p = _vertices[v];
+            
+            float cx = m[0]*p[0] + m[1]*p[1] + m[2]*p[2] + m[3];
+            float cy = m[4]*p[0] + m[5]*p[1] + m[6]*p[2] + m[7];
+            float cz = m[8]*p[0] + m[9]*p[1] + m[10]*p[2] + m[11];
+            float cw = m[12]*p[0] + m[13]*p[1] + m[14]*p[2] + m[15];
+            
+            if(cw <= 0)
+            {
+                _windowCoords[v] = cv::Vec4f(0, 0, 0, 0);
+                continue;
+            }
+            
+            // viewport transformation with the inverted depth range [1, 0]
+            float x = (cx/cw + 1.0f)*0.5f*_width;
+            float y = (cy/cw + 1.0f)*0.5f*_height;
+            float z = (1.0f - cz/cw)*0.5f;
+            
+            _windowCoords[v] = cv::Vec4f(x, y, z, 1);
+        }
+    }
+};
+
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, every thread rasterizes all
+ *  triangles of a model within its own horizontal band of the region of interest,
+ *  such that no synchronization is required. For each covered pixel center the
+ *  depth is linearly interpolated in window space and the depth test is performed
+ *  before writing the mask intensity and depth value.
+ */
+class Parallel_For_rasterizeTriangles: public cv::ParallelLoopBody
+{
+private:
+    const cv::Vec4f *_windowCoords;
+    const GLuint *_indices;
+    
+    int _numTriangles;
+    
+    uchar _maskValue;
+    
+    bool _invertDepth;
+    
+    cv::Mat _mask;
+    cv::Mat _depth;
+    
+    cv::Rect _roi;
+    
+    int _threads;
+    
+public:
+    Parallel_For_rasterizeTriangles(const std::vector<cv::Vec4f> &windowCoords, const std::vector<GLuint> &indices, uchar maskValue, bool invertDepth, cv::Mat &mask, cv::Mat &depth, const cv::Rect &roi, int threads)
+    {
+        _windowCoords = windowCoords.data();
+        _indices = indices.data();
+        
+        _numTriangles = (int)indices.size()/3;
+        
+        _maskValue = maskValue;
+        
+        _invertDepth = invertDepth;
+        
+        _mask = mask;
+        _depth = depth;
+        
+        _roi = roi;
+        
+        _threads = threads;
+    }
+    
+    virtual void operator()( const cv::Range &r ) const
+    {
+        int range = _roi.height/_threads;
+        
+        int yStart = _roi.y + r.start*range;
+        int yEnd = _roi.y + r.end*range;
+        if(r.end == _threads)
+        {
+            yEnd = _roi.y + _roi.height;
+        }
+        
+        int xStart = _roi.x;
+        int xEnd = _roi.x + _roi.width;
+        
+        for(int t = 0; t < _numTriangles; t++)
+        {
+            const cv::Vec4f &p0 = _windowCoords[_indices[3*t]];
+            const cv::Vec4f &p1 = _windowCoords[_indices[3*t+1]];
+            const cv::Vec4f &p2 = _windowCoords[_indices[3*t+2]];
+            
+            // triangle not completely in front of the camera
+            if(p0[3] == 0 || p1[3] == 0 || p2[3] == 0)
+                continue;
+            
+            float area = (p1[0] - p0[0])*(p2[1] - p0[1]) - (p1[1] - p0[1])*(p2[0] - p0[0]);
+            if(area == 0)
+                continue;
+            
+            // the pixel rows and columns whose centers might be covered
+            int minX = std::max(xStart, (int)ceil(std::min(p0[0], std::min(p1[0], p2[0])) - 0.5f));
+            int maxX = std::min(xEnd - 1, (int)floor(std::max(p0[0], std::max(p1[0], p2[0])) - 0.5f));
+            int minY = std::max(yStart, (int)ceil(std::min(p0[1], std::min(p1[1], p2[1])) - 0.5f));
+            int maxY = std::min(yEnd - 1, (int)floor(std::max(p0[1], std::max(p1[1], p2[1])) - 0.5f));
+            
+            if(minX > maxX || minY > maxY)
+                continue;
+            
+            float invArea = 1.0f/area;
+            
+            // edge function coefficients e(x, y) = a*x + b*y + c, oriented such
+            // that they are positive inside the triangle
+            float a0 = (p1[1] - p2[1])*invArea, b0 = (p2[0] - p1[0])*invArea, c0 = (p1[0]*p2[1] - p1[1]*p2[0])*invArea;
+            float a1 = (p2[1] - p0[1])*invArea, b1 = (p0[0] - p2[0])*invArea, c1 = (p2[0]*p0[1] - p2[1]*p0[0])*invArea;
+            float a2 = (p0[1] - p1[1])*invArea, b2 = (p1[0] - p0[0])*invArea, c2 = (p0[0]*p1[1] - p0[1]*p1[0])*invArea;
+            
+            for(int y = minY; y <= maxY; y++)
+            {
+                float py = y + 0.5f;
+                
+                uchar *maskRow = (uchar*)_mask.ptr<uchar>(y - _roi.y) - _roi.x;
+                float *depthRow = (float*)_depth.ptr<float>(y - _roi.y) - _roi.x;
+                
+                for(int x = minX; x <= maxX; x++)
+                {
+                    float px = x + 0.5f;
+                    
+                    float w0 = a0*px + b0*py + c0;
+                    float w1 = a1*px + b1*py + c1;
+                    float w2 = a2*px + b2*py + c2;
+                    
+                    if(w0 < 0 || w1 < 0 || w2 < 0)
+                        continue;
+                    
+                    float z = w0*p0[2] + w1*p1[2] + w2*p2[2];
+                    
+                    // clipping against the near and far plane
+                    if(z < 0 || z > 1)
+                        continue;
+                    
+                    if(_invertDepth ? z < depthRow[x] : z > depthRow[x])
+                    {
+                        depthRow[x] = z;
+                        maskRow[x] = _maskValue;
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif /* SOFTWARE_RASTERIZER_H */
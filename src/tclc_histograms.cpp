@@ -49,7 +49,7 @@ TCLCHistograms::TCLCHistograms(Model *model, int numBins, int radius, float offs
     
     this->_offset = offset;
     
-    this->_numHistograms = _model->getNumVertices();
+    this->_numHistograms = _model->getNumSamplePoints();
     
     normalizedFG = Mat::zeros(this->_numHistograms, numBins*numBins*numBins, CV_32FC1);
     normalizedBG = Mat::zeros(this->_numHistograms, numBins*numBins*numBins, CV_32FC1);
@@ -58,6 +58,9 @@ TCLCHistograms::TCLCHistograms(Model *model, int numBins, int radius, float offs
     notNormalizedBG = Mat::zeros(this->_numHistograms, numBins*numBins*numBins, CV_32SC1);
     
     initialized = Mat::zeros(1, this->_numHistograms, CV_8UC1);
+    
+    posteriorSums = Mat::zeros(2, numBins*numBins*numBins, CV_64FC1);
+    posteriorLUT = Mat::zeros(1, numBins*numBins*numBins, CV_8UC1);
 }
 
 TCLCHistograms::~TCLCHistograms()
@@ -65,32 +68,65 @@ TCLCHistograms::~TCLCHistograms()
     
 }
 
-void TCLCHistograms::update(const Mat &frame, const Mat &mask, const Mat &depth, Matx33f &K, float zNear, float zFar)
+void TCLCHistograms::update(const Mat &frame, const Mat &mask, const Mat &depth, Matx33f &K)
 {
-    _centersIDs = parallelComputeLocalHistogramCenters(mask, depth, K, zNear, zFar, 0);
+    _centersIDs = parallelComputeLocalHistogramCenters(mask, depth, K, _model->getPose(), 0);
     
-    filterHistogramCenters(100, 10.0f);
+    _offset = filterHistogramCenters(_centersIDs, 100, 10.0f);
     
     int threads = (int)_centersIDs.size();
     
     memset(notNormalizedFG.ptr<int>(), 0, _centersIDs.size()*numBins*numBins*numBins*sizeof(int));
     memset(notNormalizedBG.ptr<int>(), 0, _centersIDs.size()*numBins*numBins*numBins*sizeof(int));
     
-    memset(normalizedFG.ptr<float>(), 0, _centersIDs.size()*numBins*numBins*numBins*sizeof(float));
-    memset(normalizedBG.ptr<float>(), 0, _centersIDs.size()*numBins*numBins*numBins*sizeof(float));
-    
     Mat sumsFB = Mat::zeros((int)_centersIDs.size(), 1, CV_32SC2);
     
     parallel_for_(cv::Range(0, threads), Parallel_For_buildLocalHistograms(frame, mask, _centersIDs, radius, numBins, notNormalizedFG, notNormalizedBG, sumsFB, _model->getModelID(), threads));
     
-    parallel_for_(cv::Range(0, threads), Parallel_For_mergeLocalHistograms(notNormalizedFG, notNormalizedBG, normalizedFG, normalizedBG, initialized, _centersIDs, sumsFB, 0.1f, 0.2f, threads));
+    // the normalized histograms below the number of centers are reset during the merge, so
+    // that these and the merged ones are the histograms of which the posteriors change
+    int numCleared = (int)_centersIDs.size();
+    
+    vector<int> changedIDs(numCleared);
+    for(int h = 0; h < numCleared; h++)
+    {
+        changedIDs[h] = h;
+    }
+    for(int h = 0; h < _centersIDs.size(); h++)
+    {
+        if(_centersIDs[h].z >= numCleared)
+            changedIDs.push_back(_centersIDs[h].z);
+    }
+    
+    parallel_for_(cv::Range(0, 8), Parallel_For_mergeLocalHistograms(notNormalizedFG, notNormalizedBG, normalizedFG, normalizedBG, initialized, _centersIDs, sumsFB, 0.1f, 0.2f, numCleared, changedIDs, posteriorSums, posteriorLUT, 8));
+    
+    for(int h = 0; h < _centersIDs.size(); h++)
+    {
+        initialized.data[_centersIDs[h].z] = 1;
+    }
+}
+
+void TCLCHistograms::updateCentersAndIds(const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K, int level)
+{
+    _centersIDs = parallelComputeLocalHistogramCenters(mask, depth, K, _model->getPose(), level);
+    
+    _offset = filterHistogramCenters(_centersIDs, 100, 10.0f);
 }
 
-void TCLCHistograms::updateCentersAndIds(const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K, float zNear, float zFar, int level)
+vector<Point3i> TCLCHistograms::computeCentersAndIds(const Mat &mask, const Mat &depth, const Matx33f &K, const Matx44f &T_cm, int level)
 {
-    _centersIDs = parallelComputeLocalHistogramCenters(mask, depth, K, zNear, zFar, level);
+    vector<Point3i> centersIDs = parallelComputeLocalHistogramCenters(mask, depth, K, T_cm, level);
+    
+    filterHistogramCenters(centersIDs, 100, 10.0f);
     
-    filterHistogramCenters(100, 10.0f);
+    return centersIDs;
+}
+
+void TCLCHistograms::updateCentersAndIds(const cv::Matx33f &K, const cv::Size &imageSize)
+{
+    _centersIDs = computeContourHistogramCenters(K, imageSize);
+    
+    _offset = filterHistogramCenters(_centersIDs, 100, 10.0f);
 }
 
 
@@ -124,12 +160,11 @@ vector<Point3i> TCLCHistograms::computeLocalHistogramCenters(const Mat &mask)
 }
 
 
-vector<Point3i> TCLCHistograms::parallelComputeLocalHistogramCenters(const Mat &mask, const Mat &depth, const Matx33f &K, float zNear, float zFar, int level)
+vector<Point3i> TCLCHistograms::parallelComputeLocalHistogramCenters(const Mat &mask, const Mat &depth, const Matx33f &K, const Matx44f &T_cm, int level)
 {
     vector<Point3i> res;
     
-    vector<Vec3f> verticies = _model->getVertices();
-    Matx44f T_cm = _model->getPose();
+    const vector<Vec3f> &verticies = _model->getSamplePoints();
     Matx44f T_n = _model->getNormalization();
     
     vector<vector<Point3i> > centersIdsCollection;
@@ -139,7 +174,7 @@ vector<Point3i> TCLCHistograms::parallelComputeLocalHistogramCenters(const Mat &
     
     int m_id = _model->getModelID();
     
-    parallel_for_(cv::Range(0, 8), Parallel_For_computeHistogramCenters(mask, depth, verticies, T_cm_n, K, zNear, zFar, m_id, level, centersIdsCollection.data(), 8));
+    parallel_for_(cv::Range(0, 8), Parallel_For_computeHistogramCenters(mask, depth, verticies, T_cm_n, K, m_id, level, centersIdsCollection.data(), 8));
     
     for(int i = 0; i < centersIdsCollection.size(); i++)
     {
@@ -155,7 +190,60 @@ vector<Point3i> TCLCHistograms::parallelComputeLocalHistogramCenters(const Mat &
 }
 
 
-void TCLCHistograms::filterHistogramCenters(int numHistograms, float offset)
+vector<Point3i> TCLCHistograms::computeContourHistogramCenters(const Matx33f &K, const Size &imageSize)
+{
+    vector<Point3i> res;
+    
+    Matx44f T_cm_n = _model->getPose() * _model->getNormalization();
+    
+    // the camera center in unnormalized model coordinates
+    Matx44f T_cm_n_inv = T_cm_n.inv();
+    Vec3f viewpoint(T_cm_n_inv(0, 3), T_cm_n_inv(1, 3), T_cm_n_inv(2, 3));
+    
+    vector<Vec2i> edges;
+    _model->computeContourEdges(viewpoint, edges);
+    
+    const vector<Vec3f> &verticies = _model->getSilhouetteVertices();
+    const vector<int> &sampleIDs = _model->getVertexSampleIDs();
+    
+    // each histogram is only used once even if it is closest to multiple contour verticies
+    vector<uchar> used(_numHistograms, 0);
+    
+    for(int e = 0; e < edges.size(); e++)
+    {
+        for(int k = 0; k < 2; k++)
+        {
+            int v = edges[e][k];
+            int id = sampleIDs[v];
+            
+            if(id < 0 || used[id])
+                continue;
+            
+            Vec3f V_m = verticies[v];
+            
+            float X_c = V_m[0]*T_cm_n(0, 0) + V_m[1]*T_cm_n(0, 1) + V_m[2]*T_cm_n(0, 2) + T_cm_n(0, 3);
+            float Y_c = V_m[0]*T_cm_n(1, 0) + V_m[1]*T_cm_n(1, 1) + V_m[2]*T_cm_n(1, 2) + T_cm_n(1, 3);
+            float Z_c = V_m[0]*T_cm_n(2, 0) + V_m[1]*T_cm_n(2, 1) + V_m[2]*T_cm_n(2, 2) + T_cm_n(2, 3);
+            
+            if(Z_c <= 0)
+                continue;
+            
+            float x = X_c/Z_c*K(0, 0) + K(0, 2);
+            float y = Y_c/Z_c*K(1, 1) + K(1, 2);
+            
+            if(x >= 0 && x < imageSize.width && y >= 0 && y < imageSize.height)
+            {
+                used[id] = 1;
+                res.push_back(Point3i((int)x, (int)y, id));
+            }
+        }
+    }
+    
+    return res;
+}
+
+
+float TCLCHistograms::filterHistogramCenters(vector<Point3i> &centersIDs, int numHistograms, float offset)
 {
     int offset2 = (offset)*(offset);
     
@@ -165,14 +253,14 @@ void TCLCHistograms::filterHistogramCenters(int numHistograms, float offset)
     {
         res.clear();
         
-        while(_centersIDs.size() > 0)
+        while(centersIDs.size() > 0)
         {
-            Point3i center = _centersIDs[0];
+            Point3i center = centersIDs[0];
             vector<Point3i> tmp;
             res.push_back(center);
-            for(int c2 = 1; c2 < _centersIDs.size(); c2++)
+            for(int c2 = 1; c2 < centersIDs.size(); c2++)
             {
-                Point3i center2 = _centersIDs[c2];
+                Point3i center2 = centersIDs[c2];
                 int dx = center.x - center2.x;
                 int dy = center.y - center2.y;
                 int d = dx*dx + dy*dy;
@@ -182,16 +270,16 @@ void TCLCHistograms::filterHistogramCenters(int numHistograms, float offset)
                     tmp.push_back(center2);
                 }
             }
-            _centersIDs = tmp;
+            centersIDs = tmp;
         }
-        _centersIDs = res;
+        centersIDs = res;
         
         offset += 1.0f;
         offset2 = offset*offset;
     }
     while(res.size() > numHistograms);
     
-    _offset = offset;
+    return offset;
 }
 
 
@@ -207,7 +295,7 @@ Mat TCLCHistograms::getLocalBackgroundHistograms()
 }
 
 
-vector<Point3i> TCLCHistograms::getCentersAndIDs()
+const vector<Point3i> &TCLCHistograms::getCentersAndIDs()
 {
     return _centersIDs;
 }
@@ -218,6 +306,11 @@ Mat TCLCHistograms::getInitialized()
     return initialized;
 }
 
+Mat TCLCHistograms::getPosteriorLUT()
+{
+    return posteriorLUT;
+}
+
 
 int TCLCHistograms::getNumBins()
 {
@@ -250,4 +343,7 @@ void TCLCHistograms::clear()
     notNormalizedBG = Mat::zeros(this->_numHistograms, numBins*numBins*numBins, CV_32SC1);
     
     initialized = Mat::zeros(1, this->_numHistograms, CV_8UC1);
+    
+    posteriorSums = Mat::zeros(2, numBins*numBins*numBins, CV_64FC1);
+    posteriorLUT = Mat::zeros(1, numBins*numBins*numBins, CV_8UC1);
 }
@@ -44,14 +44,14 @@ class Model;
 /**
  *  This class implements an statistical image segmentation model based on temporary
  *  consistent, local color histograms (tclc-histograms). Here, each histogram corresponds
- *  to a 3D vertex of a given 3D model.
+ *  to a 3D surface sample point of a given 3D model.
  */
 class TCLCHistograms
 {
 public:
     /**
      *  Constructor that allocates both normalized and not normalized foreground
-     *  and background histograms for each vertex of the given 3D model.
+     *  and background histograms for each surface sample point of the given 3D model.
      *
      *  @param  model The 3D model for which the histograms are being created.
      *  @param  numBins The number of bins per color channel.
@@ -68,25 +68,47 @@ public:
      *
      *  @param  frame The color frame to be used for updating the histograms.
      *  @param  mask The corresponding binary shilhouette mask of the object.
-     *  @param  depth The per pixel depth map of the object used to filter histograms on the back of the object,
+     *  @param  depth The per pixel linear camera space depth of the object (0 for background) used to filter histograms on the back of the object,
      *  @param  K The camera's instrinsic matrix.
-     *  @param  zNear The near plane used to render the depth map.
-     *  @param  zFar The far plane used to render the depth map.
      */
-    void update(const cv::Mat &frame, const cv::Mat &mask, const cv::Mat &depth, cv::Matx33f &K, float zNear, float zFar);
+    void update(const cv::Mat &frame, const cv::Mat &mask, const cv::Mat &depth, cv::Matx33f &K);
     
     /**
      *  Computes updated center locations and IDs of all histograms that project onto or close
      *  to the contour based on the current object pose at a specified image pyramid level.
      *
      *  @param  mask The binary shilhouette mask of the object.
-     *  @param  depth The per pixel depth map of the object used to filter histograms on the back of the object,
+     *  @param  depth The per pixel linear camera space depth of the object (0 for background) used to filter histograms on the back of the object,
      *  @param  K The camera's instrinsic matrix.
-     *  @param  zNear The near plane used to render the depth map.
-     *  @param  zFar The far plane used to render the depth map.
      *  @param  level The image pyramid level to be used for the update.
      */
-    void updateCentersAndIds(const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K, float zNear, float zFar, int level);
+    void updateCentersAndIds(const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K, int level);
+    
+    /**
+     *  Computes updated center locations and IDs of all histograms based on the current
+     *  object pose without a rendering, by projecting the verticies of the contour edges
+     *  extracted from the model's mesh. Each contour vertex is assigned the histogram of
+     *  its closest surface sample point. In contrast to the rendering based version, contour
+     *  edges occluded by other parts of the object or by other objects are not removed.
+     *
+     *  @param  K The camera's instrinsic matrix at pyramid level 0.
+     *  @param  imageSize The size of the camera image at pyramid level 0.
+     */
+    void updateCentersAndIds(const cv::Matx33f &K, const cv::Size &imageSize);
+    
+    /**
+     *  Computes the center locations and IDs of all histograms that project onto or close
+     *  to the contour for a given object pose, just like updateCentersAndIds() but without
+     *  changing the current centers, such that it can be called from multiple threads.
+     *
+     *  @param  mask The binary shilhouette mask of the object.
+     *  @param  depth The per pixel linear camera space depth of the object (0 for background) used to filter histograms on the back of the object,
+     *  @param  K The camera's instrinsic matrix.
+     *  @param  T_cm The object pose the mask and depth have been rendered with.
+     *  @param  level The image pyramid level to be used.
+     *  @return The list of all center locations on or close to the contour and their corresponding IDs [(x_0, y_0, id_0), (x_1, y_1, id_1), ...].
+     */
+    std::vector<cv::Point3i> computeCentersAndIds(const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K, const cv::Matx44f &T_cm, int level);
     
     /**
      *  Returns all normalized forground histograms in their current state.
@@ -106,9 +128,12 @@ public:
      *  Returns the locations and IDs of all histogram centers that where used for the last
      *  update() or updateCentersAndIds() call.
      *
+     *  The returned reference stays valid until the centers are changed by the next update(),
+     *  updateCentersAndIds() or clear() call.
+     *
      *  @return The list of all current center locations on or close to the contour and their corresponding IDs [(x_0, y_0, id_0), (x_1, y_1, id_1), ...].
      */
-    std::vector<cv::Point3i> getCentersAndIDs();
+    const std::vector<cv::Point3i> &getCentersAndIDs();
     
     /**
      *  Returns a 1D binary mask of all histograms where a '1' means that the histograms
@@ -118,6 +143,16 @@ public:
      */
     cv::Mat getInitialized();
     
+    /**
+     *  Returns a lookup table telling for every color bin whether the average foreground
+     *  posterior probability across all initialized histograms is greater than the average
+     *  background posterior probability. The table is updated incrementally from the
+     *  histograms changed by every update() call.
+     *
+     *  @return A 1D lookup table of all bins with 255 for foreground and 0 for background (uchar).
+     */
+    cv::Mat getPosteriorLUT();
+    
     /**
      *  Returns the number of histogram bin per image channel as specified in the constructor.
      *
@@ -126,7 +161,7 @@ public:
     int getNumBins();
     
     /**
-     *  Returns the number of histograms, i.e. verticies of the corresponding 3D model.
+     *  Returns the number of histograms, i.e. surface sample points of the corresponding 3D model.
      *
      *  @return The number of histograms.
      */
@@ -172,15 +207,21 @@ private:
     
     cv::Mat initialized;
     
+    // the per bin sums of the foreground and background posteriors of all initialized histograms (2 rows, double)
+    cv::Mat posteriorSums;
+    cv::Mat posteriorLUT;
+    
     Model* _model;
     
     std::vector<cv::Point3i> _centersIDs;
     
     std::vector<cv::Point3i> computeLocalHistogramCenters(const cv::Mat &mask);
     
-    std::vector<cv::Point3i> parallelComputeLocalHistogramCenters(const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K, float zNear, float zFar, int level);
+    std::vector<cv::Point3i> parallelComputeLocalHistogramCenters(const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K, const cv::Matx44f &T_cm, int level);
+    
+    std::vector<cv::Point3i> computeContourHistogramCenters(const cv::Matx33f &K, const cv::Size &imageSize);
     
-    void filterHistogramCenters(int numHistograms, float offset);
+    float filterHistogramCenters(std::vector<cv::Point3i> &centersIDs, int numHistograms, float offset);
 };
 
 /**
@@ -204,7 +245,7 @@ private:
     
     cv::Size size;
     
-    std::vector<cv::Point3i> _centers;
+    const std::vector<cv::Point3i> &_centers;
     
     int _radius;
     
@@ -226,7 +267,7 @@ private:
     int _threads;
     
 public:
-    Parallel_For_buildLocalHistograms(const cv::Mat &frame, const cv::Mat &mask, const std::vector<cv::Point3i> &centers, float radius, int numBins, cv::Mat &localHistogramsFG, cv::Mat &localHistogramsBG, cv::Mat &sumsFB, int m_id, int threads)
+    Parallel_For_buildLocalHistograms(const cv::Mat &frame, const cv::Mat &mask, const std::vector<cv::Point3i> &centers, float radius, int numBins, cv::Mat &localHistogramsFG, cv::Mat &localHistogramsBG, cv::Mat &sumsFB, int m_id, int threads): _centers(centers)
     {
         _frame = frame;
         _mask = mask;
@@ -239,7 +280,6 @@ public:
         
         size = frame.size();
         
-        _centers = centers;
         
         _radius = radius;
         
@@ -416,7 +456,12 @@ public:
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
  *  computations. Within the corresponding for loop, each previously computed local foreground
  *  and background color histogram is merged with their normalized temporally consistent
- *  representation based on respective learning rates.
+ *  representation based on respective learning rates. The loop is split across the histogram
+ *  bins, such that at the same time the per bin sums of the foreground and background posteriors
+ *  of all initialized histograms and the resulting posterior lookup table can be updated
+ *  without synchronization, by subtracting the old and adding the new posteriors of all
+ *  changed histograms. The initialized flags of the merged histograms have to be set after
+ *  the loop has finished.
  */
 class Parallel_For_mergeLocalHistograms: public cv::ParallelLoopBody
 {
@@ -433,17 +478,50 @@ private:
     
     uchar* initializedData;
     
-    std::vector<cv::Point3i> _centersIds;
+    const std::vector<cv::Point3i> &_centersIds;
     
     float _alphaF;
     float _alphaB;
     
     int* _sumsFBData;
     
+    int _numCleared;
+    
+    const std::vector<int> &_changedIDs;
+    
+    // whether each changed histogram is initialized after the merge
+    std::vector<uchar> changedInitialized;
+    
+    double* posteriorSumsFGData;
+    double* posteriorSumsBGData;
+    
+    uchar* posteriorLUTData;
+    
     int _threads;
     
+    inline void addPosteriors(int hID, int iStart, int iEnd, double sign) const
+    {
+        float* normalizedFG = normalizedFGData + hID*histogramSize;
+        float* normalizedBG = normalizedBGData + hID*histogramSize;
+        
+        for(int i = iStart; i < iEnd; i++)
+        {
+            float pyf = normalizedFG[i];
+            float pyb = normalizedBG[i];
+            
+            if(pyf > 0.0f || pyb > 0.0f)
+            {
+                pyf += 0.0000001f;
+                pyb += 0.0000001f;
+                
+                posteriorSumsFGData[i] += sign*(pyf / (pyf + pyb));
+                posteriorSumsBGData[i] += sign*(pyb / (pyf + pyb));
+            }
+        }
+    }
+    
 public:
-    Parallel_For_mergeLocalHistograms(const cv::Mat &notNormalizedFG, const cv::Mat &notNormalizedBG, cv::Mat &normalizedFG, cv::Mat &normalizedBG, cv::Mat &initialized, const std::vector<cv::Point3i> centersIds, const cv::Mat &sumsFB, float alphaF, float alphaB, int threads)
+    Parallel_For_mergeLocalHistograms(const cv::Mat &notNormalizedFG, const cv::Mat &notNormalizedBG, cv::Mat &normalizedFG, cv::Mat &normalizedBG, cv::Mat &initialized, const std::vector<cv::Point3i> &centersIds, const cv::Mat &sumsFB, float alphaF, float alphaB, int numCleared, const std::vector<int> &changedIDs, cv::Mat &posteriorSums, cv::Mat &posteriorLUT, int threads): _centersIds(centersIds), _changedIDs(changedIDs)
     {
         histogramSize = notNormalizedFG.cols;
         
@@ -455,8 +533,6 @@ public:
         
         initializedData = initialized.data;
         
-        _centersIds = centersIds;
-        
         _sumsFB = sumsFB;
         
         _alphaF = alphaF;
@@ -464,20 +540,55 @@ public:
         
         _sumsFBData = (int*)_sumsFB.ptr<int>();
         
+        _numCleared = numCleared;
+        
+        std::vector<uchar> merged(initialized.cols, 0);
+        for(int h = 0; h < centersIds.size(); h++)
+        {
+            merged[centersIds[h].z] = 1;
+        }
+        
+        changedInitialized.resize(changedIDs.size());
+        for(int c = 0; c < changedIDs.size(); c++)
+        {
+            changedInitialized[c] = initializedData[changedIDs[c]] || merged[changedIDs[c]];
+        }
+        
+        posteriorSumsFGData = posteriorSums.ptr<double>(0);
+        posteriorSumsBGData = posteriorSums.ptr<double>(1);
+        
+        posteriorLUTData = posteriorLUT.data;
+        
         _threads = threads;
     }
     
     virtual void operator()( const cv::Range &r ) const
     {
-        int range = _sumsFB.rows/_threads;
+        int range = histogramSize/_threads;
         
-        int hEnd = r.end*range;
+        int iStart = r.start*range;
+        int iEnd = r.end*range;
         if(r.end == _threads)
         {
-            hEnd = _sumsFB.rows;
+            iEnd = histogramSize;
+        }
+        
+        // remove the old posteriors of all changed histograms
+        for(int c = 0; c < _changedIDs.size(); c++)
+        {
+            if(initializedData[_changedIDs[c]])
+            {
+                addPosteriors(_changedIDs[c], iStart, iEnd, -1.0);
+            }
+        }
+        
+        for(int h = 0; h < _numCleared; h++)
+        {
+            memset(normalizedFGData + h*histogramSize + iStart, 0, (iEnd - iStart)*sizeof(float));
+            memset(normalizedBGData + h*histogramSize + iStart, 0, (iEnd - iStart)*sizeof(float));
         }
         
-        for(int h = r.start*range; h < hEnd; h++)
+        for(int h = 0; h < _centersIds.size(); h++)
         {
             int cID = _centersIds[h].z;
             
@@ -492,53 +603,47 @@ public:
             
             if(initializedData[cID] == 0)
             {
-                for(int i = 0; i < histogramSize; i++)
+                for(int i = iStart; i < iEnd; i++)
                 {
-                    if(false)
+                    if(notNormalizedFG[i])
                     {
                         normalizedFG[i] = (float)notNormalizedFG[i]/totalFGPixels;
-                        normalizedBG[i] = (float)notNormalizedBG[i]/totalBGPixels;
-                        
                     }
-                    else
+                    if(notNormalizedBG[i])
                     {
-                        if(notNormalizedFG[i])
-                        {
-                            normalizedFG[i] = (float)notNormalizedFG[i]/totalFGPixels;
-                        }
-                        if(notNormalizedBG[i])
-                        {
-                            normalizedBG[i] = (float)notNormalizedBG[i]/totalBGPixels;
-                        }
+                        normalizedBG[i] = (float)notNormalizedBG[i]/totalBGPixels;
                     }
                 }
-                initializedData[cID] = 1;
             }
             else
             {
-                for(int i = 0; i < histogramSize; i++)
+                for(int i = iStart; i < iEnd; i++)
                 {
-                    
-                    if(false)
+                    if(notNormalizedFG[i])
                     {
-                        normalizedFG[i] = (float)notNormalizedFG[i]/totalFGPixels;
-                        normalizedBG[i] = (float)notNormalizedBG[i]/totalBGPixels;
+                        normalizedFG[i] = (1.0f - _alphaF)*normalizedFG[i] + _alphaF*(float)notNormalizedFG[i]/totalFGPixels;
                     }
-                    else
+                    if(notNormalizedBG[i])
                     {
-                        if(notNormalizedFG[i])
-                        {
-                            normalizedFG[i] = (1.0f - _alphaF)*normalizedFG[i] + _alphaF*(float)notNormalizedFG[i]/totalFGPixels;
-                        }
-                        if(notNormalizedBG[i])
-                        {
-                            normalizedBG[i] = (1.0f - _alphaB)*normalizedBG[i] + _alphaB*(float)notNormalizedBG[i]/totalBGPixels;
-                        }
+                        normalizedBG[i] = (1.0f - _alphaB)*normalizedBG[i] + _alphaB*(float)notNormalizedBG[i]/totalBGPixels;
                     }
                 }
-                
             }
         }
+        
+        // add the new posteriors of all changed histograms that are or become initialized
+        for(int c = 0; c < _changedIDs.size(); c++)
+        {
+            if(changedInitialized[c])
+            {
+                addPosteriors(_changedIDs[c], iStart, iEnd, 1.0);
+            }
+        }
+        
+        for(int i = iStart; i < iEnd; i++)
+        {
+            posteriorLUTData[i] = posteriorSumsFGData[i] > posteriorSumsBGData[i] ? 255 : 0;
+        }
     }
 };
 
@@ -552,7 +657,7 @@ public:
 class Parallel_For_computeHistogramCenters: public cv::ParallelLoopBody
 {
 private:
-    std::vector<cv::Vec3f> _verticies;
+    const std::vector<cv::Vec3f> &_verticies;
     
     std::vector<cv::Point3i>* _centersIds;
     
@@ -564,9 +669,6 @@ private:
     cv::Matx44f _T_cm;
     cv::Matx33f _K;
     
-    float _zNear;
-    float _zFar;
-    
     int _m_id;
     
     int _level;
@@ -577,10 +679,8 @@ private:
     int _threads;
     
 public:
-    Parallel_For_computeHistogramCenters(const cv::Mat &mask, const cv::Mat &depth, const std::vector<cv::Vec3f> &verticies, const cv::Matx44f &T_cm, const cv::Matx33f &K, float zNear, float zFar, int m_id, int level, std::vector<cv::Point3i>* centersIds, int threads)
+    Parallel_For_computeHistogramCenters(const cv::Mat &mask, const cv::Mat &depth, const std::vector<cv::Vec3f> &verticies, const cv::Matx44f &T_cm, const cv::Matx33f &K, int m_id, int level, std::vector<cv::Point3i>* centersIds, int threads): _verticies(verticies)
     {
-        _verticies = verticies;
-        
         _depth = depth;
         
         _level = level;
@@ -603,13 +703,8 @@ public:
         _T_cm = T_cm;
         _K = K;
         
-        _zNear = zNear;
-        _zFar = zFar;
-        
         _m_id = m_id;
         
-        _centersIds = centersIds;
-        
         _threads = threads;
     }
     
@@ -642,11 +737,9 @@ public:
             
             if(x >= 0 && x < _depth.cols && y >= 0 && y < _depth.rows)
             {
-                float d = 1.0f - _depth.at<float>(y, x);
-                
-                float Z_d = 2.0f * _zNear * _zFar / (_zFar + _zNear - (2.0f*(d) - 1.0) * (_zFar - _zNear));
+                float Z_d = _depth.at<float>(y, x);
                 
-                if(fabs(Z_c - Z_d) < 1.0f || d == 1.0)
+                if(fabs(Z_c - Z_d) < 1.0f || Z_d == 0.0f)
                 {
                     int xi = (int)x;
                     int yi = (int)y;
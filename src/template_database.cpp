@@ -0,0 +1,426 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "template_database.h"
+#include "object3d.h"
+#include "template_view.h"
+#include "file_utils.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+
+static const char fileMagic[8] = {'R', 'B', 'O', 'T', 'T', 'P', 'L', '\0'};
+
+// FNV-1a hash accumulated over raw bytes
+static void hashBytes(uint64_t &hash, const void *bytes, size_t size)
+{
+    const uchar *data = (const uchar*)bytes;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+// maps a whole file read-only
+static const uchar *mapFile(const string &fileName, size_t &size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+    
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+    
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(!mapping)
+    {
+        return NULL;
+    }
+    
+    // the view keeps the mapping alive after its handle is closed
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if(!view)
+    {
+        return NULL;
+    }
+    
+    size = (size_t)fileSize.QuadPart;
+    return (const uchar*)view;
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        ::close(fd);
+        return NULL;
+    }
+    
+    void *mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    
+    if(mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+    
+    size = fileStat.st_size;
+    return (const uchar*)mapping;
+#endif
+}
+
+static void unmapFile(const uchar *data, size_t size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+// appends raw bytes aligned to 8 bytes and returns their offset
+static uint64_t appendBytes(vector<uchar> &buffer, const void *bytes, size_t size)
+{
+    buffer.resize((buffer.size() + 7) & ~(size_t)7);
+    
+    uint64_t offset = buffer.size();
+    if(size > 0)
+    {
+        buffer.insert(buffer.end(), (const uchar*)bytes, (const uchar*)bytes + size);
+    }
+    return offset;
+}
+
+
+TemplateDatabase::TemplateDatabase()
+{
+    data = NULL;
+    dataSize = 0;
+    
+    header = NULL;
+    templateRecords = NULL;
+    levelRecords = NULL;
+}
+
+TemplateDatabase::~TemplateDatabase()
+{
+    close();
+}
+
+
+uint64_t TemplateDatabase::computeKey(Object3D *object, RenderingEngine *renderingEngine, int numLevels, const vector<float> &templateDistances)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    
+    uint32_t version = VERSION;
+    hashBytes(hash, &version, sizeof(version));
+    
+    // the geometry the templates are rendered from and the points defining the histogram IDs
+    const vector<Vec3f> &vertices = object->getSilhouetteVertices();
+    const vector<GLuint> &indices = object->getSilhouetteIndices();
+    const vector<Vec3f> &samplePoints = object->getSamplePoints();
+    
+    hashBytes(hash, vertices.data(), vertices.size()*sizeof(Vec3f));
+    hashBytes(hash, indices.data(), indices.size()*sizeof(GLuint));
+    hashBytes(hash, samplePoints.data(), samplePoints.size()*sizeof(Vec3f));
+    
+    Matx44f T_n = object->getNormalization();
+    hashBytes(hash, T_n.val, sizeof(T_n.val));
+    
+    // the templates are rendered at full resolution
+    renderingEngine->setLevel(0);
+    
+    Matx44f K = renderingEngine->getCalibrationMatrix();
+    hashBytes(hash, K.val, sizeof(K.val));
+    
+    int parameters[4] = {renderingEngine->getSize().width, renderingEngine->getSize().height, numLevels, object->getTCLCHistograms()->getRadius()};
+    hashBytes(hash, parameters, sizeof(parameters));
+    
+    // the clipping planes affect the rendered silhouettes and depths
+    float clipping[2] = {renderingEngine->getZNear(), renderingEngine->getZFar()};
+    hashBytes(hash, clipping, sizeof(clipping));
+    
+    hashBytes(hash, templateDistances.data(), templateDistances.size()*sizeof(float));
+    
+    return hash;
+}
+
+
+string TemplateDatabase::getDefaultFolder()
+{
+    return getCacheFolder("RBOT_TEMPLATE_CACHE", "templates");
+}
+
+
+bool TemplateDatabase::write(const string &fileName, uint64_t key, int numLevels, const vector<TemplateView*> &baseTemplates, const vector<TemplateView*> &neighboringTemplates)
+{
+    vector<TemplateView*> templates(baseTemplates);
+    templates.insert(templates.end(), neighboringTemplates.begin(), neighboringTemplates.end());
+    
+    int numTemplates = (int)templates.size();
+    
+    vector<TemplateRecord> templateData(numTemplates);
+    vector<LevelRecord> levelData(numTemplates*numLevels);
+    
+    // the records are placed at the beginning of the file and filled in while appending the data
+    vector<uchar> buffer(sizeof(FileHeader));
+    uint64_t templatesOffset = appendBytes(buffer, templateData.data(), templateData.size()*sizeof(TemplateRecord));
+    uint64_t levelsOffset = appendBytes(buffer, levelData.data(), levelData.size()*sizeof(LevelRecord));
+    
+    for(int t = 0; t < numTemplates; t++)
+    {
+        TemplateView *tv = templates[t];
+        TemplateRecord &record = templateData[t];
+        
+        Matx44f pose = tv->getPose();
+        memcpy(record.pose, pose.val, sizeof(record.pose));
+        record.alpha = tv->getAlpha();
+        record.beta = tv->getBeta();
+        record.gamma = tv->getGamma();
+        record.distance = tv->getDistance();
+        
+        // the histogram centers are the same for all levels
+        const vector<Point3i> &centersIDs = tv->getCentersAndIDs();
+        record.numCenters = (int)centersIDs.size();
+        record.centersOffset = appendBytes(buffer, centersIDs.data(), centersIDs.size()*sizeof(Point3i));
+        
+        for(int level = 0; level < numLevels; level++)
+        {
+            LevelRecord &levelRecord = levelData[t*numLevels + level];
+            memset(&levelRecord, 0, sizeof(LevelRecord));
+            
+            Rect roi = tv->getROI(level);
+            levelRecord.roi[0] = roi.x;
+            levelRecord.roi[1] = roi.y;
+            levelRecord.roi[2] = roi.width;
+            levelRecord.roi[3] = roi.height;
+            levelRecord.etaF = tv->getEtaF(level);
+            
+            // only masks matching the region of interest are stored
+            const BitMask &bitMask = tv->getBitMask(level);
+            if(roi.area() > 0 && bitMask.rows() == roi.height && bitMask.cols() == roi.width)
+                levelRecord.bitMaskOffset = appendBytes(buffer, bitMask.getData(), bitMask.getDataSize());
+            
+            // the compressed pixel data already is a single contiguous block
+            const CompressedPixelData &pixelData = tv->getCompressedPixelData(level);
+            levelRecord.numPixels = pixelData.numPixels;
+            levelRecord.numIDs = pixelData.numIDs;
+            if(pixelData.getData())
+                levelRecord.pixelDataOffset = appendBytes(buffer, pixelData.getData(), CompressedPixelData::computeSize(pixelData.numPixels, pixelData.numIDs));
+        }
+    }
+    
+    FileHeader fileHeader;
+    memcpy(fileHeader.magic, fileMagic, sizeof(fileMagic));
+    fileHeader.version = VERSION;
+    fileHeader.numLevels = numLevels;
+    fileHeader.key = key;
+    fileHeader.numBaseTemplates = (uint32_t)baseTemplates.size();
+    fileHeader.numNeighboringTemplates = (uint32_t)neighboringTemplates.size();
+    fileHeader.fileSize = buffer.size();
+    
+    memcpy(&buffer[0], &fileHeader, sizeof(FileHeader));
+    if(numTemplates > 0)
+    {
+        memcpy(&buffer[templatesOffset], templateData.data(), templateData.size()*sizeof(TemplateRecord));
+        memcpy(&buffer[levelsOffset], levelData.data(), levelData.size()*sizeof(LevelRecord));
+    }
+    
+    // create all missing folders of the file path
+    size_t pos = fileName.find_last_of("/\\");
+    if(pos != string::npos && pos > 0)
+    {
+        createFolders(fileName.substr(0, pos));
+    }
+    
+    string tmpFileName = fileName + ".tmp";
+    ofstream file(tmpFileName.c_str(), ios::binary);
+    if(!file.is_open())
+    {
+        cout << "error writing template file " << fileName << endl;
+        return false;
+    }
+    file.write((const char*)buffer.data(), buffer.size());
+    file.close();
+    
+    if(!file.good() || rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        cout << "error writing template file " << fileName << endl;
+        remove(tmpFileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+bool TemplateDatabase::open(const string &fileName, uint64_t key, int numLevels)
+{
+    close();
+    
+    data = mapFile(fileName, dataSize);
+    if(!data)
+    {
+        dataSize = 0;
+        return false;
+    }
+    
+    if(dataSize < sizeof(FileHeader))
+    {
+        close();
+        return false;
+    }
+    
+    header = (const FileHeader*)data;
+    
+    size_t numTemplates = (size_t)header->numBaseTemplates + header->numNeighboringTemplates;
+    size_t templatesOffset = (sizeof(FileHeader) + 7) & ~(size_t)7;
+    size_t levelsOffset = (templatesOffset + numTemplates*sizeof(TemplateRecord) + 7) & ~(size_t)7;
+    
+    if(memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0 || header->version != VERSION
+       || header->key != key || header->numLevels != numLevels || header->fileSize != dataSize
+       || levelsOffset + numTemplates*numLevels*sizeof(LevelRecord) > dataSize)
+    {
+        close();
+        return false;
+    }
+    
+    templateRecords = (const TemplateRecord*)(data + templatesOffset);
+    levelRecords = (const LevelRecord*)(data + levelsOffset);
+    
+    return true;
+}
+
+
+void TemplateDatabase::close()
+{
+    if(data)
+    {
+        unmapFile(data, dataSize);
+    }
+    data = NULL;
+    dataSize = 0;
+    
+    header = NULL;
+    templateRecords = NULL;
+    levelRecords = NULL;
+}
+
+
+int TemplateDatabase::getNumBaseTemplates()
+{
+    return header ? header->numBaseTemplates : 0;
+}
+
+
+int TemplateDatabase::getNumNeighboringTemplates()
+{
+    return header ? header->numNeighboringTemplates : 0;
+}
+
+
+TemplateView *TemplateDatabase::createTemplateView(int index)
+{
+    int numLevels = header->numLevels;
+    
+    const TemplateRecord &record = templateRecords[index];
+    
+    TemplateView *tv = new TemplateView();
+    
+    tv->T_cm = Matx44f(record.pose);
+    tv->_alpha = record.alpha;
+    tv->_beta = record.beta;
+    tv->_gamma = record.gamma;
+    tv->_distance = record.distance;
+    tv->_numLevels = numLevels;
+    
+    const Point3i *centersIDs = (const Point3i*)(data + record.centersOffset);
+    tv->centersIDs.assign(centersIDs, centersIDs + record.numCenters);
+    
+    tv->roiPyramid.resize(numLevels);
+    tv->etaFPyramid.resize(numLevels);
+    tv->bitMaskPyramid.resize(numLevels);
+    tv->pixelDataPyramid.resize(numLevels);
+    
+    for(int level = 0; level < numLevels; level++)
+    {
+        const LevelRecord &levelRecord = levelRecords[index*numLevels + level];
+        
+        Rect roi(levelRecord.roi[0], levelRecord.roi[1], levelRecord.roi[2], levelRecord.roi[3]);
+        tv->roiPyramid[level] = roi;
+        tv->etaFPyramid[level] = levelRecord.etaF;
+        
+        // the bit masks and the compressed pixel data reference the mapped file without copying
+        if(levelRecord.bitMaskOffset)
+            tv->bitMaskPyramid[level].setData(roi.height, roi.width, (const uint64_t*)(data + levelRecord.bitMaskOffset));
+        
+        if(levelRecord.pixelDataOffset)
+            tv->pixelDataPyramid[level].setData(data + levelRecord.pixelDataOffset, levelRecord.numPixels, levelRecord.numIDs);
+    }
+    
+    return tv;
+}
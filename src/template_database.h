@@ -0,0 +1,190 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPLATE_DATABASE_H
+#define TEMPLATE_DATABASE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "rendering_engine.h"
+
+class Object3D;
+class TemplateView;
+
+/**
+ *  A binary file of all template views of an object, such that the templates only have
+ *  to be rendered and preprocessed once. The file is keyed by a hash of the model geometry,
+ *  the camera intrinsics, the image size and the template parameters and is versioned
+ *  wrt the file layout. When opened, the file is memory-mapped and the bit-packed masks
+ *  and compressed pixel data of all loaded templates directly reference the mapped
+ *  memory without being copied, while only the small histogram centers are copied.
+ *  The database must therefore outlive all template views created from it. The file
+ *  is written in the native byte order and is only meant to be used on the same machine.
+ */
+class TemplateDatabase
+{
+public:
+    /**
+     *  The version of the file layout, which has to be increased whenever the layout
+     *  or the way the templates are generated changes.
+     */
+    static const uint32_t VERSION = 3;
+    
+    TemplateDatabase();
+    
+    ~TemplateDatabase();
+    
+    /**
+     *  Computes the key identifying the templates of an object for a given rendering
+     *  setup from the geometry and histogram sample points of the model, the intrinsics,
+     *  image size and clipping planes of the rendering engine at pyramid level 0 and the
+     *  parameters used for the template generation.
+     *
+     *  @param  object The 3D object of which the templates are generated.
+     *  @param  renderingEngine The rendering engine used to render the templates.
+     *  @param  numLevels The number of template pyramid levels.
+     *  @param  templateDistances The Z-distances used for the template generation.
+     *  @return  The 64 bit key of the templates.
+     */
+    static uint64_t computeKey(Object3D *object, RenderingEngine *renderingEngine, int numLevels, const std::vector<float> &templateDistances);
+    
+    /**
+     *  Returns the default folder for template files, which is taken from the environment
+     *  variable RBOT_TEMPLATE_CACHE if set and otherwise is the subfolder rbot/templates
+     *  of the user's cache directory (see getCacheFolder()).
+     *
+     *  @return  The default template folder or an empty string if none could be determined.
+     */
+    static std::string getDefaultFolder();
+    
+    /**
+     *  Writes a set of template views to a file, where the first templates are the base
+     *  templates followed by all neighboring templates. The file is written to a temporary
+     *  file first and then renamed, such that concurrent processes never read partial files.
+     *
+     *  @param  fileName The path of the template file.
+     *  @param  key The key of the templates as obtained from computeKey().
+     *  @param  numLevels The number of template pyramid levels.
+     *  @param  baseTemplates The base templates to be written.
+     *  @param  neighboringTemplates The neighboring templates to be written.
+     *  @return  True if the file has been written successfully and false otherwise.
+     */
+    static bool write(const std::string &fileName, uint64_t key, int numLevels, const std::vector<TemplateView*> &baseTemplates, const std::vector<TemplateView*> &neighboringTemplates);
+    
+    /**
+     *  Memory-maps a template file and validates its version, key and size. Any previously
+     *  opened file is closed.
+     *
+     *  @param  fileName The path of the template file.
+     *  @param  key The expected key of the templates.
+     *  @param  numLevels The expected number of template pyramid levels.
+     *  @return  True if a valid template file has been opened and false otherwise.
+     */
+    bool open(const std::string &fileName, uint64_t key, int numLevels);
+    
+    /**
+     *  Unmaps the currently opened template file.
+     */
+    void close();
+    
+    /**
+     *  Returns the number of base templates in the opened file.
+     *
+     *  @return  The number of base templates.
+     */
+    int getNumBaseTemplates();
+    
+    /**
+     *  Returns the number of neighboring templates in the opened file.
+     *
+     *  @return  The number of neighboring templates.
+     */
+    int getNumNeighboringTemplates();
+    
+    /**
+     *  Creates a template view from the opened file referencing the mapped memory, where
+     *  the base templates come first followed by all neighboring templates.
+     *
+     *  @param  index The index of the template in the file.
+     *  @return  The template view, which has to be deleted by the caller.
+     */
+    TemplateView *createTemplateView(int index);
+    
+private:
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t numLevels;
+        uint64_t key;
+        uint32_t numBaseTemplates;
+        uint32_t numNeighboringTemplates;
+        uint64_t fileSize;
+    };
+    
+    struct TemplateRecord
+    {
+        float pose[16];
+        float alpha;
+        float beta;
+        float gamma;
+        float distance;
+        int32_t numCenters;
+        uint64_t centersOffset;
+    };
+    
+    struct LevelRecord
+    {
+        int32_t roi[4];
+        int32_t etaF;
+        int32_t numPixels;
+        int32_t numIDs;
+        uint64_t bitMaskOffset;
+        uint64_t pixelDataOffset;
+    };
+    
+    const uchar *data;
+    size_t dataSize;
+    
+    const FileHeader *header;
+    const TemplateRecord *templateRecords;
+    const LevelRecord *levelRecords;
+};
+
+#endif /* TEMPLATE_DATABASE_H */
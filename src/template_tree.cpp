@@ -0,0 +1,230 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "template_tree.h"
+#include "template_view.h"
+
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+using namespace cv;
+
+// the intersection over union of two silhouettes given their overlap and sizes
+static float computeSimilarity(int overlap, int etaF1, int etaF2)
+{
+    int united = etaF1 + etaF2 - overlap;
+    
+    return united > 0 ? (float)overlap/united : 1.0f;
+}
+
+
+TemplateTree::TemplateTree()
+{
+    level = 0;
+    branching = 2;
+    root = -1;
+}
+
+
+void TemplateTree::build(const vector<TemplateView*> &templateViews, int level, int branching)
+{
+    clear();
+    
+    this->level = level;
+    this->branching = max(branching, 2);
+    
+    if(templateViews.empty())
+        return;
+    
+    vector<int> members(templateViews.size());
+    for(int i = 0; i < members.size(); i++)
+    {
+        members[i] = i;
+    }
+    
+    root = buildNode(templateViews, members);
+}
+
+
+void TemplateTree::clear()
+{
+    nodes.clear();
+    root = -1;
+}
+
+
+int TemplateTree::getLevel() const
+{
+    return level;
+}
+
+
+int TemplateTree::getRoot() const
+{
+    return root;
+}
+
+
+const TemplateTree::Node &TemplateTree::getNode(int index) const
+{
+    return nodes[index];
+}
+
+
+int TemplateTree::computeAlignedOverlap(const BitMask &mask1, const BitMask &mask2, int radius)
+{
+    Rect roi(0, 0, mask2.cols(), mask2.rows());
+    
+    // the offset of the second mask within the first one at which both centers coincide
+    int offsetX = (mask1.cols() - mask2.cols())/2;
+    int offsetY = (mask1.rows() - mask2.rows())/2;
+    
+    int maxOverlap = 0;
+    
+    for(int dy = -radius; dy <= radius; dy++)
+    {
+        for(int dx = -radius; dx <= radius; dx++)
+        {
+            maxOverlap = max(maxOverlap, mask1.countOverlap(mask2, roi, offsetX + dx, offsetY + dy));
+        }
+    }
+    
+    return maxOverlap;
+}
+
+
+int TemplateTree::buildNode(const vector<TemplateView*> &templateViews, const vector<int> &members)
+{
+    int n = (int)members.size();
+    
+    // the template with the largest silhouette represents the node
+    int rep = 0;
+    for(int i = 1; i < n; i++)
+    {
+        if(templateViews[members[i]]->getEtaF(level) > templateViews[members[rep]]->getEtaF(level))
+            rep = i;
+    }
+    
+    Node node;
+    node.templateIndex = members[rep];
+    node.maxMissing = 0;
+    node.minEtaF = INT_MAX;
+    
+    // the similarities of all templates to the cluster centers, of which the representative is the first one
+    vector<int> centers(1, rep);
+    vector<vector<float> > similarities(1, vector<float>(n));
+    vector<float> maxSimilarity(n);
+    vector<bool> isCenter(n, false);
+    isCenter[rep] = true;
+    
+    const BitMask &repMask = templateViews[members[rep]]->getBitMask(level);
+    int repEtaF = templateViews[members[rep]]->getEtaF(level);
+    
+    for(int i = 0; i < n; i++)
+    {
+        int etaF = templateViews[members[i]]->getEtaF(level);
+        int overlap = (i == rep) ? etaF : computeAlignedOverlap(repMask, templateViews[members[i]]->getBitMask(level), 2);
+        
+        node.maxMissing = max(node.maxMissing, etaF - overlap);
+        node.minEtaF = min(node.minEtaF, etaF);
+        
+        similarities[0][i] = computeSimilarity(overlap, repEtaF, etaF);
+        maxSimilarity[i] = similarities[0][i];
+    }
+    
+    if(n == 1)
+    {
+        nodes.push_back(node);
+        return (int)nodes.size() - 1;
+    }
+    
+    // the templates least similar to all previous centers become the further centers
+    while((int)centers.size() < min(branching, n))
+    {
+        int c = -1;
+        for(int i = 0; i < n; i++)
+        {
+            if(!isCenter[i] && (c < 0 || maxSimilarity[i] < maxSimilarity[c]))
+                c = i;
+        }
+        centers.push_back(c);
+        isCenter[c] = true;
+        
+        const BitMask &centerMask = templateViews[members[c]]->getBitMask(level);
+        int centerEtaF = templateViews[members[c]]->getEtaF(level);
+        
+        similarities.push_back(vector<float>(n));
+        
+        for(int i = 0; i < n; i++)
+        {
+            int etaF = templateViews[members[i]]->getEtaF(level);
+            int overlap = (i == c) ? etaF : computeAlignedOverlap(centerMask, templateViews[members[i]]->getBitMask(level), 2);
+            
+            similarities.back()[i] = computeSimilarity(overlap, centerEtaF, etaF);
+            maxSimilarity[i] = max(maxSimilarity[i], similarities.back()[i]);
+        }
+    }
+    
+    // every center forms its own cluster, all other templates join the most similar center
+    vector<vector<int> > clusters(centers.size());
+    
+    for(int i = 0; i < n; i++)
+    {
+        int k = 0;
+        if(isCenter[i])
+        {
+            k = (int)(find(centers.begin(), centers.end(), i) - centers.begin());
+        }
+        else
+        {
+            for(int j = 1; j < centers.size(); j++)
+            {
+                if(similarities[j][i] > similarities[k][i])
+                    k = j;
+            }
+        }
+        clusters[k].push_back(members[i]);
+    }
+    
+    // the children are added before their parent, such that the indices remain valid
+    for(int k = 0; k < clusters.size(); k++)
+    {
+        node.children.push_back(buildNode(templateViews, clusters[k]));
+    }
+    
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
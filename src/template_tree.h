@@ -0,0 +1,139 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPLATE_TREE_H
+#define TEMPLATE_TREE_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "bit_mask.h"
+
+class TemplateView;
+
+/**
+ *  A hierarchical index of a set of template views clustering them by the similarity
+ *  of their silhouettes (intersection over union of their masks) at one pyramid level.
+ *  Each node is represented by one of the templates in its subtree, which is the one
+ *  with the largest silhouette, such that the representative covers the other
+ *  silhouettes as far as possible. For every node the largest number of silhouette
+ *  pixels of any template in the subtree not covered by the representative is stored,
+ *  which bounds the overlap of all these templates with any binary image by the
+ *  overlap of the representative. This allows to search the templates coarse-to-fine
+ *  and to skip whole subtrees in a branch-and-bound manner. The tree only stores the
+ *  indices of the templates, which therefore must not be reordered after it was built.
+ */
+class TemplateTree
+{
+public:
+    struct Node
+    {
+        // the index of the representative template, which is part of the subtree
+        int templateIndex;
+        
+        // the indices of all child nodes, which are empty for leaves
+        std::vector<int> children;
+        
+        // the largest number of silhouette pixels of any template in the subtree not covered by the representative
+        int maxMissing;
+        
+        // the smallest number of silhouette pixels of any template in the subtree
+        int minEtaF;
+    };
+    
+    TemplateTree();
+    
+    /**
+     *  Clusters a set of templates top-down, where the templates of each node are
+     *  split into the given number of clusters around the most distinct templates.
+     *
+     *  @param  templateViews The templates to be indexed.
+     *  @param  level The pyramid level of the template masks to be compared.
+     *  @param  branching The maximum number of children per node.
+     */
+    void build(const std::vector<TemplateView*> &templateViews, int level, int branching);
+    
+    /**
+     *  Removes all nodes of the tree.
+     */
+    void clear();
+    
+    /**
+     *  Returns the pyramid level at which the templates have been compared.
+     *
+     *  @return  The pyramid level of the tree.
+     */
+    int getLevel() const;
+    
+    /**
+     *  Returns the index of the root node.
+     *
+     *  @return  The index of the root node or -1 if the tree is empty.
+     */
+    int getRoot() const;
+    
+    /**
+     *  Returns a node of the tree.
+     *
+     *  @param  index The index of the node.
+     *  @return  The node.
+     */
+    const Node &getNode(int index) const;
+    
+    /**
+     *  Computes the largest number of pixels set in two masks when placing them on top
+     *  of each other with their centers aligned up to a given number of pixels.
+     *
+     *  @param  mask1 The first mask.
+     *  @param  mask2 The second mask.
+     *  @param  radius The largest displacement of the centers in both directions.
+     *  @return  The largest overlap of both masks.
+     */
+    static int computeAlignedOverlap(const BitMask &mask1, const BitMask &mask2, int radius);
+    
+private:
+    int level;
+    
+    int branching;
+    
+    int root;
+    
+    std::vector<Node> nodes;
+    
+    int buildNode(const std::vector<TemplateView*> &templateViews, const std::vector<int> &members);
+};
+
+#endif //TEMPLATE_TREE_H
@@ -35,31 +35,51 @@
 
 #include "template_view.h"
 
+#include <cstring>
+
 using namespace std;
 using namespace cv;
 
-TemplateView::TemplateView(Object3D *object, float alpha, float beta, float gamma, float distance, int numLevels, bool generateNeighbors)
+CompressedPixelData::CompressedPixelData()
 {
-    T_cm = Transformations::translationMatrix(0, 0, distance)*Transformations::rotationMatrix(gamma, Vec3f(0, 0, 1))*Transformations::rotationMatrix(alpha, Vec3f(1, 0, 0))*Transformations::rotationMatrix(beta, Vec3f(0, 1, 0));
-    
-    object->setPose(T_cm);
-    
-    renderingEngine = RenderingEngine::Instance();
-    
-    renderingEngine->setLevel(0);
-    renderingEngine->renderSilhouette(object, GL_FILL, false, 1.0f, 1.0f, 1.0f, true);
+    numPixels = 0;
+    numIDs = 0;
     
-    Mat mask0 = renderingEngine->downloadFrame(RenderingEngine::MASK);
-    Mat depth0 = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
-    
-    Matx33f K = renderingEngine->getCalibrationMatrix().get_minor<3, 3>(0, 0);
-    
-    float zNear = renderingEngine->getZNear();
-    float zFar = renderingEngine->getZFar();
+    x = NULL;
+    y = NULL;
+    idsOffsets = NULL;
+    ids = NULL;
+    hsVal = NULL;
+}
+
+size_t CompressedPixelData::computeSize(int numPixels, int numIDs)
+{
+    return (2*numPixels + numPixels + 1 + numIDs)*sizeof(int) + numPixels*sizeof(uchar);
+}
+
+void CompressedPixelData::setData(const void *block, int numPixels, int numIDs)
+{
+    this->numPixels = numPixels;
+    this->numIDs = numIDs;
     
-    TCLCHistograms *tclcHistograms = object->getTCLCHistograms();
+    const int *data = (const int*)block;
     
-    int m_id = object->getModelID();
+    x = data;
+    y = x + numPixels;
+    idsOffsets = y + numPixels;
+    ids = idsOffsets + numPixels + 1;
+    hsVal = (const uchar*)(ids + numIDs);
+}
+
+const void *CompressedPixelData::getData() const
+{
+    return x;
+}
+
+
+TemplateView::TemplateView(Object3D *object, float alpha, float beta, float gamma, float distance, int numLevels, const Mat &mask, const Mat &depth, const Matx33f &K)
+{
+    T_cm = computePose(alpha, beta, gamma, distance);
     
     _alpha = alpha;
     _beta = beta;
@@ -69,151 +89,159 @@ TemplateView::TemplateView(Object3D *object, float alpha, float beta, float gamm
     
     _numLevels = numLevels;
     
-    centersIDsPyramid.resize(_numLevels);
-    roiPyramid.resize(_numLevels);
-    etaFPyramid.resize(_numLevels);
-    maskPyramid.resize(_numLevels);
-    sdtPyramid.resize(_numLevels);
-    heavisidePyramid.resize(_numLevels);
-    pixelDataPyramid.resize(_numLevels);
-    
-    SignedDistanceTransform2D SDT2D(8.0f);
-    
-    Size maxSize = mask0.size();
-    
-    for(int level = 2; level < _numLevels; level++)
+    vector<Mat> masks(numLevels), depths(numLevels);
+    masks[0] = mask;
+    depths[0] = depth;
+    for(int level = 1; level < numLevels; level++)
     {
-        int scale = pow(2, level);
-  
-        tclcHistograms->updateCentersAndIds(mask0/255*m_id, depth0, K, zNear, zFar, 0);
-    
-        std::vector<cv::Point3i> centersIDs = tclcHistograms->getCentersAndIDs();
-        
-        centersIDsPyramid[level] = centersIDs;
+        RenderingEngine::reduceSilhouette(masks[level-1], depths[level-1], masks[level], depths[level]);
+    }
     
-        int offset = tclcHistograms->getRadius()/pow(2, level);
+    computeTemplateData(object, masks, depth, K);
+}
+
+
+TemplateView::TemplateView()
+{
+    _alpha = 0;
+    _beta = 0;
+    _gamma = 0;
     
-        Rect roi = computeBoundingBox(centersIDs, offset, level, Size(maxSize.width/scale, maxSize.height/scale));
-        
-        roiPyramid[level] = roi;
+    _distance = 0;
     
-        renderingEngine->setLevel(level);
-        renderingEngine->renderSilhouette(object, GL_FILL, false, 1.0f, 1.0f, 1.0f, true);
-        
-        Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-        mask = mask(roi).clone();
-        
-        etaFPyramid[level] = countNonZero(mask);
-        
-        maskPyramid[level] = mask*255;
-        
-        Mat sdt, xyPos;
-        SDT2D.computeTransform(mask, sdt, xyPos, 8);
-    
-        sdtPyramid[level] = sdt;
-        
-        Mat heaviside;
-        parallel_for_(cv::Range(0, 8), Parallel_For_convertToHeaviside(sdt, heaviside, 8));
-        
-        heavisidePyramid[level] = heaviside;
-        
-        compressTemplateData(centersIDs, heaviside, roi, tclcHistograms->getRadius(), level);
-    }
+    _numLevels = 0;
 }
 
 
 TemplateView::~TemplateView()
 {
-    for(int i = 0; i < pixelDataPyramid.size(); i++)
-    {
-        for(int j = 0; j < pixelDataPyramid[i].size(); j++)
-        {
-            delete[] pixelDataPyramid[i][j].ids;
-        }
-        pixelDataPyramid[i].clear();
-    }
-    pixelDataPyramid.clear();
+    
 }
 
-Matx44f TemplateView::getPose()
+Matx44f TemplateView::computePose(float alpha, float beta, float gamma, float distance)
+{
+    return Transformations::translationMatrix(0, 0, distance)*Transformations::rotationMatrix(gamma, Vec3f(0, 0, 1))*Transformations::rotationMatrix(alpha, Vec3f(1, 0, 0))*Transformations::rotationMatrix(beta, Vec3f(0, 1, 0));
+}
+
+Matx44f TemplateView::getPose() const
 {
     return T_cm;
 }
 
-float TemplateView::getAlpha()
+float TemplateView::getAlpha() const
 {
     return _alpha;
 }
 
-float TemplateView::getBeta()
+float TemplateView::getBeta() const
 {
     return _beta;
 }
 
-float TemplateView::getGamma()
+float TemplateView::getGamma() const
 {
     return _gamma;
 }
 
-float TemplateView::getDistance()
+float TemplateView::getDistance() const
 {
     return _distance;
 }
 
-int TemplateView::getEtaF(int level)
+int TemplateView::getEtaF(int level) const
 {
     return etaFPyramid[level];
 }
 
-Mat TemplateView::getMask(int level)
+const BitMask &TemplateView::getBitMask(int level) const
 {
-    return maskPyramid[level];
+    return bitMaskPyramid[level];
 }
 
-Mat TemplateView::getSDT(int level)
-{
-    return sdtPyramid[level];
-}
-
-Mat TemplateView::getHeaviside(int level)
-{
-    return heavisidePyramid[level];
-}
-
-Rect TemplateView::getROI(int level)
+Rect TemplateView::getROI(int level) const
 {
     return roiPyramid[level];
 }
 
-Point3f TemplateView::getCurrentOffset(int level)
+const vector<Point3i> &TemplateView::getCentersAndIDs() const
 {
-    return currentOffset;
+    return centersIDs;
 }
 
-void TemplateView::setCurrentOffset(Point3f &offset, int level)
+
+const CompressedPixelData &TemplateView::getCompressedPixelData(int level) const
 {
-    currentOffset = offset;
+    return pixelDataPyramid[level];
 }
 
-vector<Point3i> TemplateView::getCentersAndIDs(int level)
+void TemplateView::addNeighborTemplate(TemplateView *kv)
 {
-    return centersIDsPyramid[level];
+    neighbors.push_back(kv);
 }
 
-
-std::vector<PixelData>& TemplateView::getCompressedPixelData(int level)
+const std::vector<TemplateView*> &TemplateView::getNeighborTemplates() const
 {
-    return pixelDataPyramid[level];
+    return neighbors;
 }
 
-void TemplateView::addNeighborTemplate(TemplateView *kv)
+size_t TemplateView::getMemoryUsage() const
 {
-    neighbors.push_back(kv);
+    size_t size = sizeof(TemplateView);
+    
+    size += centersIDs.size()*sizeof(Point3i);
+    size += neighbors.size()*sizeof(TemplateView*);
+    
+    for(int level = 0; level < _numLevels; level++)
+    {
+        size += bitMaskPyramid[level].getDataSize();
+        size += CompressedPixelData::computeSize(pixelDataPyramid[level].numPixels, pixelDataPyramid[level].numIDs);
+    }
+    
+    return size;
 }
 
-std::vector<TemplateView*> TemplateView::getNeighborTemplates()
+void TemplateView::computeTemplateData(Object3D *object, const vector<Mat> &masks, const Mat &depth, const Matx33f &K)
 {
-    return neighbors;
+    TCLCHistograms *tclcHistograms = object->getTCLCHistograms();
+    
+    int m_id = object->getModelID();
+    
+    roiPyramid.resize(_numLevels);
+    etaFPyramid.resize(_numLevels);
+    bitMaskPyramid.resize(_numLevels);
+    pixelDataPyramid.resize(_numLevels);
+    pixelDataStorage.resize(_numLevels);
+    
+    SignedDistanceTransform2D SDT2D;
+    
+    Size maxSize = masks[0].size();
+    
+    // the centers are computed at full resolution without changing the current ones of the object
+    centersIDs = tclcHistograms->computeCentersAndIds(masks[0]/255*m_id, depth, K, T_cm, 0);
+    
+    // the lower levels are not used for pose detection and are left empty
+    for(int level = MIN_LEVEL; level < _numLevels; level++)
+    {
+        int scale = pow(2, level);
+    
+        int offset = tclcHistograms->getRadius()/pow(2, level);
+    
+        Rect roi = computeBoundingBox(centersIDs, offset, level, Size(maxSize.width/scale, maxSize.height/scale));
+        
+        roiPyramid[level] = roi;
+    
+        Mat mask = masks[level](roi).clone();
+        
+        etaFPyramid[level] = countNonZero(mask);
+        
+        bitMaskPyramid[level] = BitMask(mask);
+        
+        SignedDistanceBand band;
+        SDT2D.computeTransform(mask, band, 8);
+        
+        // only the compressed Heaviside values within the band are kept
+        compressTemplateData(centersIDs, band.heaviside, roi, tclcHistograms->getRadius(), level);
+    }
 }
 
 void TemplateView::compressTemplateData(const std::vector<cv::Point3i>& centersIDs, const cv::Mat &heaviside, const cv::Rect& roi, int radius, int level)
@@ -224,6 +252,11 @@ void TemplateView::compressTemplateData(const std::vector<cv::Point3i>& centersI
     
     float *hsData = (float*)heaviside.ptr<float>();
     
+    vector<int> xs, ys;
+    vector<uchar> hsVals;
+    vector<int> idsOffsets(1, 0);
+    vector<int> ids;
+    
     for(int j = 0; j < roi.height; j++)
     {
         int idx = j*roi.width;
@@ -234,7 +267,7 @@ void TemplateView::compressTemplateData(const std::vector<cv::Point3i>& centersI
             
             if(hsVal >= 0.0f)
             {
-                vector<int> ids;
+                int numIDs = (int)ids.size();
                 for(int h = 0; h < numHistograms; h++)
                 {
                     cv::Point3i centerID = centersIDs[h];
@@ -249,25 +282,35 @@ void TemplateView::compressTemplateData(const std::vector<cv::Point3i>& centersI
                     }
                 }
                 
-                if(ids.size() > 1)
+                if(ids.size() - numIDs > 1)
                 {
-                    PixelData pixelData;
-                    pixelData.x = i;
-                    pixelData.y = j;
-                    pixelData.hsVal = hsVal;
-                    pixelData.ids_size = (int)ids.size();
-                    pixelData.ids = new int[pixelData.ids_size];
-                    
-                    for(int k = 0; k < ids.size(); k++)
-                    {
-                        pixelData.ids[k] = ids[k];
-                    }
-                    
-                    pixelDataPyramid[level].push_back(pixelData);
+                    xs.push_back(i);
+                    ys.push_back(j);
+                    hsVals.push_back(saturate_cast<uchar>(hsVal*255.0f));
+                    idsOffsets.push_back((int)ids.size());
+                }
+                else
+                {
+                    ids.resize(numIDs);
                 }
             }
         }
     }
+    
+    // copy all arrays into a single contiguous block of memory
+    int numPixels = (int)xs.size();
+    
+    vector<int> &storage = pixelDataStorage[level];
+    storage.resize((CompressedPixelData::computeSize(numPixels, (int)ids.size()) + sizeof(int) - 1)/sizeof(int));
+    
+    int *data = storage.data();
+    data = copy(xs.begin(), xs.end(), data);
+    data = copy(ys.begin(), ys.end(), data);
+    data = copy(idsOffsets.begin(), idsOffsets.end(), data);
+    data = copy(ids.begin(), ids.end(), data);
+    memcpy(data, hsVals.data(), hsVals.size()*sizeof(uchar));
+    
+    pixelDataPyramid[level].setData(storage.data(), numPixels, (int)ids.size());
 }
 
 cv::Rect TemplateView::computeBoundingBox(const std::vector<cv::Point3i> &centersIDs, int offset, int level, const cv::Size &maxSize)
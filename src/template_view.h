@@ -45,36 +45,78 @@
 #include "object3d.h"
 #include "tclc_histograms.h"
 #include "signed_distance_transform2d.h"
+#include "bit_mask.h"
 
 /**
- *  The template view data per pixel.
+ *  The linearized template view data of a single pyramid level in a structure of
+ *  arrays layout, where all arrays lie in one contiguous block of memory in the order
+ *  x, y, idsOffsets, ids, hsVal. The tclc-histogram IDs of all pixels are stored
+ *  consecutively (compressed sparse rows), such that template matching streams
+ *  linearly through memory.
  */
-struct PixelData
+struct CompressedPixelData
 {
-    // The original 2D pixel location.
-    int x;
-    int y;
+    // The number of pixels.
+    int numPixels;
     
-    // The Heaviside value.
-    float hsVal;
+    // The total number of tclc-histogram IDs of all pixels.
+    int numIDs;
     
-    // The number of tclc-histograms the pixel lies within.
-    int ids_size;
+    // The original 2D pixel locations.
+    const int *x;
+    const int *y;
     
-    // The IDs of all tclc-histograms the pixel lies within.
-    int* ids;
+    // The IDs of pixel p are ids[idsOffsets[p]], ..., ids[idsOffsets[p+1] - 1] (numPixels + 1 entries).
+    const int *idsOffsets;
+    
+    // The IDs of all tclc-histograms the pixels lie within.
+    const int *ids;
+    
+    // The Heaviside values quantized to 8 bit, i.e. multiplied by 255.
+    const uchar *hsVal;
+    
+    CompressedPixelData();
+    
+    /**
+     *  Returns the size of the contiguous block of memory holding all arrays.
+     *
+     *  @param  numPixels The number of pixels.
+     *  @param  numIDs The total number of tclc-histogram IDs of all pixels.
+     *  @return  The size of the block in bytes.
+     */
+    static size_t computeSize(int numPixels, int numIDs);
+    
+    /**
+     *  Sets all arrays to reference a given contiguous block of memory without copying it.
+     *
+     *  @param  block The block of memory of computeSize(numPixels, numIDs) bytes, aligned to 4 bytes.
+     *  @param  numPixels The number of pixels.
+     *  @param  numIDs The total number of tclc-histogram IDs of all pixels.
+     */
+    void setData(const void *block, int numPixels, int numIDs);
+    
+    /**
+     *  Returns the contiguous block of memory holding all arrays.
+     *
+     *  @return  The block of memory of computeSize(numPixels, numIDs) bytes.
+     */
+    const void *getData() const;
 };
 
 /**
  *  A class representing a single template view at multiple image scales
- *  for region-based object pose detection using tclc-histograms.
+ *  for region-based object pose detection using tclc-histograms. A template
+ *  view is not modified after it has been created, such that it can be matched
+ *  concurrently by any number of searches that keep their own results.
  */
 class TemplateView {
     
 public:
     /**
-     *  Constructor for the template view at a given object rotation and
-     *  distance to the camera.
+     *  Constructor for the template view at a given object rotation and distance to
+     *  the camera from a silhouette that has already been rendered at this pose at full
+     *  resolution (e.g. within a batch of templates). Neither the rendering engine nor
+     *  the state of the object are used, such that templates can be created in parallel.
      *
      *  @param  object The 3D object for which the template view is to be created.
      *  @param  alpha The Euler angle of the object's rotation around the x-axis (in degrees).
@@ -82,9 +124,11 @@ public:
      *  @param  gamma The Euler angle of the object's rotation around the z-axis (in degrees).
      *  @param  distance The object's distance to the camera to be used.
      *  @param  numLevels Number of template pyramid levels to be created with a downscale factor of 2.
-     *  @param  generateNeighbors A flag telling whether neighboring templates should also be created or not.
+     *  @param  mask The silhouette mask of the object rendered at pyramid level 0 with a color of 255 (single channel, uchar).
+     *  @param  depth The corresponding linear depth (single channel, float, 0 for the background).
+     *  @param  K The camera's intrinsic matrix at pyramid level 0.
      */
-    TemplateView(Object3D *object, float alpha, float beta, float gamma, float distance, int numLevels, bool generateNeighbors);
+    TemplateView(Object3D *object, float alpha, float beta, float gamma, float distance, int numLevels, const cv::Mat &mask, const cv::Mat &depth, const cv::Matx33f &K);
     
     ~TemplateView();
     
@@ -100,7 +144,7 @@ public:
      *
      *  @return  The 6DOF object pose within the template.
      */
-    cv::Matx44f getPose();
+    cv::Matx44f getPose() const;
     
     /**
      *  Returns the Euler angle of the object's rotation around the
@@ -108,7 +152,7 @@ public:
      *
      *  @return  The object's rotation around the x-axis within the template (in degrees).
      */
-    float getAlpha();
+    float getAlpha() const;
     
     /**
      *  Returns the Euler angle of the object's rotation around the
@@ -116,7 +160,7 @@ public:
      *
      *  @return  The object's rotation around the y-axis within the template (in degrees).
      */
-    float getBeta();
+    float getBeta() const;
     
     /**
      *  Returns the Euler angle of the object's rotation around the
@@ -124,7 +168,7 @@ public:
      *
      *  @return  The object's rotation around the z-axis within the template (in degrees).
      */
-    float getGamma();
+    float getGamma() const;
     
     /**
      *  Returns the object's distance to the camera coresponding to
@@ -132,7 +176,7 @@ public:
      *
      *  @return  The object's distance to the camera within the template.
      */
-    float getDistance();
+    float getDistance() const;
     
     /**
      *  Returns the total number of pixels in the object region at a given
@@ -141,34 +185,16 @@ public:
      *  @param level The pyramid level to be used.
      *  @return  The total number of pixels in the object region within the template.
      */
-    int getEtaF(int level);
+    int getEtaF(int level) const;
     
     /**
-     *  Returns the binary mask image of the template at a given pyramid
-     *  level.
+     *  Returns the bit-packed binary mask of the template at a given pyramid
+     *  level, which is used to quickly count its overlap with an image.
      *
      *  @param level The pyramid level to be used.
-     *  @return  The binary mask image of the template.
+     *  @return  The bit-packed binary mask of the template.
      */
-    cv::Mat getMask(int level);
-    
-    /**
-     *  Returns the 2D signed distance transform of the binary mask of the
-     *  template at a given pyramid level.
-     *
-     *  @param level The pyramid level to be used.
-     *  @return  The 2D signed distance transform of the binary mask of the template.
-     */
-    cv::Mat getSDT(int level);
-    
-    /**
-     *  Returns the smoothed Heaviside representation of the 2D signed distance
-     *  transform of the template at a given pyramid level.
-     *
-     *  @param level The pyramid level to be used.
-     *  @return  The smoothed Heaviside representation of the 2D signed distance transform of the template.
-     */
-    cv::Mat getHeaviside(int level);
+    const BitMask &getBitMask(int level) const;
     
     /**
      *  Returns the 2D region of interest around the object in the template at
@@ -177,34 +203,15 @@ public:
      *  @param level The pyramid level to be used.
      *  @return  The 2D region of interest around the object in the template.
      */
-    cv::Rect getROI(int level);
-    
-    /**
-     *  Returns the 2D (x, y) offset at which the template currently matches
-     *  best with the corresponding matching score at a given pyramid level.
-     *
-     *  @param level The pyramid level to be used.
-     *  @return  The 2D offset with the matching score (x, y, score).
-     */
-    cv::Point3f getCurrentOffset(int level);
-    
-    /**
-     *  Sets the 2D (x, y) offset at which the template currently matches
-     *  best with the corresponding matching score at a given pyramid level.
-     *
-     *  @param offset The 2D offset with the matching score (x, y, score).
-     *  @param level The pyramid level to be used.
-     */
-    void setCurrentOffset(cv::Point3f &offset, int level);
+    cv::Rect getROI(int level) const;
     
     /**
      *  Returns the 2D centers and IDs of all tclc-histograms in the
-     *  template at a given pyramid level.
+     *  template, which are located at pyramid level 0 for all levels.
      *
-     *  @param level The pyramid level to be used.
      *  @return  The 2D centers and IDs of all tclc-histograms in the template [(x_0, y_0, id_0), (x_1, y_1, id_1), ...].
      */
-    std::vector<cv::Point3i> getCentersAndIDs(int level);
+    const std::vector<cv::Point3i> &getCentersAndIDs() const;
     
     /**
      *  Returns a linearized representation of the template at a given pyramid
@@ -213,7 +220,7 @@ public:
      *  @param level The pyramid level to be used.
      *  @return  The linearized representation of the template.
      */
-    std::vector<PixelData> &getCompressedPixelData(int level);
+    const CompressedPixelData &getCompressedPixelData(int level) const;
     
     /**
      *  Adds a neighboring template view to this template.
@@ -227,25 +234,55 @@ public:
      *
      *  @return  The set of all neighboring templates of this template.
      */
-    std::vector<TemplateView*> getNeighborTemplates();
+    const std::vector<TemplateView*> &getNeighborTemplates() const;
+    
+    /**
+     *  Returns the approximate amount of memory used by the template view,
+     *  including the data that references a template file.
+     *
+     *  @return  The memory used by the template view in bytes.
+     */
+    size_t getMemoryUsage() const;
+    
+    /**
+     *  Computes the 6DOF object pose of a template view at a given object rotation and
+     *  distance to the camera.
+     *
+     *  @param  alpha The Euler angle of the object's rotation around the x-axis (in degrees).
+     *  @param  beta The Euler angle of the object's rotation around the y-axis (in degrees).
+     *  @param  gamma The Euler angle of the object's rotation around the z-axis (in degrees).
+     *  @param  distance The object's distance to the camera.
+     *  @return  The 6DOF object pose of the template view.
+     */
+    static cv::Matx44f computePose(float alpha, float beta, float gamma, float distance);
+    
+    /**
+     *  The lowest pyramid level for which template data is kept, since only the
+     *  levels from here on are used for pose detection.
+     */
+    static const int MIN_LEVEL = 2;
     
 private:
-    RenderingEngine *renderingEngine;
+    friend class TemplateDatabase;
+    
+    /**
+     *  Constructor for an empty template view that is filled from a template file.
+     */
+    TemplateView();
     
     cv::Matx44f T_cm;
     
     std::vector<int> etaFPyramid;
-    std::vector<cv::Mat> maskPyramid;
-    std::vector<cv::Mat> sdtPyramid;
-    std::vector<cv::Mat> heavisidePyramid;
+    std::vector<BitMask> bitMaskPyramid;
     
     std::vector<cv::Rect> roiPyramid;
     
-    std::vector<std::vector<cv::Point3i> > centersIDsPyramid;
+    std::vector<cv::Point3i> centersIDs;
     
-    std::vector<std::vector<PixelData> > pixelDataPyramid;
+    std::vector<CompressedPixelData> pixelDataPyramid;
     
-    cv::Point3f currentOffset;
+    // the memory of the compressed pixel data per level unless it references a template file
+    std::vector<std::vector<int> > pixelDataStorage;
     
     float _alpha;
     float _beta;
@@ -257,6 +294,8 @@ private:
     
     std::vector<TemplateView*> neighbors;
     
+    void computeTemplateData(Object3D *object, const std::vector<cv::Mat> &masks, const cv::Mat &depth, const cv::Matx33f &K);
+    
     void compressTemplateData(const std::vector<cv::Point3i> &centersIDs, const cv::Mat &heaviside, const cv::Rect &roi, int radius, int level);
     
     cv::Rect computeBoundingBox(const std::vector<cv::Point3i> &centersIDs, int offset, int level, const cv::Size &maxSize);
@@ -265,55 +304,63 @@ private:
 
 /**
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
- *  computations. Within the corresponding for loop, every pixel of a given 2D
- *  signed distance transform is mapped to its correspoding value in the
- *  smoothed Heaviside function representation.
+ *  computations. Within the corresponding for loop, a template view is created
+ *  from an already rendered silhouette for each given viewpoint, which includes
+ *  computing its histogram centers, signed distance transforms and compressed
+ *  pixel data.
  */
-class Parallel_For_convertToHeaviside: public cv::ParallelLoopBody
+class Parallel_For_createTemplateViews: public cv::ParallelLoopBody
 {
 private:
-    cv::Mat _sdt, _heaviside;
+    Object3D *_object;
+    
+    std::vector<cv::Vec4f> _viewpoints;
     
-    float *sdtData, *hsData;
+    std::vector<cv::Mat> _masks;
+    std::vector<cv::Mat> _depths;
+    
+    cv::Matx33f _K;
+    
+    int _numLevels;
+    
+    TemplateView **_templateViews;
     
     int _threads;
     
 public:
-    Parallel_For_convertToHeaviside(const cv::Mat &sdt, cv::Mat &heaviside, int threads)
+    Parallel_For_createTemplateViews(Object3D *object, const std::vector<cv::Vec4f> &viewpoints, const std::vector<cv::Mat> &masks, const std::vector<cv::Mat> &depths, const cv::Matx33f &K, int numLevels, TemplateView **templateViews, int threads)
     {
-        _sdt = sdt;
+        _object = object;
         
-        heaviside.create(_sdt.rows, _sdt.cols, CV_32FC1);
-        _heaviside = heaviside;
+        _viewpoints = viewpoints;
         
-        sdtData = _sdt.ptr<float>();
-        hsData = _heaviside.ptr<float>();
+        _masks = masks;
+        _depths = depths;
+        
+        _K = K;
+        
+        _numLevels = numLevels;
+        
+        _templateViews = templateViews;
         
         _threads = threads;
     }
     
     virtual void operator()( const cv::Range &r ) const
     {
-        int range = _sdt.rows/_threads;
+        int range = (int)_viewpoints.size()/_threads;
         
-        int yEnd = r.end*range;
+        int vEnd = r.end*range;
         if(r.end == _threads)
         {
-            yEnd = _sdt.rows;
+            vEnd = (int)_viewpoints.size();
         }
         
-        float s = 1.2f;
-        
-        for(int y = r.start*range; y < yEnd; y++)
+        for(int v = r.start*range; v < vEnd; v++)
         {
-            float* sdtRow = sdtData + y*_sdt.cols;
-            float* hsRow = hsData + y*_heaviside.cols;
+            cv::Vec4f viewpoint = _viewpoints[v];
             
-            for(int x = 0; x < _sdt.cols; x++)
-            {
-                float dist = sdtRow[x];
-                hsRow[x] = (fabs(dist) <= 8.0f) ? 1.0f/float(CV_PI)*(-atan(dist*s)) + 0.5f : -1.0f;
-            }
+            _templateViews[v] = new TemplateView(_object, viewpoint[0], viewpoint[1], viewpoint[2], viewpoint[3], _numLevels, _masks[v], _depths[v], _K);
         }
     }
 };